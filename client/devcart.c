@@ -23,14 +23,85 @@ enum {
     FUNC_EXEC,
     FUNC_PRINT,
     FUNC_QUIT,
-    FUNC_CHGDIR
+    FUNC_CHGDIR,
+    FUNC_ACK,
+    FUNC_CHECKSUM,
+    FUNC_RESYNC,
+    FUNC_RESYNC_ACK,
+    FUNC_READSECTORS,
+    FUNC_FILL,
+    FUNC_RELOAD
 };
 
+// flags byte after the filename in a download request
+#define DOWNLOAD_FILLS (1 << 0)
+// flags byte of a reload poll, return to the hook instead of restarting
+#define RELOAD_HOOK (1 << 0)
+// writing 1 to the cache purge bit of CCR invalidates every line
+#define CACHE_CCR (*(volatile Uint8*)(0xfffffe92))
+#define CACHE_PURGE (1 << 4)
+
+// everything to and from the server is sent as frames:
+// sync, channel, sequence number, length (2 bytes, big endian),
+// crc of the header, payload
+#define FRAME_SYNC (0x5a)
+#define FRAME_HEADER_SIZE (6)
+#define FRAME_MAX_PAYLOAD (1024)
+enum {
+    CHAN_CONTROL = 0,
+    CHAN_CONSOLE,
+    CHAN_STREAM,
+    CHAN_BULK
+};
+
+// bundle layout, see server/bundle.h
+#define BUNDLE_HEADER_SIZE (12)
+#define BUNDLE_ENTRY_SIZE (32)
+#define BUNDLE_NAME_SIZE (24)
+
+#define DEVCART_NO_FILE (0xffffffff)
+#define DEVCART_SECTOR_SIZE (2048)
+// how long to wait for the server between frames, a few seconds
+#define DEVCART_TIMEOUT_POLLS (0x800000)
+
+// set while a frame is being sent. prints that happen meanwhile (from an
+// interrupt handler) are queued and sent at the next frame boundary.
+static volatile int tx_busy = 0;
+static char console_buf[256];
+static volatile Uint8 console_head = 0;
+static volatile Uint8 console_tail = 0;
+
+// frame sequence numbers, they restart at 1 after a resync
+static Uint8 tx_seq = 0;
+static Uint8 rx_seq = 0;
+static Uint8 resync_nonce = 0;
+static int resyncs = 0;
+// the last server resync we answered. it repeats requests until it
+// hears back, so the same one can turn up again
+static Uint8 answered_nonce = 0;
+static int answered = 0;
+// watch mode reloads return here instead of restarting the program
+static void (*reload_hook)(void) = NULL;
+
+static void Devcart_FlushConsole(void);
+
 static inline Uint8 Devcart_GetByte(void) {
     while ((USB_FLAGS & USB_RXF) != 0);
     return USB_FIFO;
 }
 
+static int Devcart_GetByteTimeout(Uint8 *byte) {
+    Uint32 polls = DEVCART_TIMEOUT_POLLS;
+
+    while ((USB_FLAGS & USB_RXF) != 0) {
+        if (--polls == 0) {
+            return 0;
+        }
+    }
+    *byte = USB_FIFO;
+    return 1;
+}
+
 static Uint32 Devcart_GetDword(void) {
     Uint32 tmp = Devcart_GetByte();
     tmp = (tmp << 8) | Devcart_GetByte();
@@ -45,76 +116,473 @@ static inline void Devcart_PutByte(Uint8 byte) {
     USB_FIFO = byte;
 }
 
-int Devcart_LoadFile(char *filename, void *dest) {
-    Uint8 *ptr = (Uint8 *)dest;
-    Uint8 letter;
-    int len;
-    crc_t readchecksum;
-    crc_t checksum = crc_init();
+static Uint8 Devcart_HeaderCrc(Uint8 *header) {
+    return crc_finalize(crc_update(crc_init(), header, FRAME_HEADER_SIZE - 1));
+}
 
-    //tell server we want to download a file
-    Devcart_PutByte(FUNC_DOWNLOAD);
-    //tell server the filename we want to download
-    for (int i = 0;; i++) {
-        letter = (Uint8)filename[i];
-        Devcart_PutByte(letter);
-        if (letter == '\0') {
+static void Devcart_PutHeader(Uint8 channel, Uint8 seq, Uint16 len) {
+    Uint8 header[FRAME_HEADER_SIZE];
+
+    header[0] = FRAME_SYNC;
+    header[1] = channel;
+    header[2] = seq;
+    header[3] = (Uint8)(len >> 8);
+    header[4] = (Uint8)len;
+    header[5] = Devcart_HeaderCrc(header);
+    for (int i = 0; i < FRAME_HEADER_SIZE; i++) {
+        Devcart_PutByte(header[i]);
+    }
+}
+
+static void Devcart_PutFrameHeader(Uint8 channel, Uint16 len) {
+    Devcart_PutHeader(channel, tx_seq++, len);
+}
+
+static int Devcart_HeaderValid(Uint8 *header) {
+    return header[0] == FRAME_SYNC && header[1] <= CHAN_BULK &&
+           Devcart_HeaderCrc(header) == header[5] &&
+           ((header[3] << 8) | header[4]) <= FRAME_MAX_PAYLOAD;
+}
+
+// reads a frame header, returns 0 if it's garbled or the server went quiet.
+// *in_sequence is cleared if frames went missing before this one
+static int Devcart_GetFrameHeader(Uint8 *channel, Uint16 *len, int *in_sequence) {
+    Uint8 header[FRAME_HEADER_SIZE];
+
+    for (int i = 0; i < FRAME_HEADER_SIZE; i++) {
+        if (!Devcart_GetByteTimeout(&header[i])) {
+            return 0;
+        }
+    }
+    if (!Devcart_HeaderValid(header)) {
+        return 0;
+    }
+
+    *channel = header[1];
+    *len = (header[3] << 8) | header[4];
+    *in_sequence = header[2] == rx_seq;
+    rx_seq = header[2] + 1;
+    return 1;
+}
+
+// resync requests and answers go out with sequence number 0
+static void Devcart_SendResync(Uint8 command, Uint8 nonce) {
+    tx_busy = 1;
+    Devcart_PutHeader(CHAN_CONTROL, 0, 2);
+    Devcart_PutByte(command);
+    Devcart_PutByte(nonce);
+    tx_seq = 1;
+    tx_busy = 0;
+}
+
+static void Devcart_SkipBytes(int len) {
+    for (int i = 0; i < len; i++) {
+        Devcart_GetByte();
+    }
+}
+
+// lost track of the frames from the server. ask it to drop whatever it was
+// sending, then skip everything until the answer comes back
+static void Devcart_Resync(void) {
+    Uint8 header[FRAME_HEADER_SIZE];
+    Uint8 nonce = ++resync_nonce;
+    Uint8 command, value;
+    Uint16 len;
+    int have = 0;
+    int i, j;
+
+    resyncs++;
+    Devcart_SendResync(FUNC_RESYNC, nonce);
+    for (;;) {
+        if (!Devcart_GetByteTimeout(&header[have])) {
+            // the request or its answer got lost, ask again
+            Devcart_SendResync(FUNC_RESYNC, nonce);
+            have = 0;
+            continue;
+        }
+        if (have == 0 && header[0] != FRAME_SYNC) {
+            continue;
+        }
+        if (++have < FRAME_HEADER_SIZE) {
+            continue;
+        }
+
+        if (!Devcart_HeaderValid(header)) {
+            // a header could start anywhere after the first sync byte
+            for (i = 1; i < have && header[i] != FRAME_SYNC; i++);
+            for (j = 0; i < have; i++, j++) {
+                header[j] = header[i];
+            }
+            have = j;
+            continue;
+        }
+        have = 0;
+
+        len = (header[3] << 8) | header[4];
+        if (header[1] != CHAN_CONTROL || len != 2) {
+            Devcart_SkipBytes(len);
+            continue;
+        }
+        command = Devcart_GetByte();
+        value = Devcart_GetByte();
+        if (command == FUNC_RESYNC) {
+            // the server lost track as well, answering it settles both
+            Devcart_SendResync(FUNC_RESYNC_ACK, value);
+            answered = 1;
+            answered_nonce = value;
+            break;
+        }
+        if (command == FUNC_RESYNC_ACK && value == nonce) {
             break;
         }
     }
+    rx_seq = 1;
+    Devcart_FlushConsole();
+}
 
-    //pc server will send "upload" command back, read that byte
-    Devcart_GetByte();
-    //pc server sends address first, this is unnecessary since we're
-    //specifying it
-    Devcart_GetDword();
-    len = (int)Devcart_GetDword(); //file length
+// sends any queued console text as one frame
+static void Devcart_FlushConsole(void) {
+    Uint8 tail = console_tail;
+    Uint8 len = console_head - tail;
 
+    if (len == 0 || tx_busy) {
+        return;
+    }
+    tx_busy = 1;
+    Devcart_PutFrameHeader(CHAN_CONSOLE, len);
     for (int i = 0; i < len; i++) {
-        // inlining is 20K/s faster
-        while ((USB_FLAGS & USB_RXF) != 0);
-        ptr[i] = USB_FIFO;
+        Devcart_PutByte(console_buf[tail++]);
+    }
+    console_tail = tail;
+    tx_busy = 0;
+}
+
+// sends a control message: command byte followed by a string (if any)
+static void Devcart_SendControl(Uint8 command, char *string) {
+    int len = 0;
+
+    if (string) {
+        while (string[len] != '\0') {
+            len++;
+        }
+        len++;
+    }
+
+    tx_busy = 1;
+    Devcart_PutFrameHeader(CHAN_CONTROL, len + 1);
+    Devcart_PutByte(command);
+    for (int i = 0; i < len; i++) {
+        Devcart_PutByte((Uint8)string[i]);
+    }
+    tx_busy = 0;
+    Devcart_FlushConsole();
+}
+
+// writes a run the server sent as a fill instead of data
+static void Devcart_Fill(Uint8 *ptr, Uint32 len, Uint8 value) {
+    Uint32 value32 = (Uint32)value * 0x01010101u;
+    Uint32 *ptr32;
+
+    while (len > 0 && ((Uint32)ptr & 3) != 0) {
+        *ptr++ = value;
+        len--;
+    }
+    ptr32 = (Uint32 *)ptr;
+    for (; len >= 16; len -= 16) {
+        ptr32[0] = value32;
+        ptr32[1] = value32;
+        ptr32[2] = value32;
+        ptr32[3] = value32;
+        ptr32 += 4;
     }
+    for (; len >= 4; len -= 4) {
+        *ptr32++ = value32;
+    }
+    ptr = (Uint8 *)ptr32;
+    while (len-- > 0) {
+        *ptr++ = value;
+    }
+}
+
+// receives the server's answer to a download or sector read request
+static int Devcart_Receive(void *dest) {
+    Uint8 *ptr = (Uint8 *)dest;
+    Uint8 channel;
+    Uint16 frame_len;
+    Uint32 len = 0;
+    Uint32 received = 0;
+    crc_t readchecksum = 0;
+    crc_t checksum = crc_init();
+    int done = 0;
+    int failed;
+    int in_sequence;
 
-    readchecksum = Devcart_GetByte();
+    // the server sends an "upload" header, the data on the bulk channel,
+    // then the checksum
+    while (!done) {
+        if (!Devcart_GetFrameHeader(&channel, &frame_len, &in_sequence)) {
+            Devcart_Resync();
+            return -1;
+        }
+        if (channel == CHAN_CONTROL && frame_len > 0) {
+            Uint8 command = Devcart_GetByte();
+            frame_len--;
+            if (command == FUNC_RESYNC && frame_len == 1) {
+                Uint8 nonce = Devcart_GetByte();
+                Devcart_SendResync(FUNC_RESYNC_ACK, nonce);
+                rx_seq = 1;
+                if (answered && nonce == answered_nonce) {
+                    // repeat of one already answered
+                    continue;
+                }
+                // the server lost track and has dropped this request
+                answered = 1;
+                answered_nonce = nonce;
+                resyncs++;
+                Devcart_FlushConsole();
+                return -1;
+            }
+            if (command == FUNC_RESYNC_ACK) {
+                // stale answer, it restarts the sequence count like every
+                // resync frame
+                Devcart_SkipBytes(frame_len);
+                rx_seq = 1;
+                continue;
+            }
+            if (!in_sequence) {
+                Devcart_SkipBytes(frame_len);
+                Devcart_Resync();
+                return -1;
+            }
+            if (command == FUNC_UPLOAD && frame_len >= 8) {
+                //pc server sends address first, this is unnecessary since we're
+                //specifying it
+                Devcart_GetDword();
+                len = Devcart_GetDword(); //file length
+                frame_len -= 8;
+                if (len == DEVCART_NO_FILE) {
+                    Devcart_SkipBytes(frame_len);
+                    return -1;
+                }
+            }
+            else if (command == FUNC_FILL && frame_len >= 9) {
+                Uint32 offset = Devcart_GetDword();
+                Uint32 fill_len = Devcart_GetDword();
+                Uint8 value = Devcart_GetByte();
+                frame_len -= 9;
+                // the data before it has always been sent first
+                if (offset == received && fill_len <= len - received) {
+                    Devcart_Fill(&ptr[received], fill_len, value);
+                    received += fill_len;
+                }
+            }
+            else if (command == FUNC_CHECKSUM && frame_len >= 1) {
+                readchecksum = Devcart_GetByte();
+                frame_len--;
+                done = 1;
+            }
+            Devcart_SkipBytes(frame_len);
+        }
+        else if (!in_sequence) {
+            Devcart_SkipBytes(frame_len);
+            Devcart_Resync();
+            return -1;
+        }
+        else if (channel == CHAN_BULK) {
+            if (received + frame_len > len) {
+                //shouldn't happen, don't write past the buffer
+                Devcart_SkipBytes(frame_len);
+                continue;
+            }
+            for (int i = 0; i < frame_len; i++) {
+                // inlining is 20K/s faster
+                while ((USB_FLAGS & USB_RXF) != 0);
+                ptr[received++] = USB_FIFO;
+            }
+        }
+        else {
+            Devcart_SkipBytes(frame_len);
+        }
+        //prints from interrupts go out between frames
+        Devcart_FlushConsole();
+    }
 
     checksum = crc_update(checksum, ptr, len);
     checksum = crc_finalize(checksum);
+    failed = (checksum != readchecksum) || (received != len);
+
+    tx_busy = 1;
+    Devcart_PutFrameHeader(CHAN_CONTROL, 2);
+    Devcart_PutByte(FUNC_ACK);
+    Devcart_PutByte(failed);
+    tx_busy = 0;
+    Devcart_FlushConsole();
+
+    //the data is damaged, don't let anyone use it
+    return failed ? -1 : (int)len;
+}
+
+int Devcart_LoadFile(char *filename, void *dest) {
+    int len = 0;
+
+    while (filename[len] != '\0') {
+        len++;
+    }
+
+    //tell server we want to download a file, long runs of one value can
+    //come as fills
+    tx_busy = 1;
+    Devcart_PutFrameHeader(CHAN_CONTROL, len + 3);
+    Devcart_PutByte(FUNC_DOWNLOAD);
+    for (int i = 0; i <= len; i++) {
+        Devcart_PutByte((Uint8)filename[i]);
+    }
+    Devcart_PutByte(DOWNLOAD_FILLS);
+    tx_busy = 0;
+    Devcart_FlushConsole();
+
+    return Devcart_Receive(dest);
+}
+
+int Devcart_ReadSectors(Uint32 fad, Uint32 count, void *dest) {
+    int len;
+
+    tx_busy = 1;
+    Devcart_PutFrameHeader(CHAN_CONTROL, 9);
+    Devcart_PutByte(FUNC_READSECTORS);
+    for (int i = 24; i >= 0; i -= 8) {
+        Devcart_PutByte((Uint8)(fad >> i));
+    }
+    for (int i = 24; i >= 0; i -= 8) {
+        Devcart_PutByte((Uint8)(count >> i));
+    }
+    tx_busy = 0;
+    Devcart_FlushConsole();
+
+    len = Devcart_Receive(dest);
+    return len < 0 ? -1 : len / DEVCART_SECTOR_SIZE;
+}
+
+void Devcart_SetReloadHook(void (*hook)(void)) {
+    reload_hook = hook;
+}
+
+int Devcart_PollReload(void *staging, Uint32 size) {
+    Uint32 addr = (Uint32)staging;
+    int len;
 
-    if (checksum != readchecksum) {
-        Devcart_PutByte(0x1);
+    tx_busy = 1;
+    Devcart_PutFrameHeader(CHAN_CONTROL, 10);
+    Devcart_PutByte(FUNC_RELOAD);
+    for (int i = 24; i >= 0; i -= 8) {
+        Devcart_PutByte((Uint8)(addr >> i));
     }
-    else {
-        Devcart_PutByte(0);
+    for (int i = 24; i >= 0; i -= 8) {
+        Devcart_PutByte((Uint8)(size >> i));
     }
+    Devcart_PutByte(reload_hook ? RELOAD_HOOK : 0);
+    tx_busy = 0;
+    Devcart_FlushConsole();
 
-    return (int)len;
+    //nothing changed, or the changes arrived damaged and the server will
+    //send them again
+    len = Devcart_Receive(staging);
+    if (len <= 0) {
+        return 0;
+    }
+
+    //the stub was just written as data, then it patches the program,
+    //purges the cache again and either restarts it or comes back here
+    CACHE_CCR |= CACHE_PURGE;
+    ((void (*)(void))staging)();
+    if (reload_hook) {
+        reload_hook();
+    }
+    return 1;
 }
 
 void Devcart_PrintStr(char *string) {
-    Devcart_PutByte(FUNC_PRINT);
-    for (int i = 0;; i++) {
-        Devcart_PutByte(string[i]);
-        if (string[i] == '\0') {
-            break;
+    int len = 0;
+    int chunk;
+
+    while (string[len] != '\0') {
+        len++;
+    }
+
+    // another frame is half sent, queue the text for later
+    if (tx_busy) {
+        while (len-- > 0 && (Uint8)(console_head - console_tail) != 255) {
+            console_buf[console_head] = *string++;
+            console_head++;
         }
+        return;
     }
+
+    tx_busy = 1;
+    while (len > 0) {
+        chunk = len > FRAME_MAX_PAYLOAD ? FRAME_MAX_PAYLOAD : len;
+        Devcart_PutFrameHeader(CHAN_CONSOLE, chunk);
+        for (int i = 0; i < chunk; i++) {
+            Devcart_PutByte(*string++);
+        }
+        len -= chunk;
+    }
+    tx_busy = 0;
+    Devcart_FlushConsole();
 }
 
 void Devcart_Reset() {
     // quit server program
-    Devcart_PutByte(FUNC_QUIT);
+    Devcart_SendControl(FUNC_QUIT, 0);
     // reset saturn
     PER_SMPC_SYS_RES();
 }
 
-void Devcart_ChangeDir(char *dir) {
-    Devcart_PutByte(FUNC_CHGDIR);
-    for (int i = 0;; i++) {
-        Devcart_PutByte(dir[i]);
-        if (dir[i] == '\0') {
-            break;
+int Devcart_LoadBundle(char *filename, void *dest) {
+    Uint8 *bundle = (Uint8 *)dest;
+    int size = Devcart_LoadFile(filename, dest);
+    Uint32 count;
+
+    if (size < BUNDLE_HEADER_SIZE || bundle[0] != 'S' || bundle[1] != 'B' ||
+        bundle[2] != 'D' || bundle[3] != 'L') {
+        return -1;
+    }
+    count = ((Uint32 *)dest)[2];
+    if (BUNDLE_HEADER_SIZE + count * BUNDLE_ENTRY_SIZE > (Uint32)size) {
+        return -1;
+    }
+    return (int)count;
+}
+
+void *Devcart_BundleFile(void *bundle, char *filename, Uint32 *size) {
+    Uint32 count = ((Uint32 *)bundle)[2];
+    Uint8 *entry = (Uint8 *)bundle + BUNDLE_HEADER_SIZE;
+
+    for (Uint32 i = 0; i < count; i++, entry += BUNDLE_ENTRY_SIZE) {
+        // names in the bundle are lowercase
+        char *name = (char *)&entry[8];
+        int j;
+        for (j = 0; j < BUNDLE_NAME_SIZE; j++) {
+            char c = filename[j];
+            if (c >= 'A' && c <= 'Z') {
+                c += 'a' - 'A';
+            }
+            if (c != name[j] || c == '\0') {
+                break;
+            }
+        }
+        if (j < BUNDLE_NAME_SIZE && filename[j] == '\0' && name[j] == '\0') {
+            *size = ((Uint32 *)entry)[1];
+            return (Uint8 *)bundle + ((Uint32 *)entry)[0];
         }
     }
+    return NULL;
 }
 
+void Devcart_ChangeDir(char *dir) {
+    Devcart_SendControl(FUNC_CHGDIR, dir);
+}
+
+int Devcart_GetResyncs(void) {
+    return resyncs;
+}
@@ -1,15 +1,42 @@
 #ifndef DEVCART_H
 #define DEVCART_H
 
-//loads file with filename specified from computer
+//loads file with filename specified from computer, returns the file size
+//or -1 if the server couldn't read it or the link had to be resynchronised
 int Devcart_LoadFile(char *filename, void *dest);
+//reads 2048 byte sectors from the CD image the server was started with
+//(-i), addressed by FAD like CD block reads (150 is the first sector).
+//returns the number of sectors read or -1. call it in place of the CD
+//driver's sector reads to try out a disc layout without burning it
+int Devcart_ReadSectors(Uint32 fad, Uint32 count, void *dest);
 //prints string to computer
 void Devcart_PrintStr(char *string);
 //reset back to file menu
 void Devcart_Reset(void);
 
+// loads a bundle of files (built with satbundle, or by the server from
+// <name>.lst) in one request, returns the number of files in it or -1.
+// dest must be 4 byte aligned
+int Devcart_LoadBundle(char *filename, void *dest);
+// finds a file in a loaded bundle, returns a pointer to it within the
+// bundle and sets *size, or returns NULL if it isn't there
+void *Devcart_BundleFile(void *bundle, char *filename, Uint32 *size);
+
 // change to a subdirectory (can only go one subdirectory deep &
 // the name must be 8 or less characters)
 void Devcart_ChangeDir(char *dir);
 
+// watch mode (satbug -x <program> <address> -w -s <directory>): asks the
+// server whether the program was rebuilt, returns 0 if not. the changes
+// are uploaded into staging (size bytes, outside the program) and applied
+// there. with no hook the program restarts from its entry point and this
+// doesn't return, otherwise the code is patched in place and the hook is
+// called so the program can pick the changes up without a reset
+int Devcart_PollReload(void *staging, Uint32 size);
+// set to NULL to restart on every reload
+void Devcart_SetReloadHook(void (*hook)(void));
+
+// number of times the link to the server lost sync and was realigned
+int Devcart_GetResyncs(void);
+
 #endif
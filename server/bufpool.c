@@ -0,0 +1,206 @@
+/*
+    bufpool.c: pinned transfer buffer pool
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "bufpool.h"
+
+// enough for the file server's chunks in flight as well as the transfers
+#define BUFPOOL_SLOTS (32)
+// sizes are rounded up so buffers fit more than the one transfer they were made for
+#define BUFPOOL_GRANULE (64*1024)
+
+#ifdef __linux__
+// libusb 1.0.21 and later. Weak so an older libusb still links, it just
+// leaves us with heap buffers
+unsigned char *libusb_dev_mem_alloc(struct libusb_device_handle *dev_handle,
+                                    size_t length) __attribute__((weak));
+int libusb_dev_mem_free(struct libusb_device_handle *dev_handle,
+                        unsigned char *buffer, size_t length) __attribute__((weak));
+#endif
+
+typedef struct
+{
+    unsigned char  *data;
+    unsigned int    size;
+    int             pinned;
+    int             in_use;
+} bufpool_slot_t;
+
+static bufpool_slot_t slots[BUFPOOL_SLOTS];
+static struct libusb_device_handle *handle = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int pinned_failed = 0;
+
+static void SlotAlloc(bufpool_slot_t *slot, unsigned int size)
+{
+    slot->size = (size + BUFPOOL_GRANULE - 1) & ~(BUFPOOL_GRANULE - 1);
+    slot->pinned = 0;
+    slot->data = NULL;
+
+#ifdef __linux__
+    if (handle != NULL && libusb_dev_mem_alloc != NULL && !pinned_failed)
+    {
+        slot->data = libusb_dev_mem_alloc(handle, slot->size);
+        if (slot->data != NULL)
+        {
+            slot->pinned = 1;
+            return;
+        }
+
+        // usbfs memory is limited (usbfs_memory_mb), stop asking once it runs out
+        pinned_failed = 1;
+    }
+#endif
+
+    slot->data = malloc(slot->size);
+}
+
+static void SlotFree(bufpool_slot_t *slot)
+{
+#ifdef __linux__
+    if (slot->pinned)
+    {
+        libusb_dev_mem_free(handle, slot->data, slot->size);
+    }
+    else
+#endif
+    {
+        free(slot->data);
+    }
+
+    slot->data = NULL;
+    slot->size = 0;
+    slot->pinned = 0;
+}
+
+void bufpool_init(struct libusb_device_handle *pHandle)
+{
+    pthread_mutex_lock(&lock);
+    handle = pHandle;
+    pinned_failed = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+unsigned char *bufpool_get(unsigned int size)
+{
+    bufpool_slot_t *best = NULL, *spare = NULL;
+    int             ii;
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    pthread_mutex_lock(&lock);
+    for (ii = 0; ii < BUFPOOL_SLOTS; ii++)
+    {
+        if (slots[ii].in_use)
+        {
+            continue;
+        }
+        if (slots[ii].data != NULL && slots[ii].size >= size)
+        {
+            if (best == NULL || slots[ii].size < best->size)
+            {
+                best = &slots[ii];
+            }
+        }
+        else if (spare == NULL || spare->data != NULL)
+        {
+            // prefer an empty slot over throwing away a smaller buffer
+            spare = &slots[ii];
+        }
+    }
+
+    if (best == NULL && spare != NULL)
+    {
+        if (spare->data != NULL)
+        {
+            SlotFree(spare);
+        }
+        SlotAlloc(spare, size);
+        if (spare->data != NULL)
+        {
+            best = spare;
+        }
+    }
+
+    if (best != NULL)
+    {
+        best->in_use = 1;
+        pthread_mutex_unlock(&lock);
+        return best->data;
+    }
+    pthread_mutex_unlock(&lock);
+
+    // every slot is busy, so this one isn't kept
+    return malloc(size);
+}
+
+void bufpool_put(unsigned char *pBuffer)
+{
+    int ii;
+
+    if (pBuffer == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    for (ii = 0; ii < BUFPOOL_SLOTS; ii++)
+    {
+        if (slots[ii].data == pBuffer)
+        {
+            slots[ii].in_use = 0;
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    free(pBuffer);
+}
+
+void bufpool_close(void)
+{
+    int ii;
+
+    // pinned memory belongs to the device handle, so it has to go first
+    pthread_mutex_lock(&lock);
+    for (ii = 0; ii < BUFPOOL_SLOTS; ii++)
+    {
+        if (slots[ii].data != NULL && !slots[ii].in_use)
+        {
+            SlotFree(&slots[ii]);
+        }
+    }
+    handle = NULL;
+    pthread_mutex_unlock(&lock);
+}
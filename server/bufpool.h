@@ -0,0 +1,19 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+/* Reusable transfer buffers. On Linux they come from libusb_dev_mem_alloc,
+   so usbfs can DMA straight out of them instead of copying each transfer
+   through its own bounce buffer. Elsewhere, or when the kernel won't give
+   us any, they're plain heap memory. Either way a returned buffer is kept
+   and handed out again instead of allocating one per transfer. */
+
+struct libusb_device_handle;
+
+void bufpool_init(struct libusb_device_handle *pHandle);
+//returns NULL if there's no memory at all
+unsigned char *bufpool_get(unsigned int size);
+void bufpool_put(unsigned char *pBuffer);
+//every buffer has to be returned before this
+void bufpool_close(void);
+
+#endif // BUFPOOL_H
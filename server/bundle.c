@@ -0,0 +1,270 @@
+/*
+    bundle.c: many files packed into one transfer
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bundle.h"
+#include "trace.h"
+
+#define BUNDLE_PATH_SIZE (1024)
+#define BUNDLE_COPY_SIZE (64*1024)
+
+static void PutDword(unsigned char *p, unsigned int value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static int AddName(char ***pppNames, int *pCount, int *pCapacity, const char *pName)
+{
+    char  **grown;
+    int     ii;
+
+    // a file only goes in once, where it was first needed
+    for (ii = 0; ii < *pCount; ii++)
+    {
+        if (!strcmp((*pppNames)[ii], pName))
+        {
+            return 1;
+        }
+    }
+
+    if (*pCount == *pCapacity)
+    {
+        *pCapacity = *pCapacity ? *pCapacity * 2 : 64;
+        grown = realloc(*pppNames, *pCapacity * sizeof(char *));
+        if (grown == NULL)
+        {
+            return 0;
+        }
+        *pppNames = grown;
+    }
+
+    (*pppNames)[*pCount] = strdup(pName);
+    if ((*pppNames)[*pCount] == NULL)
+    {
+        return 0;
+    }
+    (*pCount)++;
+    return 1;
+}
+
+int bundle_build(FILE *pOut, const char *pDirectory, char **ppNames, int count)
+{
+    char            path[BUNDLE_PATH_SIZE];
+    unsigned char   entry[BUNDLE_ENTRY_SIZE];
+    unsigned char  *buffer;
+    unsigned int   *sizes;
+    unsigned int    offset, len, ii, jj;
+    size_t          read;
+    long            size;
+    FILE           *File;
+    int             ok = 1;
+
+    sizes = malloc((count ? count : 1) * sizeof(unsigned int));
+    buffer = malloc(BUNDLE_COPY_SIZE);
+    if (sizes == NULL || buffer == NULL)
+    {
+        printf("Memory allocation error\n");
+        free(sizes);
+        free(buffer);
+        return 0;
+    }
+
+    for (ii = 0; ii < (unsigned int)count && ok; ii++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", pDirectory, ppNames[ii]);
+        File = fopen(path, "rb");
+        if (File == NULL || strlen(ppNames[ii]) >= BUNDLE_NAME_SIZE)
+        {
+            printf(File ? "Name too long for a bundle: '%s'\n" : "Can't open the file '%s'\n",
+                   File ? ppNames[ii] : path);
+            ok = 0;
+        }
+        else
+        {
+            fseek(File, 0, SEEK_END);
+            size = ftell(File);
+            sizes[ii] = size < 0 ? 0 : (unsigned int)size;
+        }
+        if (File != NULL)
+        {
+            fclose(File);
+        }
+    }
+
+    memcpy(entry, BUNDLE_MAGIC, 4);
+    PutDword(&entry[4], BUNDLE_VERSION);
+    PutDword(&entry[8], count);
+    ok = ok && fwrite(entry, 1, BUNDLE_HEADER_SIZE, pOut) == BUNDLE_HEADER_SIZE;
+
+    offset = BUNDLE_HEADER_SIZE + count * BUNDLE_ENTRY_SIZE;
+    for (ii = 0; ii < (unsigned int)count && ok; ii++)
+    {
+        offset = (offset + BUNDLE_ALIGN - 1) & ~(BUNDLE_ALIGN - 1);
+        PutDword(&entry[0], offset);
+        PutDword(&entry[4], sizes[ii]);
+        memset(&entry[8], 0, BUNDLE_NAME_SIZE);
+        for (jj = 0; ppNames[ii][jj] != '\0'; jj++)
+        {
+            entry[8 + jj] = tolower((unsigned char)ppNames[ii][jj]);
+        }
+        ok = fwrite(entry, 1, BUNDLE_ENTRY_SIZE, pOut) == BUNDLE_ENTRY_SIZE;
+        offset += sizes[ii];
+    }
+
+    offset = BUNDLE_HEADER_SIZE + count * BUNDLE_ENTRY_SIZE;
+    memset(buffer, 0, BUNDLE_ALIGN);
+    for (ii = 0; ii < (unsigned int)count && ok; ii++)
+    {
+        len = ((offset + BUNDLE_ALIGN - 1) & ~(BUNDLE_ALIGN - 1)) - offset;
+        ok = fwrite(buffer, 1, len, pOut) == len;
+        offset += len;
+
+        snprintf(path, sizeof(path), "%s/%s", pDirectory, ppNames[ii]);
+        File = fopen(path, "rb");
+        len = 0;
+        while (ok && File != NULL && len < sizes[ii])
+        {
+            read = fread(buffer, 1, BUNDLE_COPY_SIZE, File);
+            if (read == 0 || len + read > sizes[ii])
+            {
+                break;
+            }
+            ok = fwrite(buffer, 1, read, pOut) == read;
+            len += read;
+        }
+        if (len != sizes[ii])
+        {
+            printf("Error reading the file '%s'\n", path);
+            ok = 0;
+        }
+        if (File != NULL)
+        {
+            fclose(File);
+        }
+        offset += sizes[ii];
+    }
+
+    free(sizes);
+    free(buffer);
+    return ok;
+}
+
+int bundle_read_list(const char *pFilename, char ***pppNames, int *pCount)
+{
+    char    line[BUNDLE_PATH_SIZE];
+    char   *start, *end;
+    int     capacity = 0, ok = 1;
+    FILE   *File;
+
+    *pppNames = NULL;
+    *pCount = 0;
+    File = fopen(pFilename, "r");
+    if (File == NULL)
+    {
+        return 0;
+    }
+
+    while (ok && fgets(line, sizeof(line), File) != NULL)
+    {
+        for (start = line; isspace((unsigned char)*start); start++);
+        for (end = start + strlen(start); end > start && isspace((unsigned char)end[-1]); end--);
+        *end = '\0';
+        if (*start != '\0' && *start != '#')
+        {
+            ok = AddName(pppNames, pCount, &capacity, start);
+        }
+    }
+    fclose(File);
+
+    if (!ok)
+    {
+        printf("Memory allocation error\n");
+        bundle_free_names(*pppNames, *pCount);
+    }
+    return ok;
+}
+
+int bundle_read_trace(const char *pFilename, char ***pppNames, int *pCount)
+{
+    trace_entry_t   entry;
+    size_t          len;
+    int             capacity = 0, ok = 1;
+    FILE           *File;
+
+    *pppNames = NULL;
+    *pCount = 0;
+    File = fopen(pFilename, "rb");
+    if (File == NULL || trace_read_header(File) == 0)
+    {
+        printf("'%s' isn't a trace\n", pFilename);
+        if (File != NULL)
+        {
+            fclose(File);
+        }
+        return 0;
+    }
+
+    // the trace is in the order requests were answered, which is the
+    // order they were made in. bundles the client loaded don't go in
+    // another one
+    while (ok && trace_read(File, &entry))
+    {
+        len = strlen(entry.name);
+        if (entry.result == TRACE_OK &&
+            (len < strlen(BUNDLE_EXTENSION) ||
+             strcmp(&entry.name[len - strlen(BUNDLE_EXTENSION)], BUNDLE_EXTENSION)))
+        {
+            ok = AddName(pppNames, pCount, &capacity, entry.name);
+        }
+    }
+    fclose(File);
+
+    if (!ok)
+    {
+        printf("Memory allocation error\n");
+        bundle_free_names(*pppNames, *pCount);
+    }
+    return ok;
+}
+
+void bundle_free_names(char **ppNames, int count)
+{
+    int ii;
+
+    for (ii = 0; ii < count; ii++)
+    {
+        free(ppNames[ii]);
+    }
+    free(ppNames);
+}
@@ -0,0 +1,34 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stdio.h>
+
+/* Bundles pack many small files into one, so the client can fetch them
+   with a single request. Values are big endian so the Saturn can use the
+   table of contents in place:
+
+       "SBDL", version, file count,
+       then per file: offset from the start of the bundle, size,
+                      lowercase name (NUL padded to BUNDLE_NAME_SIZE),
+       then the files in list order, each starting on a 4 byte boundary */
+
+#define BUNDLE_MAGIC "SBDL"
+#define BUNDLE_VERSION (1)
+#define BUNDLE_NAME_SIZE (24)
+#define BUNDLE_HEADER_SIZE (12)
+#define BUNDLE_ENTRY_SIZE (8 + BUNDLE_NAME_SIZE)
+#define BUNDLE_ALIGN (4)
+// the file server builds <name>.bdl from <name>.lst on request if there's
+// no bundle with that name
+#define BUNDLE_EXTENSION ".bdl"
+#define BUNDLE_LIST_EXTENSION ".lst"
+
+//names are relative to pDirectory
+int bundle_build(FILE *pOut, const char *pDirectory, char **ppNames, int count);
+//one name per line, blank lines and lines starting with # are skipped
+int bundle_read_list(const char *pFilename, char ***pppNames, int *pCount);
+//the files a satbug -t trace delivered, in first access order
+int bundle_read_trace(const char *pFilename, char ***pppNames, int *pCount);
+void bundle_free_names(char **ppNames, int count);
+
+#endif // BUNDLE_H
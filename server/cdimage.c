@@ -0,0 +1,398 @@
+/*
+    cdimage.c: CD images served by sector
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cdimage.h"
+
+/* The image file is mapped rather than read, so the page cache is the
+   sector cache and workers copy straight out of it. Sequential reads grow
+   a read-ahead window that is handed to the kernel ahead of time, the
+   same way it would treat a sequentially read file. */
+#define READAHEAD_MIN (32)
+#define READAHEAD_MAX (1024)
+
+#define CUE_LINE_SIZE (1024)
+
+struct cdimage_s
+{
+    int             fd;
+    unsigned char  *map;
+    size_t          map_size;
+    off_t           start;          // offset of FAD 150 in the file
+    unsigned int    raw_size;       // sector size in the file
+    unsigned int    data_offset;    // where user data starts in a sector
+    unsigned int    sectors;
+
+    pthread_mutex_t lock;
+    unsigned int    next_fad;       // where a sequential read would continue
+    unsigned int    window;
+};
+
+typedef struct
+{
+    char            file[CUE_LINE_SIZE];
+    unsigned int    raw_size;
+    unsigned int    data_offset;
+    unsigned int    start;          // first sector of the track
+    unsigned int    end;            // first sector of the next track, 0 if none
+} cue_t;
+
+static int TrackMode(const char *pMode, unsigned int *pRawSize, unsigned int *pDataOffset)
+{
+    if (!strcasecmp(pMode, "MODE1/2048") || !strcasecmp(pMode, "MODE2/2048"))
+    {
+        *pRawSize = 2048;
+        *pDataOffset = 0;
+    }
+    else if (!strcasecmp(pMode, "MODE1/2352"))
+    {
+        // 12 sync bytes, 4 header bytes
+        *pRawSize = 2352;
+        *pDataOffset = 16;
+    }
+    else if (!strcasecmp(pMode, "MODE2/2352"))
+    {
+        // form 1, which also has an 8 byte subheader
+        *pRawSize = 2352;
+        *pDataOffset = 24;
+    }
+    else if (!strcasecmp(pMode, "MODE2/2336"))
+    {
+        *pRawSize = 2336;
+        *pDataOffset = 8;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+// finds the first track of a cue sheet
+static int ParseCue(const char *pFilename, cue_t *pCue)
+{
+    char            line[CUE_LINE_SIZE];
+    char            word[CUE_LINE_SIZE];
+    char            mode[32];
+    const char     *slash;
+    char           *quote, *name;
+    unsigned int    track, index, min, sec, frame;
+    int             tracks = 0, found = 0;
+    FILE           *File;
+
+    File = fopen(pFilename, "r");
+    if (File == NULL)
+    {
+        printf("Can't open the file '%s'\n", pFilename);
+        return 0;
+    }
+
+    memset(pCue, 0, sizeof(cue_t));
+    while (fgets(line, sizeof(line), File) != NULL)
+    {
+        if (sscanf(line, " %s", word) != 1)
+        {
+            continue;
+        }
+
+        if (!strcasecmp(word, "FILE") && tracks == 0)
+        {
+            // the name may be quoted and is relative to the cue sheet
+            name = strchr(line, '"');
+            if (name != NULL && (quote = strchr(name + 1, '"')) != NULL)
+            {
+                name++;
+                *quote = '\0';
+            }
+            else if (sscanf(line, " %*s %s", word) == 1)
+            {
+                name = word;
+            }
+            else
+            {
+                continue;
+            }
+            pCue->file[0] = '\0';
+            slash = strrchr(pFilename, '/');
+            if (name[0] != '/' && slash != NULL &&
+                slash - pFilename + 1 < (int)sizeof(pCue->file))
+            {
+                memcpy(pCue->file, pFilename, slash - pFilename + 1);
+                pCue->file[slash - pFilename + 1] = '\0';
+            }
+            strncat(pCue->file, name, sizeof(pCue->file) - strlen(pCue->file) - 1);
+        }
+        else if (!strcasecmp(word, "FILE"))
+        {
+            // later tracks are in another file
+            break;
+        }
+        else if (!strcasecmp(word, "TRACK") &&
+                 sscanf(line, " %*s %u %31s", &track, mode) == 2)
+        {
+            tracks++;
+            if (tracks == 1 && !TrackMode(mode, &pCue->raw_size, &pCue->data_offset))
+            {
+                printf("Unsupported first track mode %s\n", mode);
+                break;
+            }
+        }
+        else if (!strcasecmp(word, "INDEX") &&
+                 sscanf(line, " %*s %u %u:%u:%u", &index, &min, &sec, &frame) == 4)
+        {
+            // the first index of the next track ends this one
+            if (tracks == 1 && index == 1)
+            {
+                pCue->start = (min * 60 + sec) * 75 + frame;
+                found = 1;
+            }
+            else if (tracks == 2)
+            {
+                pCue->end = (min * 60 + sec) * 75 + frame;
+                break;
+            }
+        }
+    }
+    fclose(File);
+
+    if (!found || pCue->file[0] == '\0' || pCue->raw_size == 0)
+    {
+        printf("No usable data track in '%s'\n", pFilename);
+        return 0;
+    }
+    return 1;
+}
+
+cdimage_t *cdimage_open(const char *pFilename)
+{
+    cdimage_t      *image;
+    cue_t           cue;
+    struct stat     info;
+    const char     *ext = strrchr(pFilename, '.');
+    off_t           end;
+
+    memset(&cue, 0, sizeof(cue));
+    if (ext != NULL && !strcasecmp(ext, ".cue"))
+    {
+        if (!ParseCue(pFilename, &cue))
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        snprintf(cue.file, sizeof(cue.file), "%s", pFilename);
+        cue.raw_size = 2048;
+    }
+
+    image = calloc(1, sizeof(cdimage_t));
+    if (image == NULL)
+    {
+        printf("Memory allocation error\n");
+        return NULL;
+    }
+
+    image->fd = open(cue.file, O_RDONLY);
+    if (image->fd < 0 || fstat(image->fd, &info))
+    {
+        printf("Can't open the file '%s'\n", cue.file);
+        cdimage_close(image);
+        return NULL;
+    }
+
+    // a bare .bin is raw mode 1 sectors if it divides up into them
+    if (ext != NULL && !strcasecmp(ext, ".bin") && info.st_size % 2352 == 0)
+    {
+        cue.raw_size = 2352;
+        cue.data_offset = 16;
+    }
+
+    image->raw_size = cue.raw_size;
+    image->data_offset = cue.data_offset;
+    image->start = (off_t)cue.start * cue.raw_size;
+    end = cue.end > cue.start ? (off_t)cue.end * cue.raw_size : info.st_size;
+    if (end > info.st_size)
+    {
+        end = info.st_size;
+    }
+    image->sectors = end > image->start ? (end - image->start) / cue.raw_size : 0;
+    if (image->sectors == 0)
+    {
+        printf("'%s' has no sectors\n", cue.file);
+        cdimage_close(image);
+        return NULL;
+    }
+
+    image->map_size = info.st_size;
+    image->map = mmap(NULL, image->map_size, PROT_READ, MAP_SHARED, image->fd, 0);
+    if (image->map == MAP_FAILED)
+    {
+        printf("Can't map the file '%s'\n", cue.file);
+        image->map = NULL;
+        cdimage_close(image);
+        return NULL;
+    }
+    madvise(image->map, image->map_size, MADV_SEQUENTIAL);
+
+    pthread_mutex_init(&image->lock, NULL);
+    image->next_fad = CDIMAGE_FIRST_FAD;
+    image->window = READAHEAD_MIN;
+    printf("Mounted %s: %u sectors of %u bytes\n", cue.file, image->sectors, image->raw_size);
+    return image;
+}
+
+void cdimage_close(cdimage_t *pImage)
+{
+    if (pImage == NULL)
+    {
+        return;
+    }
+    if (pImage->map != NULL)
+    {
+        munmap(pImage->map, pImage->map_size);
+        pthread_mutex_destroy(&pImage->lock);
+    }
+    if (pImage->fd >= 0)
+    {
+        close(pImage->fd);
+    }
+    free(pImage);
+}
+
+unsigned int cdimage_sectors(const cdimage_t *pImage)
+{
+    return pImage->sectors;
+}
+
+static void ReadAhead(cdimage_t *pImage, unsigned int fad, unsigned int count)
+{
+    unsigned int    window, first;
+    size_t          page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t          from, to;
+
+    pthread_mutex_lock(&pImage->lock);
+    // grow the window while the reads follow on from each other, start
+    // again from the minimum on a seek
+    if (fad == pImage->next_fad)
+    {
+        pImage->window = pImage->window * 2 > READAHEAD_MAX ? READAHEAD_MAX : pImage->window * 2;
+    }
+    else
+    {
+        pImage->window = READAHEAD_MIN;
+    }
+    pImage->next_fad = fad + count;
+    window = pImage->window;
+    pthread_mutex_unlock(&pImage->lock);
+
+    first = fad - CDIMAGE_FIRST_FAD + count;
+    if (first >= pImage->sectors)
+    {
+        return;
+    }
+    if (window > pImage->sectors - first)
+    {
+        window = pImage->sectors - first;
+    }
+    from = (size_t)(pImage->start + (off_t)first * pImage->raw_size);
+    to = from + (size_t)window * pImage->raw_size;
+    from &= ~(page - 1);
+    madvise(pImage->map + from, to - from, MADV_WILLNEED);
+}
+
+// copies len bytes that go offset bytes into the split up destination
+static void CopyFrames(unsigned char *pDest, unsigned int offset, const unsigned char *src,
+                       unsigned int len, unsigned int FrameSize, unsigned int FrameStride)
+{
+    unsigned int piece;
+
+    if (FrameSize == FrameStride)
+    {
+        memcpy(&pDest[offset], src, len);
+        return;
+    }
+    while (len > 0)
+    {
+        piece = FrameSize - offset % FrameSize;
+        if (piece > len)
+        {
+            piece = len;
+        }
+        memcpy(&pDest[offset / FrameSize * FrameStride + offset % FrameSize], src, piece);
+        offset += piece;
+        src += piece;
+        len -= piece;
+    }
+}
+
+int cdimage_read(cdimage_t *pImage, unsigned int fad, unsigned int count,
+                 unsigned char *pDest)
+{
+    return cdimage_read_frames(pImage, fad, count, pDest, CDIMAGE_SECTOR_SIZE,
+                               CDIMAGE_SECTOR_SIZE);
+}
+
+int cdimage_read_frames(cdimage_t *pImage, unsigned int fad, unsigned int count,
+                        unsigned char *pDest, unsigned int FrameSize,
+                        unsigned int FrameStride)
+{
+    const unsigned char    *src;
+    unsigned int            ii;
+
+    if (fad < CDIMAGE_FIRST_FAD || fad - CDIMAGE_FIRST_FAD > pImage->sectors ||
+        count > pImage->sectors - (fad - CDIMAGE_FIRST_FAD))
+    {
+        return 0;
+    }
+
+    src = pImage->map + pImage->start + (off_t)(fad - CDIMAGE_FIRST_FAD) * pImage->raw_size;
+    if (pImage->raw_size == CDIMAGE_SECTOR_SIZE)
+    {
+        CopyFrames(pDest, 0, src, count * CDIMAGE_SECTOR_SIZE, FrameSize, FrameStride);
+    }
+    else
+    {
+        for (ii = 0; ii < count; ii++)
+        {
+            CopyFrames(pDest, ii * CDIMAGE_SECTOR_SIZE, &src[pImage->data_offset],
+                       CDIMAGE_SECTOR_SIZE, FrameSize, FrameStride);
+            src += pImage->raw_size;
+        }
+    }
+
+    ReadAhead(pImage, fad, count);
+    return 1;
+}
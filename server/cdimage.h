@@ -0,0 +1,28 @@
+#ifndef CDIMAGE_H
+#define CDIMAGE_H
+
+/* CD images the file server can mount (.iso, .bin or .cue) to answer
+   sector reads. Only the first track is served, as 2048 byte sectors of
+   user data addressed by FAD like the Saturn's CD block does: FAD 150 is
+   the first sector of the track. */
+
+#define CDIMAGE_SECTOR_SIZE (2048)
+#define CDIMAGE_FIRST_FAD (150)
+
+typedef struct cdimage_s cdimage_t;
+
+cdimage_t *cdimage_open(const char *pFilename);
+void cdimage_close(cdimage_t *pImage);
+//number of sectors in the track
+unsigned int cdimage_sectors(const cdimage_t *pImage);
+//copies count sectors of user data starting at fad to pDest, returns 0 if
+//they're not all on the track. safe to call from several threads
+int cdimage_read(cdimage_t *pImage, unsigned int fad, unsigned int count,
+                 unsigned char *pDest);
+//the same, with the data split into FrameSize byte pieces that start
+//FrameStride bytes apart in pDest
+int cdimage_read_frames(cdimage_t *pImage, unsigned int fad, unsigned int count,
+                        unsigned char *pDest, unsigned int FrameSize,
+                        unsigned int FrameStride);
+
+#endif // CDIMAGE_H
@@ -0,0 +1,258 @@
+/*
+    console.c: debug console output thread
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "console.h"
+#include "metrics.h"
+#include "queue.h"
+#include "timeline.h"
+
+#define CONSOLE_RING_SIZE (1024*1024)
+#define CONSOLE_MAX_IOV (64)
+#define CONSOLE_MAX_LINES (32)
+#define CONSOLE_PREFIX_SIZE (48)
+
+// every console_write call becomes one record in the ring
+typedef struct
+{
+    uint64_t time;
+    uint32_t len;
+} console_record_t;
+
+struct console
+{
+    byte_ring_t     ring;
+    pthread_t       thread;
+    int             running;
+    unsigned int    dropped;
+    char            device_name[CONSOLE_PREFIX_SIZE / 2];
+    uint64_t        start_time;
+};
+
+static uint64_t Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void WriteAll(struct iovec *iov, int count)
+{
+    ssize_t written;
+
+    while (count > 0)
+    {
+        written = writev(STDOUT_FILENO, iov, count);
+        if (written < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return;
+        }
+
+        while (count > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+static void *ConsoleThread(void *pArg)
+{
+    console_t          *pConsole = pArg;
+    struct iovec        iov[CONSOLE_MAX_IOV];
+    char                prefix[CONSOLE_MAX_LINES][CONSOLE_PREFIX_SIZE];
+    char                note[CONSOLE_PREFIX_SIZE];
+    console_record_t    record = {0, 0};
+    unsigned int        used, offset, len, reported = 0, lost;
+    unsigned char      *data, *newline;
+    int                 niov, nprefix, line_start = 1;
+    uint64_t            elapsed;
+    long long           start;
+
+    timeline_thread("console");
+    for (;;)
+    {
+        used = ring_wait(&pConsole->ring, &pConsole->running);
+        if (used == 0)
+        {
+            if (!__atomic_load_n(&pConsole->running, __ATOMIC_ACQUIRE) &&
+                ring_used(&pConsole->ring) == 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        niov = 0;
+        nprefix = 0;
+        offset = 0;
+        // gather as many lines as fit into one writev
+        while (niov < CONSOLE_MAX_IOV - 2 && nprefix < CONSOLE_MAX_LINES)
+        {
+            if (record.len == 0)
+            {
+                if (used - offset < sizeof(record))
+                {
+                    break;
+                }
+                ring_copy_out(&pConsole->ring, offset, &record, sizeof(record));
+                offset += sizeof(record);
+                continue;
+            }
+
+            if (line_start)
+            {
+                elapsed = record.time - pConsole->start_time;
+                snprintf(prefix[nprefix], CONSOLE_PREFIX_SIZE, "[%6llu.%06llu %s] ",
+                         (unsigned long long)(elapsed / 1000000000ull),
+                         (unsigned long long)(elapsed / 1000ull % 1000000ull),
+                         pConsole->device_name);
+                iov[niov].iov_base = prefix[nprefix];
+                iov[niov].iov_len = strlen(prefix[nprefix]);
+                niov++;
+                nprefix++;
+                line_start = 0;
+            }
+
+            // records are published whole, so the payload is all there
+            len = ring_peek(&pConsole->ring, offset, &data);
+            if (len > record.len)
+            {
+                len = record.len;
+            }
+            newline = memchr(data, '\n', len);
+            if (newline != NULL)
+            {
+                len = newline - data + 1;
+                line_start = 1;
+            }
+            iov[niov].iov_base = data;
+            iov[niov].iov_len = len;
+            niov++;
+            offset += len;
+            record.len -= len;
+        }
+
+        lost = __atomic_load_n(&pConsole->dropped, __ATOMIC_RELAXED);
+        if (lost != reported)
+        {
+            snprintf(note, sizeof(note), "%s[console dropped %u bytes]\n",
+                     line_start ? "" : "\n", lost - reported);
+            iov[niov].iov_base = note;
+            iov[niov].iov_len = strlen(note);
+            niov++;
+            reported = lost;
+            line_start = 1;
+        }
+
+        // keep ordering with the server's own printf output
+        start = metrics_now();
+        fflush(stdout);
+        WriteAll(iov, niov);
+        timeline_span("console write", "console", start);
+        ring_release(&pConsole->ring, offset);
+    }
+
+    return NULL;
+}
+
+console_t *console_open(const char *device_id)
+{
+    console_t *pConsole = calloc(1, sizeof(console_t));
+
+    if (pConsole == NULL || !ring_init(&pConsole->ring, CONSOLE_RING_SIZE))
+    {
+        printf("Memory allocation error\n");
+        free(pConsole);
+        return NULL;
+    }
+
+    snprintf(pConsole->device_name, sizeof(pConsole->device_name), "%s", device_id);
+    pConsole->start_time = Now();
+    pConsole->running = 1;
+    if (pthread_create(&pConsole->thread, NULL, ConsoleThread, pConsole))
+    {
+        printf("Error starting console thread\n");
+        ring_free(&pConsole->ring);
+        free(pConsole);
+        return NULL;
+    }
+
+    return pConsole;
+}
+
+void console_write(console_t *pConsole, const unsigned char *data, unsigned int len)
+{
+    console_record_t record;
+
+    if (len == 0)
+    {
+        return;
+    }
+
+    if (ring_space(&pConsole->ring) < sizeof(record) + len)
+    {
+        __atomic_add_fetch(&pConsole->dropped, len, __ATOMIC_RELAXED);
+        timeline_instant("console dropped", "console");
+        return;
+    }
+
+    record.time = Now();
+    record.len = len;
+    ring_copy_in(&pConsole->ring, 0, &record, sizeof(record));
+    ring_copy_in(&pConsole->ring, sizeof(record), data, len);
+    ring_publish(&pConsole->ring, sizeof(record) + len);
+}
+
+void console_close(console_t *pConsole)
+{
+    __atomic_store_n(&pConsole->running, 0, __ATOMIC_RELEASE);
+    ring_wake(&pConsole->ring);
+    pthread_join(pConsole->thread, NULL);
+    ring_free(&pConsole->ring);
+    free(pConsole);
+}
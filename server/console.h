@@ -0,0 +1,19 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+/* Debug console output. Text printed by the Saturn is handed to a separate
+   thread through a lock-free ring, so a slow terminal or pipe never stalls
+   the USB reader. Each line is stamped with the monotonic time it arrived
+   and the device it came from. */
+
+typedef struct console console_t;
+
+//one per cart, each with a thread of its own
+console_t *console_open(const char *device_id);
+//never blocks, text that doesn't fit in the ring is dropped and counted.
+//only one thread may write to a console
+void console_write(console_t *pConsole, const unsigned char *data, unsigned int len);
+//flushes everything written so far and stops the console thread
+void console_close(console_t *pConsole);
+
+#endif // CONSOLE_H
@@ -0,0 +1,533 @@
+/*
+    convert.c: on-demand asset conversion for the file server
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+#include "convert.h"
+#include "sha256.h"
+
+#define CONVERT_PATH_SIZE (1024)
+#define CONVERT_EXT_SIZE (16)
+#define CELL_SIZE (8)
+
+typedef struct
+{
+    char            source_ext[CONVERT_EXT_SIZE];
+    char            target_ext[CONVERT_EXT_SIZE];
+    const char     *name;
+    int             version;
+    convert_fn_t    function;
+} converter_t;
+
+static int PngToBitmap(const unsigned char *pIn, size_t inSize,
+                       unsigned char **ppOut, size_t *pOutSize);
+static int PngToCells(const unsigned char *pIn, size_t inSize,
+                      unsigned char **ppOut, size_t *pOutSize);
+static int WavToPcm(const unsigned char *pIn, size_t inSize,
+                    unsigned char **ppOut, size_t *pOutSize);
+
+static converter_t converters[CONVERT_MAX] =
+{
+    {".png", ".rgb", "png-rgb555", 1, PngToBitmap},
+    {".png", ".cel", "png-rgb555-cells", 1, PngToCells},
+    {".wav", ".pcm", "wav-pcm-be", 1, WavToPcm},
+};
+static int num_converters = 3;
+
+static unsigned int GetDword(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+           ((unsigned int)p[2] << 8) | p[3];
+}
+
+static unsigned int GetLittle(const unsigned char *p, int bytes)
+{
+    unsigned int value = 0;
+
+    while (bytes-- > 0)
+    {
+        value = (value << 8) | p[bytes];
+    }
+    return value;
+}
+
+static int Paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+    {
+        return a;
+    }
+    return pb <= pc ? b : c;
+}
+
+/* Decodes 8 bit, non-interlaced PNGs of any colour type to RGB555 pixels,
+   which covers what image editors export for the Saturn. Pixels less than
+   half opaque become 0, which VDP1 and VDP2 treat as transparent. */
+static unsigned short *DecodePng(const unsigned char *pIn, size_t inSize,
+                                 unsigned int *pWidth, unsigned int *pHeight)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    static const int channels[7] = {1, 0, 3, 1, 2, 0, 4};
+    unsigned char   palette[256][4];
+    unsigned char  *idat = NULL, *raw = NULL, *grown, *line, *prior;
+    unsigned short *pixels = NULL;
+    unsigned int    width = 0, height = 0, depth = 0, colour = 0, interlace = 0;
+    unsigned int    bpp = 0, stride, len, xx, yy, ii;
+    size_t          idat_size = 0, pos = 8;
+    uLongf          raw_size;
+    int             a, b, c, r, g, bl, alpha;
+    const unsigned char *px;
+
+    if (inSize < 8 || memcmp(pIn, signature, 8))
+    {
+        printf("Not a PNG\n");
+        return NULL;
+    }
+
+    memset(palette, 0xff, sizeof(palette));
+    while (pos + 12 <= inSize)
+    {
+        len = GetDword(&pIn[pos]);
+        if (len > inSize - pos - 12)
+        {
+            break;
+        }
+        if (!memcmp(&pIn[pos + 4], "IHDR", 4) && len >= 13)
+        {
+            width = GetDword(&pIn[pos + 8]);
+            height = GetDword(&pIn[pos + 12]);
+            depth = pIn[pos + 16];
+            colour = pIn[pos + 17];
+            interlace = pIn[pos + 20];
+        }
+        else if (!memcmp(&pIn[pos + 4], "PLTE", 4))
+        {
+            for (ii = 0; ii < len / 3 && ii < 256; ii++)
+            {
+                memcpy(palette[ii], &pIn[pos + 8 + ii * 3], 3);
+            }
+        }
+        else if (!memcmp(&pIn[pos + 4], "tRNS", 4) && colour == 3)
+        {
+            for (ii = 0; ii < len && ii < 256; ii++)
+            {
+                palette[ii][3] = pIn[pos + 8 + ii];
+            }
+        }
+        else if (!memcmp(&pIn[pos + 4], "IDAT", 4))
+        {
+            grown = realloc(idat, idat_size + len + 1);
+            if (grown == NULL)
+            {
+                break;
+            }
+            idat = grown;
+            memcpy(&idat[idat_size], &pIn[pos + 8], len);
+            idat_size += len;
+        }
+        else if (!memcmp(&pIn[pos + 4], "IEND", 4))
+        {
+            break;
+        }
+        pos += len + 12;
+    }
+
+    if (colour < 7)
+    {
+        bpp = channels[colour];
+    }
+    if (width == 0 || height == 0 || width > 4096 || height > 4096 ||
+        depth != 8 || bpp == 0 || interlace != 0 || idat == NULL)
+    {
+        printf("Unsupported PNG, only 8 bit non-interlaced images can be converted\n");
+        free(idat);
+        return NULL;
+    }
+
+    stride = width * bpp;
+    raw_size = (uLongf)(stride + 1) * height;
+    raw = malloc(raw_size);
+    pixels = malloc((size_t)width * height * sizeof(unsigned short));
+    if (raw == NULL || pixels == NULL ||
+        uncompress(raw, &raw_size, idat, idat_size) != Z_OK ||
+        raw_size != (uLongf)(stride + 1) * height)
+    {
+        printf("Corrupt PNG\n");
+        free(idat);
+        free(raw);
+        free(pixels);
+        return NULL;
+    }
+    free(idat);
+
+    // undo the filters in place, each line starts with its filter type
+    prior = NULL;
+    for (yy = 0; yy < height; yy++)
+    {
+        line = &raw[yy * (stride + 1) + 1];
+        for (xx = 0; xx < stride; xx++)
+        {
+            a = xx >= bpp ? line[xx - bpp] : 0;
+            b = prior ? prior[xx] : 0;
+            c = prior && xx >= bpp ? prior[xx - bpp] : 0;
+            switch (line[-1])
+            {
+            case 1: line[xx] += a; break;
+            case 2: line[xx] += b; break;
+            case 3: line[xx] += (a + b) / 2; break;
+            case 4: line[xx] += Paeth(a, b, c); break;
+            }
+        }
+        prior = line;
+
+        for (xx = 0; xx < width; xx++)
+        {
+            px = &line[xx * bpp];
+            switch (colour)
+            {
+            case 0: r = g = bl = px[0]; alpha = 255; break;
+            case 2: r = px[0]; g = px[1]; bl = px[2]; alpha = 255; break;
+            case 3: r = palette[px[0]][0]; g = palette[px[0]][1];
+                    bl = palette[px[0]][2]; alpha = palette[px[0]][3]; break;
+            case 4: r = g = bl = px[0]; alpha = px[1]; break;
+            default: r = px[0]; g = px[1]; bl = px[2]; alpha = px[3]; break;
+            }
+            pixels[yy * width + xx] = alpha < 128 ? 0 :
+                0x8000 | ((bl >> 3) << 10) | ((g >> 3) << 5) | (r >> 3);
+        }
+    }
+    free(raw);
+
+    *pWidth = width;
+    *pHeight = height;
+    return pixels;
+}
+
+static int PngToBitmap(const unsigned char *pIn, size_t inSize,
+                       unsigned char **ppOut, size_t *pOutSize)
+{
+    unsigned short *pixels;
+    unsigned char  *out;
+    unsigned int    width, height, ii;
+
+    pixels = DecodePng(pIn, inSize, &width, &height);
+    if (pixels == NULL)
+    {
+        return 0;
+    }
+
+    *pOutSize = (size_t)width * height * 2;
+    out = malloc(*pOutSize);
+    for (ii = 0; out != NULL && ii < width * height; ii++)
+    {
+        out[ii * 2] = (unsigned char)(pixels[ii] >> 8);
+        out[ii * 2 + 1] = (unsigned char)pixels[ii];
+    }
+    free(pixels);
+    *ppOut = out;
+    return out != NULL;
+}
+
+static int PngToCells(const unsigned char *pIn, size_t inSize,
+                      unsigned char **ppOut, size_t *pOutSize)
+{
+    unsigned short *pixels, pixel;
+    unsigned char  *out, *dest;
+    unsigned int    width, height, cx, cy, xx, yy;
+
+    pixels = DecodePng(pIn, inSize, &width, &height);
+    if (pixels == NULL)
+    {
+        return 0;
+    }
+    if (width % CELL_SIZE || height % CELL_SIZE)
+    {
+        printf("Image size %ux%u isn't a multiple of the cell size\n", width, height);
+        free(pixels);
+        return 0;
+    }
+
+    *pOutSize = (size_t)width * height * 2;
+    out = malloc(*pOutSize);
+    dest = out;
+    for (cy = 0; out != NULL && cy < height; cy += CELL_SIZE)
+    {
+        for (cx = 0; cx < width; cx += CELL_SIZE)
+        {
+            for (yy = cy; yy < cy + CELL_SIZE; yy++)
+            {
+                for (xx = cx; xx < cx + CELL_SIZE; xx++)
+                {
+                    pixel = pixels[yy * width + xx];
+                    *dest++ = (unsigned char)(pixel >> 8);
+                    *dest++ = (unsigned char)pixel;
+                }
+            }
+        }
+    }
+    free(pixels);
+    *ppOut = out;
+    return out != NULL;
+}
+
+static int WavToPcm(const unsigned char *pIn, size_t inSize,
+                    unsigned char **ppOut, size_t *pOutSize)
+{
+    unsigned int    format = 0, bits = 0, len, ii;
+    size_t          pos = 12;
+    unsigned char  *out;
+
+    if (inSize < 12 || memcmp(pIn, "RIFF", 4) || memcmp(&pIn[8], "WAVE", 4))
+    {
+        printf("Not a WAV file\n");
+        return 0;
+    }
+
+    while (pos + 8 <= inSize)
+    {
+        len = GetLittle(&pIn[pos + 4], 4);
+        if (len > inSize - pos - 8)
+        {
+            len = inSize - pos - 8;
+        }
+        if (!memcmp(&pIn[pos], "fmt ", 4) && len >= 16)
+        {
+            format = GetLittle(&pIn[pos + 8], 2);
+            bits = GetLittle(&pIn[pos + 22], 2);
+        }
+        else if (!memcmp(&pIn[pos], "data", 4))
+        {
+            if (format != 1 || (bits != 8 && bits != 16))
+            {
+                printf("Unsupported WAV, only 8 and 16 bit PCM can be converted\n");
+                return 0;
+            }
+
+            // 8 bit WAV samples are unsigned, 16 bit ones little endian
+            out = malloc(len ? len : 1);
+            if (out == NULL)
+            {
+                return 0;
+            }
+            for (ii = 0; bits == 8 && ii < len; ii++)
+            {
+                out[ii] = pIn[pos + 8 + ii] ^ 0x80;
+            }
+            for (ii = 0; bits == 16 && ii + 1 < len; ii += 2)
+            {
+                out[ii] = pIn[pos + 9 + ii];
+                out[ii + 1] = pIn[pos + 8 + ii];
+            }
+            *ppOut = out;
+            *pOutSize = bits == 16 ? len & ~1u : len;
+            return 1;
+        }
+        pos += 8 + len + (len & 1);
+    }
+
+    printf("No sample data in the WAV file\n");
+    return 0;
+}
+
+int convert_register(const char *pSourceExt, const char *pTargetExt,
+                     const char *pName, int version, convert_fn_t function)
+{
+    converter_t *converter;
+
+    if (num_converters == CONVERT_MAX || strlen(pSourceExt) >= CONVERT_EXT_SIZE ||
+        strlen(pTargetExt) >= CONVERT_EXT_SIZE)
+    {
+        return 0;
+    }
+
+    converter = &converters[num_converters++];
+    strcpy(converter->source_ext, pSourceExt);
+    strcpy(converter->target_ext, pTargetExt);
+    converter->name = pName;
+    converter->version = version;
+    converter->function = function;
+    return 1;
+}
+
+static unsigned char *ReadFile(const char *pPath, size_t *pSize)
+{
+    unsigned char  *data;
+    long            size;
+    FILE           *File;
+
+    File = fopen(pPath, "rb");
+    if (File == NULL)
+    {
+        return NULL;
+    }
+    fseek(File, 0, SEEK_END);
+    size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    data = size < 0 ? NULL : malloc(size ? size : 1);
+    if (data != NULL && fread(data, 1, size, File) != (size_t)size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(File);
+    *pSize = (size_t)size;
+    return data;
+}
+
+static FILE *Convert(const converter_t *converter, const char *pSource,
+                     const char *pCacheDir)
+{
+    char            path[CONVERT_PATH_SIZE], temp[CONVERT_PATH_SIZE + 32];
+    unsigned char   digest[SHA256_SIZE];
+    unsigned char   version[4];
+    unsigned char  *source, *out = NULL;
+    size_t          source_size, out_size = 0;
+    struct timeval  before, after;
+    sha256_t        hash;
+    FILE           *File;
+    int             ii, ok;
+
+    source = ReadFile(pSource, &source_size);
+    if (source == NULL)
+    {
+        return NULL;
+    }
+
+    // the key covers the converter too, so a new version misses the cache
+    sha256_init(&hash);
+    sha256_update(&hash, (const unsigned char *)converter->name, strlen(converter->name) + 1);
+    version[0] = (unsigned char)(converter->version >> 24);
+    version[1] = (unsigned char)(converter->version >> 16);
+    version[2] = (unsigned char)(converter->version >> 8);
+    version[3] = (unsigned char)converter->version;
+    sha256_update(&hash, version, sizeof(version));
+    sha256_update(&hash, source, source_size);
+    sha256_final(&hash, digest);
+
+    snprintf(path, sizeof(path), "%s/", pCacheDir);
+    for (ii = 0; ii < SHA256_SIZE; ii++)
+    {
+        snprintf(&path[strlen(path)], sizeof(path) - strlen(path), "%02x", digest[ii]);
+    }
+    File = fopen(path, "rb");
+    if (File != NULL)
+    {
+        printf("Using cached conversion of %s\n", pSource);
+        free(source);
+        return File;
+    }
+
+    gettimeofday(&before, NULL);
+    ok = converter->function(source, source_size, &out, &out_size);
+    free(source);
+    if (!ok)
+    {
+        printf("Couldn't convert %s\n", pSource);
+        return NULL;
+    }
+    gettimeofday(&after, NULL);
+    printf("Converted %s in %.1f ms\n", pSource,
+           (after.tv_sec - before.tv_sec) * 1000.0 + (after.tv_usec - before.tv_usec) / 1000.0);
+
+    // several workers may convert the same source at once, write to a
+    // temporary name so none of them sees a partial result
+    snprintf(temp, sizeof(temp), "%s.%d.%p", path, (int)getpid(), (void *)&hash);
+    if (mkdir(pCacheDir, 0777) != 0 && errno != EEXIST)
+    {
+        File = NULL;
+    }
+    else
+    {
+        File = fopen(temp, "wb");
+    }
+    ok = File != NULL && fwrite(out, 1, out_size, File) == out_size;
+    if (File != NULL && fclose(File) != 0)
+    {
+        ok = 0;
+    }
+    ok = ok && rename(temp, path) == 0;
+    if (ok)
+    {
+        File = fopen(path, "rb");
+    }
+    else
+    {
+        // serve it anyway if the cache can't be written
+        unlink(temp);
+        File = tmpfile();
+        if (File != NULL && fwrite(out, 1, out_size, File) != out_size)
+        {
+            fclose(File);
+            File = NULL;
+        }
+    }
+    free(out);
+    return File;
+}
+
+FILE *convert_open(const char *pPath, const char *pCacheDir)
+{
+    char            source[CONVERT_PATH_SIZE];
+    const char     *ext = strrchr(pPath, '.');
+    struct stat     info;
+    size_t          base;
+    int             ii;
+
+    if (ext == NULL || strchr(ext, '/') != NULL)
+    {
+        return NULL;
+    }
+    base = ext - pPath;
+
+    for (ii = 0; ii < num_converters; ii++)
+    {
+        if (strcasecmp(ext, converters[ii].target_ext) ||
+            base + strlen(converters[ii].source_ext) >= sizeof(source))
+        {
+            continue;
+        }
+        memcpy(source, pPath, base);
+        strcpy(&source[base], converters[ii].source_ext);
+        if (stat(source, &info) == 0 && S_ISREG(info.st_mode))
+        {
+            return Convert(&converters[ii], source, pCacheDir);
+        }
+    }
+
+    return NULL;
+}
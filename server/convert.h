@@ -0,0 +1,33 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Derived assets for the file server. A request for a file that doesn't
+   exist, like title.rgb, is answered by running the converter registered
+   for that extension on the source file next to it (title.png). Results
+   are cached on disk, keyed by a hash of the converter and the source
+   contents, so a source only gets converted again after it changes.
+
+   Built in:
+       .png -> .rgb  15 bit RGB bitmap, big endian, MSB set on opaque pixels
+       .png -> .cel  the same in 8x8 cells, left to right, top to bottom
+       .wav -> .pcm  signed big endian PCM, the sample format the SCSP plays */
+
+#define CONVERT_MAX (16)
+#define CONVERT_CACHE_DIR ".satcache"
+
+//allocates the converted data in *ppOut, returns 0 on failure
+typedef int (*convert_fn_t)(const unsigned char *pIn, size_t inSize,
+                            unsigned char **ppOut, size_t *pOutSize);
+
+//extensions include the dot. bump version when the output changes so old
+//cached results aren't used. not thread safe, register before serving
+int convert_register(const char *pSourceExt, const char *pTargetExt,
+                     const char *pName, int version, convert_fn_t function);
+//opens the converted version of pPath (cached in pCacheDir), or returns
+//NULL if no converter applies or the conversion failed
+FILE *convert_open(const char *pPath, const char *pCacheDir);
+
+#endif // CONVERT_H
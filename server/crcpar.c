@@ -0,0 +1,182 @@
+/*
+    crcpar.c: CRC combination and multithreaded CRC
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "crcpar.h"
+
+#define CRC_POLY (0x07)
+#define CRC_WIDTH (8)
+#define CRC_TOP_BIT (1 << (CRC_WIDTH - 1))
+
+// below this much data per thread, thread startup costs more than it saves
+#define CRC_PIECE_MIN (256*1024)
+#define CRC_MAX_THREADS (16)
+
+typedef struct
+{
+    const unsigned char    *data;
+    size_t                  len;
+    crc_t                   crc;
+    pthread_t               thread;
+    int                     started;
+} crc_piece_t;
+
+// multiplies a vector by a matrix of CRC_WIDTH columns
+static crc_t Gf2Times(const crc_t *mat, crc_t vec)
+{
+    crc_t sum = 0;
+
+    while (vec)
+    {
+        if (vec & 1)
+        {
+            sum ^= *mat;
+        }
+        vec >>= 1;
+        mat++;
+    }
+
+    return sum;
+}
+
+static void Gf2Square(crc_t *square, const crc_t *mat)
+{
+    int n;
+
+    for (n = 0; n < CRC_WIDTH; n++)
+    {
+        square[n] = Gf2Times(mat, mat[n]);
+    }
+}
+
+crc_t crc_combine(crc_t crcA, crc_t crcB, size_t lenB)
+{
+    crc_t   even[CRC_WIDTH], odd[CRC_WIDTH];
+    int     n;
+
+    if (lenB == 0)
+    {
+        return crcA ^ crcB;
+    }
+
+    // operator for one zero bit, column n is where bit n ends up
+    for (n = 0; n < CRC_WIDTH; n++)
+    {
+        odd[n] = (1 << n) & CRC_TOP_BIT ? ((1 << n) << 1) ^ CRC_POLY : (1 << n) << 1;
+    }
+
+    Gf2Square(even, odd);   // two zero bits
+    Gf2Square(odd, even);   // four zero bits
+
+    // apply one zero byte, two, four... for each bit set in lenB
+    do
+    {
+        Gf2Square(even, odd);
+        if (lenB & 1)
+        {
+            crcA = Gf2Times(even, crcA);
+        }
+        lenB >>= 1;
+        if (lenB == 0)
+        {
+            break;
+        }
+
+        Gf2Square(odd, even);
+        if (lenB & 1)
+        {
+            crcA = Gf2Times(odd, crcA);
+        }
+        lenB >>= 1;
+    } while (lenB != 0);
+
+    return crcA ^ crcB;
+}
+
+static void *PieceThread(void *arg)
+{
+    crc_piece_t *piece = arg;
+
+    piece->crc = crc_update(crc_init(), piece->data, piece->len);
+    return NULL;
+}
+
+crc_t crc_parallel(crc_t crc, const unsigned char *data, size_t data_len)
+{
+    crc_piece_t pieces[CRC_MAX_THREADS];
+    long        cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t      count, step, offset = 0;
+    size_t      ii;
+
+    count = data_len / CRC_PIECE_MIN;
+    if (cores > 0 && count > (size_t)cores)
+    {
+        count = cores;
+    }
+    if (count > CRC_MAX_THREADS)
+    {
+        count = CRC_MAX_THREADS;
+    }
+    if (count < 2)
+    {
+        return crc_update(crc, data, data_len);
+    }
+
+    step = data_len / count;
+    for (ii = 0; ii < count; ii++)
+    {
+        pieces[ii].data = &data[offset];
+        pieces[ii].len = ii == count - 1 ? data_len - offset : step;
+        pieces[ii].started = 0;
+        offset += pieces[ii].len;
+
+        // the first piece is done on this thread
+        if (ii > 0 && !pthread_create(&pieces[ii].thread, NULL, PieceThread, &pieces[ii]))
+        {
+            pieces[ii].started = 1;
+        }
+    }
+
+    crc = crc_update(crc, pieces[0].data, pieces[0].len);
+    for (ii = 1; ii < count; ii++)
+    {
+        if (pieces[ii].started)
+        {
+            pthread_join(pieces[ii].thread, NULL);
+        }
+        else
+        {
+            PieceThread(&pieces[ii]);
+        }
+        crc = crc_combine(crc, pieces[ii].crc, pieces[ii].len);
+    }
+
+    return crc;
+}
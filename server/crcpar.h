@@ -0,0 +1,15 @@
+#ifndef CRCPAR_H
+#define CRCPAR_H
+
+#include "crc.h"
+
+/* CRC of A followed by B, given only the CRCs of both and B's length.
+   Works because the CRC (init 0, no final xor) is linear: A's CRC just
+   has to be advanced over lenB zero bytes, which is a GF(2) matrix power. */
+crc_t crc_combine(crc_t crcA, crc_t crcB, size_t lenB);
+
+/* Same result as crc_update, with large buffers split across threads and
+   the pieces merged with crc_combine. */
+crc_t crc_parallel(crc_t crc, const unsigned char *data, size_t data_len);
+
+#endif // CRCPAR_H
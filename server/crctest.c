@@ -0,0 +1,143 @@
+/*
+    crctest.c: checks the parallel CRC against crc_update
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Checks that crc_combine and crc_parallel give the same CRCs as a plain
+   crc_update over the whole buffer, for splits and lengths around the
+   edge cases: empty pieces, single bytes, lengths that aren't a multiple
+   of crc_parallel's piece size and buffers big enough to use every core.
+   Build with "make crctest", exits non-zero if anything differs. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "crc.h"
+#include "crcpar.h"
+
+#define BUFFER_SIZE (8*1024*1024 + 13)
+#define RANDOM_SPLITS (2000)
+// crc_parallel's smallest piece, from crcpar.c
+#define PIECE_SIZE (256*1024)
+
+static unsigned int seed = 1;
+static int failures = 0;
+
+// xorshift, so runs are repeatable
+static unsigned int Random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void CheckCombine(const unsigned char *pData, size_t lenA, size_t lenB)
+{
+    crc_t whole, crcA, crcB;
+
+    whole = crc_update(crc_init(), pData, lenA + lenB);
+    crcA = crc_update(crc_init(), pData, lenA);
+    crcB = crc_update(crc_init(), &pData[lenA], lenB);
+    if (crc_combine(crcA, crcB, lenB) != whole)
+    {
+        printf("crc_combine differs for %lu + %lu bytes\n",
+               (unsigned long)lenA, (unsigned long)lenB);
+        failures++;
+    }
+}
+
+static void CheckParallel(const unsigned char *pData, size_t len, crc_t start)
+{
+    crc_t expected = crc_update(start, pData, len);
+
+    if (crc_parallel(start, pData, len) != expected)
+    {
+        printf("crc_parallel differs for %lu bytes from 0x%02x\n", (unsigned long)len, start);
+        failures++;
+    }
+}
+
+int main(void)
+{
+    static const size_t lengths[] =
+    {
+        0, 1, 2, 7, 255, PIECE_SIZE - 1, PIECE_SIZE, PIECE_SIZE + 1,
+        2*PIECE_SIZE - 1, 2*PIECE_SIZE + 1, 3*PIECE_SIZE + 5, 1024*1024,
+        5*1024*1024 + 3, BUFFER_SIZE - 1, BUFFER_SIZE
+    };
+    unsigned char  *data = malloc(BUFFER_SIZE);
+    size_t          ii, jj, lenA, lenB;
+
+    if (data == NULL)
+    {
+        printf("Memory allocation error\n");
+        return 1;
+    }
+    for (ii = 0; ii < BUFFER_SIZE; ii++)
+    {
+        data[ii] = (unsigned char)Random();
+    }
+
+    // every pair of the fixed lengths that fits
+    for (ii = 0; ii < sizeof(lengths) / sizeof(lengths[0]); ii++)
+    {
+        for (jj = 0; jj < sizeof(lengths) / sizeof(lengths[0]); jj++)
+        {
+            if (lengths[ii] + lengths[jj] <= BUFFER_SIZE)
+            {
+                CheckCombine(data, lengths[ii], lengths[jj]);
+            }
+        }
+        CheckParallel(data, lengths[ii], crc_init());
+        CheckParallel(data, lengths[ii], (crc_t)Random());
+    }
+
+    // random split points, mostly short so many of them run quickly
+    for (ii = 0; ii < RANDOM_SPLITS; ii++)
+    {
+        lenA = Random() % (ii % 100 == 0 ? BUFFER_SIZE : 4096);
+        lenB = Random() % (BUFFER_SIZE - lenA + 1);
+        if (ii % 100 != 0)
+        {
+            lenB %= 4096;
+        }
+        CheckCombine(data, lenA, lenB);
+    }
+    for (ii = 0; ii < 50; ii++)
+    {
+        lenA = Random() % (BUFFER_SIZE + 1);
+        CheckParallel(&data[BUFFER_SIZE - lenA], lenA, (crc_t)Random());
+    }
+
+    free(data);
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("crc_combine and crc_parallel match crc_update\n");
+    return 0;
+}
@@ -30,95 +30,157 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <unistd.h>
 #include "ftdi.h"
 
+#include "bufpool.h"
 #include "crc.h"
+#include "crcpar.h"
 #include "devcart.h"
+#include "elf.h"
+#include "localdev.h"
+#include "metrics.h"
+#include "session.h"
+#include "swap.h"
+#include "usbread.h"
+
+struct devcart
+{
+    struct ftdi_context device;
+    unsigned char       send_buf[2*WRITE_PAYLOAD_SIZE];
+    unsigned char       recv_buf[2*READ_PAYLOAD_SIZE];
+    char                id[24];
+    int                 raw_reads;
+    usbread_t           raw_read;   // raw read leftovers
+    long long           latency;    // ns a read can sit on data, see devcart.h
+    int                 virtual;    // replayed session or local client
+    swap_layout_t       upload_swap;
+};
+
+#define FTDI_DEFAULT_LATENCY_MS (16)
+// a local client or replay hands data over as soon as it's there
+#define VIRTUAL_LATENCY_NS (1000000ll)
+
+/* The buffer pool's pinned memory comes from the first real cart opened and
+   belongs to its USB handle, while every open cart takes buffers from it.
+   So the pool lasts until the last cart is closed, and if its owner is
+   closed before then, the owner's device stays open until that point. */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static devcart_t *pool_owner = NULL;
+static int pool_users = 0;
+
+int devcart_download_request(devcart_t *pCart, const unsigned int address, const unsigned int size)
+{
+    int         status;
+    long long   start;
+
+    pCart->send_buf[0] = FUNC_DOWNLOAD; /* Client function */
+    pCart->send_buf[1] = (unsigned char)(address >> 24);
+    pCart->send_buf[2] = (unsigned char)(address >> 16);
+    pCart->send_buf[3] = (unsigned char)(address >> 8);
+    pCart->send_buf[4] = (unsigned char)(address);
+    pCart->send_buf[5] = (unsigned char)(size >> 24);
+    pCart->send_buf[6] = (unsigned char)(size >> 16);
+    pCart->send_buf[7] = (unsigned char)(size >> 8);
+    pCart->send_buf[8] = (unsigned char)(size);
+
+    start = metrics_now();
+    status = devcart_write(pCart, pCart->send_buf, 9);
+    metrics_phase(METRICS_USB_WRITE, start);
+    if (status < 0)
+    {
+        printf("Send download command error: %s\n",
+               ftdi_get_error_string(&pCart->device));
+        metrics_count(METRICS_WRITE_ERRORS);
+    }
 
-static unsigned char send_buf[2*WRITE_PAYLOAD_SIZE];
-static unsigned char recv_buf[2*READ_PAYLOAD_SIZE];
-ftdi_context_t device = {0};
+    return status < 0 ? 0 : 1;
+}
 
-int devcart_download(const char *pFilename, const unsigned int address,
-                      const unsigned int size)
+int devcart_download_receive(devcart_t *pCart, unsigned char *pBuffer, const unsigned int size)
 {
-    unsigned char  *pFileBuffer = NULL;
-    FILE           *File = NULL;
     unsigned int    received = 0;
-    int             status = -1;
+    int             status;
     crc_t           readChecksum, calcChecksum;
-    struct timeval      before, after;
-    signed long long    timedelta;
+    long long       start = metrics_now();
 
-    pFileBuffer = (unsigned char*)malloc(size);
-    if (pFileBuffer != NULL)
+    while (size - received > 0)
     {
-        gettimeofday(&before, NULL);
-        send_buf[0] = FUNC_DOWNLOAD; /* Client function */
-        send_buf[1] = (unsigned char)(address >> 24);
-        send_buf[2] = (unsigned char)(address >> 16);
-        send_buf[3] = (unsigned char)(address >> 8);
-        send_buf[4] = (unsigned char)(address);
-        send_buf[5] = (unsigned char)(size >> 24);
-        send_buf[6] = (unsigned char)(size >> 16);
-        send_buf[7] = (unsigned char)(size >> 8);
-        send_buf[8] = (unsigned char)(size);
-
-        status = ftdi_write_data(&device, send_buf, 9);
+        status = devcart_read(pCart, &pBuffer[received], size - received);
         if (status < 0)
         {
-            printf("Send download command error: %s\n",
-                   ftdi_get_error_string(&device));
-            goto DownloadError;
+            printf("Read data error: %s\n",
+                   ftdi_get_error_string(&pCart->device));
+            return 0;
         }
 
-        while (size - received > 0)
-        {
-            status = ftdi_read_data(&device, &pFileBuffer[received], size);
-            if (status < 0)
-            {
-                printf("Read data error: %s\n",
-                       ftdi_get_error_string(&device));
-                goto DownloadError;
-            }
+        received += status;
+    }
+    metrics_phase(METRICS_USB_READ, start);
+    metrics_bytes(size);
 
-            received += status;
+    // The transfer may timeout, so loop until a byte
+    // is received or an error occurs.
+    start = metrics_now();
+    do
+    {
+        status = devcart_read(pCart, (unsigned char*)&readChecksum, 1);
+        if (status < 0)
+        {
+            printf("Read data error: %s\n",
+                   ftdi_get_error_string(&pCart->device));
+            return 0;
         }
+    } while (status == 0);
+    metrics_phase(METRICS_ACK_WAIT, start);
 
-        // The transfer may timeout, so loop until a byte
-        // is received or an error occurs.
-        do
-        {
-            status = ftdi_read_data(&device, (unsigned char*)&readChecksum, 1);
-            if (status < 0)
-            {
-                printf("Read data error: %s\n",
-                       ftdi_get_error_string(&device));
-                goto DownloadError;
-            }
-        } while (status == 0);
+    start = metrics_now();
+    calcChecksum = crc_init();
+    calcChecksum = crc_parallel(calcChecksum, pBuffer, size);
+    calcChecksum = crc_finalize(calcChecksum);
+    metrics_phase(METRICS_CRC, start);
 
-        gettimeofday(&after, NULL);
-        timedelta = (signed long long) after.tv_sec * 1000000ll +
-                    (signed long long) after.tv_usec -
-                    (signed long long) before.tv_sec * 1000000ll -
-                    (signed long long) before.tv_usec;
-        printf("Transfer time %f\n", timedelta/1000000.0f);
-        printf("Transfer speed %f K/s\n", (size/1024.0f)/(timedelta/1000000.0f));
+    if (readChecksum != calcChecksum)
+    {
+        printf("Checksum error (%0x, should be %0x)\n",
+               calcChecksum, readChecksum);
+        return 0;
+    }
+
+    return 1;
+}
 
-        calcChecksum = crc_init();
-        calcChecksum = crc_update(calcChecksum, pFileBuffer, size);
-        calcChecksum = crc_finalize(calcChecksum);
+int devcart_download_buffer(devcart_t *pCart, unsigned char *pBuffer,
+                            const unsigned int address, const unsigned int size)
+{
+    return devcart_download_request(pCart, address, size) &&
+           devcart_download_receive(pCart, pBuffer, size);
+}
 
-        if (readChecksum != calcChecksum)
+int devcart_download(devcart_t *pCart, const char *pFilename,
+                     const unsigned int address, const unsigned int size)
+{
+    unsigned char  *pFileBuffer = NULL;
+    FILE           *File = NULL;
+    int             status = -1;
+    long long       before, timedelta;
+
+    pFileBuffer = bufpool_get(size);
+    if (pFileBuffer != NULL)
+    {
+        before = metrics_now();
+        if (!devcart_download_buffer(pCart, pFileBuffer, address, size))
         {
-            printf("Checksum error (%0x, should be %0x)\n",
-                   calcChecksum, readChecksum);
             status = -1;
             goto DownloadError;
         }
 
+        timedelta = (metrics_now() - before) / 1000;
+        printf("Transfer time %f\n", timedelta/1000000.0f);
+        printf("Transfer speed %f K/s\n", (size/1024.0f)/(timedelta/1000000.0f));
+
+        before = metrics_now();
         File = fopen(pFilename, "wb");
         if (File == NULL)
         {
@@ -129,10 +191,12 @@ int devcart_download(const char *pFilename, const unsigned int address,
         {
             fwrite(pFileBuffer, 1, size, File);
             fclose(File);
+            metrics_phase(METRICS_FILE_IO, before);
+            status = 0;
         }
 
 DownloadError:
-        free(pFileBuffer);
+        bufpool_put(pFileBuffer);
     }
 
     return status < 0 ? 0 : 1;
@@ -141,16 +205,257 @@ DownloadError:
 /* Sending the write command and data separately is inefficient,
    but simplifies the code. The alternative is to copy also the data
    into the sendbuffer. */
-int devcart_upload(const char *pFilename, const unsigned int Address)
+int devcart_upload_begin(devcart_t *pCart, const unsigned int Address, const unsigned int Size)
+{
+    int         status;
+    long long   start;
+
+    pCart->send_buf[0] = FUNC_UPLOAD; /* Client function */
+    pCart->send_buf[1] = (unsigned char)(Address >> 24);
+    pCart->send_buf[2] = (unsigned char)(Address >> 16);
+    pCart->send_buf[3] = (unsigned char)(Address >> 8);
+    pCart->send_buf[4] = (unsigned char)Address;
+    pCart->send_buf[5] = (unsigned char)(Size >> 24);
+    pCart->send_buf[6] = (unsigned char)(Size >> 16);
+    pCart->send_buf[7] = (unsigned char)(Size >> 8);
+    pCart->send_buf[8] = (unsigned char)Size;
+    start = metrics_now();
+    status = devcart_write(pCart, pCart->send_buf, 9);
+    metrics_phase(METRICS_USB_WRITE, start);
+
+    if (status < 0)
+    {
+        printf("Send upload command error: %s\n",
+               ftdi_get_error_string(&pCart->device));
+        metrics_count(METRICS_WRITE_ERRORS);
+    }
+
+    return status < 0 ? 0 : 1;
+}
+
+int devcart_upload_data(devcart_t *pCart, const unsigned char *pData, const unsigned int Size)
+{
+    unsigned int    sent = 0;
+    int             status;
+    long long       start = metrics_now();
+
+    while (Size - sent > 0)
+    {
+        status = devcart_write(pCart, &pData[sent], Size-sent);
+        if (status < 0)
+        {
+            printf("Send data error: %s\n",
+                   ftdi_get_error_string(&pCart->device));
+            metrics_count(METRICS_WRITE_ERRORS);
+            return 0;
+        }
+
+        sent += status;
+    }
+    metrics_phase(METRICS_USB_WRITE, start);
+    metrics_bytes(Size);
+
+    return 1;
+}
+
+int devcart_upload_checksum(devcart_t *pCart, const unsigned char Checksum)
+{
+    int status;
+
+    pCart->send_buf[0] = Checksum;
+    status = devcart_write(pCart, pCart->send_buf, 1);
+
+    if (status < 0)
+    {
+        printf("Send checksum error: %s\n",
+               ftdi_get_error_string(&pCart->device));
+        metrics_count(METRICS_WRITE_ERRORS);
+        return 0;
+    }
+
+    return 1;
+}
+
+int devcart_upload_result(devcart_t *pCart)
+{
+    int         status;
+    long long   start = metrics_now();
+
+    do
+    {
+        status = devcart_read(pCart, pCart->recv_buf, 1);
+        if (status < 0)
+        {
+            printf("Read upload result failed: %s\n",
+                   ftdi_get_error_string(&pCart->device));
+            return 0;
+        }
+    } while (status == 0);
+    metrics_phase(METRICS_ACK_WAIT, start);
+
+    return pCart->recv_buf[0] == 0;
+}
+
+int devcart_upload_end(devcart_t *pCart, const unsigned char Checksum)
+{
+    return devcart_upload_checksum(pCart, Checksum) && devcart_upload_result(pCart);
+}
+
+int devcart_upload_buffer(devcart_t *pCart, const unsigned char *pData,
+                          const unsigned int Address, const unsigned int Size)
+{
+    crc_t       checksum = crc_init();
+    long long   start = metrics_now();
+
+    checksum = crc_parallel(checksum, pData, Size);
+    checksum = crc_finalize(checksum);
+    metrics_phase(METRICS_CRC, start);
+
+    return devcart_upload_begin(pCart, Address, Size) &&
+           devcart_upload_data(pCart, pData, Size) &&
+           devcart_upload_end(pCart, checksum);
+}
+
+// sends one upload without waiting for its result
+static int UploadSegment(devcart_t *pCart, const unsigned char *pData,
+                         const unsigned int Address, const unsigned int Size)
+{
+    crc_t       checksum = crc_init();
+    long long   start = metrics_now();
+
+    checksum = crc_parallel(checksum, pData, Size);
+    checksum = crc_finalize(checksum);
+    metrics_phase(METRICS_CRC, start);
+
+    return devcart_upload_begin(pCart, Address, Size) &&
+           devcart_upload_data(pCart, pData, Size) &&
+           devcart_upload_checksum(pCart, checksum);
+}
+
+/* Every segment is sent before any result is read, so the uploads go back
+   to back. When the program is going to be run, BSS is cleared on the
+   target by a stub placed after the program, which then jumps to the entry
+   point. Otherwise BSS is uploaded as zeros. */
+static int UploadElf(devcart_t *pCart, const unsigned char *pData,
+                     const unsigned int Size, unsigned int *pEntry)
+{
+    elf_image_t     image;
+    elf_segment_t  *segment;
+    unsigned char   stub[ELF_STUB_SIZE + (ELF_MAX_SEGMENTS + 1) * 8];
+    unsigned char  *zeros;
+    unsigned int    sent = 0, bytes = 0, bss = 0, stub_address, ii;
+    int             ok = 1;
+
+    if (!elf_parse(pData, Size, &image))
+    {
+        return 0;
+    }
+
+    for (ii = 0; ii < (unsigned int)image.count && ok; ii++)
+    {
+        segment = &image.segments[ii];
+        if (segment->file_size > 0)
+        {
+            ok = UploadSegment(pCart, segment->data, segment->address, segment->file_size);
+            sent += ok;
+            bytes += segment->file_size;
+        }
+
+        bss += segment->mem_size - segment->file_size;
+        if (ok && pEntry == NULL && segment->mem_size > segment->file_size)
+        {
+            zeros = calloc(1, segment->mem_size - segment->file_size);
+            ok = zeros != NULL &&
+                 UploadSegment(pCart, zeros, segment->address + segment->file_size,
+                               segment->mem_size - segment->file_size);
+            sent += ok;
+            free(zeros);
+        }
+    }
+
+    if (ok && pEntry != NULL)
+    {
+        *pEntry = image.entry;
+        if (bss > 0)
+        {
+            stub_address = elf_end(&image);
+            ok = UploadSegment(pCart, stub, stub_address, elf_build_stub(&image, stub_address, stub));
+            sent += ok;
+            *pEntry = stub_address;
+        }
+    }
+
+    // results come back in order, collect all of them even after a failure
+    for (ii = 0; ii < sent; ii++)
+    {
+        if (!devcart_upload_result(pCart))
+        {
+            ok = 0;
+        }
+    }
+
+    printf("Loaded %d ELF segments: %u bytes, %u bytes of BSS %s\n", image.count,
+           bytes, bss, pEntry != NULL ? "cleared on the target" : "sent as zeros");
+    return ok;
+}
+
+/* pEntry is set to where to jump to when the program is going to be run.
+   Anything that isn't an ELF file is byte swapped in place. */
+static int UploadImage(devcart_t *pCart, unsigned char *pData, const unsigned int Size,
+                       const unsigned int Address, unsigned int *pEntry)
+{
+    if (elf_is_elf(pData, Size))
+    {
+        // ELF files say where they go
+        return UploadElf(pCart, pData, Size, pEntry);
+    }
+
+    swap_buffer(&pCart->upload_swap, pData, Size);
+    if (!devcart_upload_buffer(pCart, pData, Address, Size))
+    {
+        return 0;
+    }
+    if (pEntry != NULL)
+    {
+        *pEntry = Address;
+    }
+    return 1;
+}
+
+// the caller's data is only copied when it has to be swapped
+static int UploadMemory(devcart_t *pCart, const unsigned char *pData, const unsigned int Size,
+                        const unsigned int Address, unsigned int *pEntry)
+{
+    unsigned char  *pCopy = NULL;
+    int             ok;
+
+    if (pCart->upload_swap.record != 0 && !elf_is_elf(pData, Size))
+    {
+        pCopy = bufpool_get(Size);
+        if (pCopy == NULL)
+        {
+            printf("Memory allocation error\n");
+            return 0;
+        }
+        memcpy(pCopy, pData, Size);
+    }
+
+    // with no copy nothing gets written to the data
+    ok = UploadImage(pCart, pCopy != NULL ? pCopy : (unsigned char *)pData, Size, Address, pEntry);
+    bufpool_put(pCopy);
+    return ok;
+}
+
+static int UploadFile(devcart_t *pCart, const char *pFilename, const unsigned int Address,
+                      unsigned int *pEntry)
 {
     unsigned char      *pFileBuffer = NULL;
-    unsigned int        size = -1, sent = 0;
+    unsigned int        size = -1;
     FILE               *File = NULL;
     int                 status = 0;
-    crc_t               checksum = crc_init();
-    struct timeval      before, after;
-    signed long long    timedelta;
+    long long           before, timedelta;
 
+    before = metrics_now();
     File = fopen(pFilename, "rb");
     if (File == NULL)
     {
@@ -161,7 +466,8 @@ int devcart_upload(const char *pFilename, const unsigned int Address)
         fseek(File, 0, SEEK_END);
         size = ftell(File);
         fseek(File, 0, SEEK_SET);
-        pFileBuffer = malloc(size);
+        // the file goes straight into a buffer libusb can send from
+        pFileBuffer = bufpool_get(size);
 
         if (pFileBuffer == NULL)
         {
@@ -170,77 +476,21 @@ int devcart_upload(const char *pFilename, const unsigned int Address)
         else
         {
             fread(pFileBuffer, 1, size, File);
-            checksum = crc_update(checksum, pFileBuffer, size);
-            checksum = crc_finalize(checksum);
-
-            gettimeofday(&before, NULL);
-            send_buf[0] = FUNC_UPLOAD; /* Client function */
-            send_buf[1] = (unsigned char)(Address >> 24);
-            send_buf[2] = (unsigned char)(Address >> 16);
-            send_buf[3] = (unsigned char)(Address >> 8);
-            send_buf[4] = (unsigned char)Address;
-            send_buf[5] = (unsigned char)(size >> 24);
-            send_buf[6] = (unsigned char)(size >> 16);
-            send_buf[7] = (unsigned char)(size >> 8);
-            send_buf[8] = (unsigned char)size;
-            status = ftdi_write_data(&device, send_buf, 9);
-
-            if (status < 0)
-            {
-                printf("Send upload command error: %s\n",
-                       ftdi_get_error_string(&device));
-                goto UploadError;
-            }
-
-            while (size - sent > 0)
-            {
-                status = ftdi_write_data(&device, &pFileBuffer[sent], size-sent);
-                if (status < 0)
-                {
-                    printf("Send data error: %s\n",
-                           ftdi_get_error_string(&device));
-                    goto UploadError;
-                }
-
-                sent += status;
-            }
-
-            send_buf[0] = (unsigned char)checksum;
-            status = ftdi_write_data(&device, send_buf, 1);
-
-            if (status < 0)
-            {
-                printf("Send checksum error: %s\n",
-                       ftdi_get_error_string(&device));
-                goto UploadError;
-            }
+            metrics_phase(METRICS_FILE_IO, before);
 
-            do
-            {
-                status = ftdi_read_data(&device, recv_buf, 1);
-                if (status < 0)
-                {
-                    printf("Read upload result failed: %s\n",
-                           ftdi_get_error_string(&device));
-                    goto UploadError;
-                }
-            } while (status == 0);
-
-            if (recv_buf[0] != 0)
+            before = metrics_now();
+            if (!UploadImage(pCart, pFileBuffer, size, Address, pEntry))
             {
                 status = -1;
+                goto UploadError;
             }
 
-            gettimeofday(&after, NULL);
-            timedelta = (signed long long) after.tv_sec * 1000000ll +
-                        (signed long long) after.tv_usec -
-                        (signed long long) before.tv_sec * 1000000ll -
-                        (signed long long) before.tv_usec;
+            timedelta = (metrics_now() - before) / 1000;
             printf("Transfer time %f\n", timedelta/1000000.0f);
             printf("Transfer speed %f K/s\n", (size/1024.0f)/(timedelta/1000000.0f));
 
 UploadError:
-            free(pFileBuffer);
+            bufpool_put(pFileBuffer);
         }
         fclose(File);
     }
@@ -248,98 +498,302 @@ UploadError:
     return status < 0 ? 0 : 1;
 }
 
-int devcart_execute(const char *pFilename, const unsigned int Address)
+int devcart_upload(devcart_t *pCart, const char *pFilename, const unsigned int Address)
 {
-    int status = 0;
-    if (devcart_upload(pFilename, Address))
+    return UploadFile(pCart, pFilename, Address, NULL);
+}
+
+static int Execute(devcart_t *pCart, const unsigned int Entry)
+{
+    int status;
+
+    pCart->send_buf[0] = FUNC_EXEC; /* Client function */
+    pCart->send_buf[1] = (unsigned char)(Entry >> 24);
+    pCart->send_buf[2] = (unsigned char)(Entry >> 16);
+    pCart->send_buf[3] = (unsigned char)(Entry >> 8);
+    pCart->send_buf[4] = (unsigned char)Entry;
+    status = devcart_write(pCart, pCart->send_buf, 5);
+    if (status < 0)
     {
-        send_buf[0] = FUNC_EXEC; /* Client function */
-        send_buf[1] = (unsigned char)(Address >> 24);
-        send_buf[2] = (unsigned char)(Address >> 16);
-        send_buf[3] = (unsigned char)(Address >> 8);
-        send_buf[4] = (unsigned char)Address;
-        status = ftdi_write_data(&device, send_buf, 5);
-        if (status < 0)
-        {
-            printf("Send execute error: %s\n",
-                   ftdi_get_error_string(&device));
-        }
+        printf("Send execute error: %s\n",
+               ftdi_get_error_string(&pCart->device));
+        metrics_count(METRICS_WRITE_ERRORS);
     }
 
     return status < 0 ? 0 : 1;
 }
 
-int devcart_init(const int VID, const int PID)
+int devcart_execute(devcart_t *pCart, const char *pFilename, const unsigned int Address)
+{
+    unsigned int entry;
+
+    return UploadFile(pCart, pFilename, Address, &entry) && Execute(pCart, entry);
+}
+
+int devcart_upload_image(devcart_t *pCart, const unsigned char *pData,
+                         const unsigned int Size, const unsigned int Address)
+{
+    return UploadMemory(pCart, pData, Size, Address, NULL);
+}
+
+int devcart_execute_image(devcart_t *pCart, const unsigned char *pData,
+                          const unsigned int Size, const unsigned int Address)
+{
+    unsigned int entry;
+
+    return UploadMemory(pCart, pData, Size, Address, &entry) && Execute(pCart, entry);
+}
+
+int devcart_set_swap(devcart_t *pCart, const char *pLayout)
+{
+    return swap_parse(pLayout, &pCart->upload_swap);
+}
+
+int devcart_swapping(devcart_t *pCart)
+{
+    return pCart->upload_swap.record != 0;
+}
+
+void devcart_set_raw_reads(devcart_t *pCart, const int Enable)
+{
+    pCart->raw_reads = Enable;
+}
+
+int devcart_read(devcart_t *pCart, unsigned char *pBuffer, const int Size)
+{
+    int status;
+
+    if (session_replaying())
+    {
+        return session_read(pBuffer, Size);
+    }
+    else if (localdev_active())
+    {
+        status = localdev_read(pBuffer, Size);
+    }
+    else if (pCart->raw_reads)
+    {
+        status = usbread_data(&pCart->raw_read, &pCart->device, pBuffer, Size);
+    }
+    else
+    {
+        status = ftdi_read_data(&pCart->device, pBuffer, Size);
+    }
+
+    if (status < 0)
+    {
+        metrics_count(METRICS_READ_ERRORS);
+    }
+    session_log(SESSION_READ, pBuffer, status);
+    return status;
+}
+
+int devcart_write(devcart_t *pCart, const unsigned char *pData, const int Size)
 {
-    int status = ftdi_init(&device);
-    int error = 0;
+    int status;
+
+    if (session_replaying())
+    {
+        return session_write(pData, Size);
+    }
+
+    if (localdev_active())
+    {
+        status = localdev_write(pData, Size);
+    }
+    else
+    {
+        status = ftdi_write_data(&pCart->device, (unsigned char *)pData, Size);
+    }
+    session_log(SESSION_WRITE, pData, status);
+    return status;
+}
+
+devcart_t *devcart_open(const int VID, const int PID, const int Index)
+{
+    devcart_t      *pCart = calloc(1, sizeof(devcart_t));
+    int             status;
+    int             error = 0;
+    unsigned char   latency;
+
+    if (pCart == NULL)
+    {
+        printf("Memory allocation error\n");
+        return NULL;
+    }
+    status = ftdi_init(&pCart->device);
+    if (Index > 0)
+    {
+        snprintf(pCart->id, sizeof(pCart->id), "%04x:%04x/%d", VID, PID, Index);
+    }
+    else
+    {
+        snprintf(pCart->id, sizeof(pCart->id), "%04x:%04x", VID, PID);
+    }
+
+    // a replayed session or a local client stands in for the device
+    if (session_replaying() || localdev_active())
+    {
+        pCart->device.error_str = session_replaying() ? "end of the replayed session" :
+                                  "the client disconnected";
+        pCart->virtual = 1;
+        pCart->latency = VIRTUAL_LATENCY_NS;
+        pthread_mutex_lock(&pool_lock);
+        pool_users++;
+        pthread_mutex_unlock(&pool_lock);
+        return pCart;
+    }
 
     if (status < 0)
     {
-        printf("Init error: %s\n", ftdi_get_error_string(&device));
+        printf("Init error: %s\n", ftdi_get_error_string(&pCart->device));
         error = 1;
     }
     else
     {
-        status = ftdi_usb_open(&device, VID, PID);
+        status = ftdi_usb_open_desc_index(&pCart->device, VID, PID, NULL, NULL, Index);
         if (status < 0 && status != -5)
         {
-            printf("Device open error: %s\n", ftdi_get_error_string(&device));
+            printf("Device open error: %s\n", ftdi_get_error_string(&pCart->device));
             error = 1;
         }
         else
         {
-            status = ftdi_usb_purge_buffers(&device);
+            status = ftdi_usb_purge_buffers(&pCart->device);
             if (status < 0)
             {
                 printf("Purge buffers error: %s\n",
-                       ftdi_get_error_string(&device));
+                       ftdi_get_error_string(&pCart->device));
                 error = 1;
             }
 
-            status = ftdi_read_data_set_chunksize(&device, USB_READPACKET_SIZE);
+            status = ftdi_read_data_set_chunksize(&pCart->device, USB_READPACKET_SIZE);
             if (status < 0)
             {
                 printf("Set read chunksize error: %s\n",
-                       ftdi_get_error_string(&device));
+                       ftdi_get_error_string(&pCart->device));
                 error = 1;
             }
 
-            status = ftdi_write_data_set_chunksize(&device, USB_WRITEPACKET_SIZE);
+            status = ftdi_write_data_set_chunksize(&pCart->device, USB_WRITEPACKET_SIZE);
             if (status < 0)
             {
                 printf("Set write chunksize error: %s\n",
-                       ftdi_get_error_string(&device));
+                       ftdi_get_error_string(&pCart->device));
                 error = 1;
             }
 
-            status = ftdi_set_bitmode(&device, 0x0, BITMODE_RESET);
+            // an unknown timer is taken to be the FTDI default
+            latency = FTDI_DEFAULT_LATENCY_MS;
+            ftdi_get_latency_timer(&pCart->device, &latency);
+            pCart->latency = latency * 1000000ll;
+
+            status = ftdi_set_bitmode(&pCart->device, 0x0, BITMODE_RESET);
             if (status < 0)
             {
                 printf("Bitmode configuration error: %s\n",
-                       ftdi_get_error_string(&device));
+                       ftdi_get_error_string(&pCart->device));
                 error = 1;
             }
 
             if (error)
             {
-                ftdi_usb_close(&device);
+                ftdi_usb_close(&pCart->device);
+            }
+            else
+            {
+                pthread_mutex_lock(&pool_lock);
+                pool_users++;
+                if (pool_owner == NULL)
+                {
+                    pool_owner = pCart;
+                    bufpool_init(pCart->device.usb_dev);
+                }
+                pthread_mutex_unlock(&pool_lock);
             }
         }
     }
 
-    return !error;
+    if (error)
+    {
+        ftdi_deinit(&pCart->device);
+        free(pCart);
+        return NULL;
+    }
+    return pCart;
 }
 
-void devcart_close(void)
+const char *devcart_get_id(devcart_t *pCart)
 {
-    int status = ftdi_usb_purge_buffers(&device);
-    if (status < 0)
+    return pCart->id;
+}
+
+long long devcart_get_latency(devcart_t *pCart)
+{
+    return pCart->latency;
+}
+
+const char *devcart_get_error(devcart_t *pCart)
+{
+    return ftdi_get_error_string(&pCart->device);
+}
+
+static void FreeCart(devcart_t *pCart)
+{
+    if (!pCart->virtual)
     {
-        printf("Purge buffers error: %s\n",
-               ftdi_get_error_string(&device));
+        ftdi_usb_close(&pCart->device);
     }
-
-    ftdi_usb_close(&device);
+    ftdi_deinit(&pCart->device);
+    free(pCart);
 }
 
+void devcart_close(devcart_t *pCart)
+{
+    devcart_t  *owner = NULL;
+    int         status;
+
+    if (pCart == NULL)
+    {
+        return;
+    }
+
+    if (pCart->virtual)
+    {
+        localdev_close();
+    }
+    else
+    {
+        status = ftdi_usb_purge_buffers(&pCart->device);
+        if (status < 0)
+        {
+            printf("Purge buffers error: %s\n",
+                   ftdi_get_error_string(&pCart->device));
+        }
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    pool_users--;
+    if (pool_users == 0)
+    {
+        // pinned memory has to go before the handle it came from
+        bufpool_close();
+        owner = pool_owner;
+        pool_owner = NULL;
+    }
+    else if (pool_owner == pCart)
+    {
+        // other carts may still hold its pinned buffers
+        pCart = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (owner != NULL && owner != pCart)
+    {
+        FreeCart(owner);
+    }
+    if (pCart != NULL)
+    {
+        FreeCart(pCart);
+    }
+}
@@ -16,17 +16,83 @@ enum
     FUNC_EXEC,
     FUNC_PRINT,
     FUNC_QUIT,
-    FUNC_CHGDIR
+    FUNC_CHGDIR,
+    FUNC_ACK,           // client's checksum result for a file server upload
+    FUNC_CHECKSUM,      // file server upload checksum
+    FUNC_RESYNC,        // realign the file server link, followed by a nonce
+    FUNC_RESYNC_ACK,    // answer to FUNC_RESYNC with the same nonce
+    FUNC_READSECTORS,   // read from the mounted CD image, followed by the
+                        // FAD and sector count, answered like a download
+    FUNC_FILL,          // part of a file server upload sent as a byte run:
+                        // offset, length, value
+    FUNC_RELOAD         // watch mode poll: staging address, size, flags
 };
 
-typedef struct ftdi_context ftdi_context_t;
-extern ftdi_context_t device;
+// optional flags byte after the name in a file server download request
+#define DOWNLOAD_FILLS (1 << 0)     // the client understands FUNC_FILL
 
-int devcart_download(const char *pFilename, const unsigned int Address,
-                       const unsigned int Size);
-int devcart_upload(const char *pFilename, const unsigned int Address);
-int devcart_execute(const char *pFilename, const unsigned int Address);
-int devcart_init(const int VID, const int PID);
-void devcart_close(void);
+// upload size the file server sends when a requested file can't be read
+#define DEVCART_NO_FILE (0xffffffff)
+
+/* One cart. Everything that talks to the device takes its handle, so a
+   process can have several open and tools can link the device layer in as
+   libsatbug (see the Makefile). One thread can read from a handle while
+   another writes to it, but two reads or two writes mustn't overlap. */
+typedef struct devcart devcart_t;
+
+//the Index'th cart with these IDs, counting from 0. NULL if it can't be
+//opened. A replayed session or a local client (see session.h and
+//localdev.h) stands in for it when one's active
+devcart_t *devcart_open(const int VID, const int PID, const int Index);
+void devcart_close(devcart_t *pCart);
+
+int devcart_download(devcart_t *pCart, const char *pFilename,
+                     const unsigned int Address, const unsigned int Size);
+int devcart_download_buffer(devcart_t *pCart, unsigned char *pBuffer,
+                            const unsigned int Address, const unsigned int Size);
+// download split into the command and the response, so several commands
+// can be in flight at once. Responses come back in command order.
+int devcart_download_request(devcart_t *pCart, const unsigned int Address,
+                             const unsigned int Size);
+int devcart_download_receive(devcart_t *pCart, unsigned char *pBuffer,
+                             const unsigned int Size);
+int devcart_upload(devcart_t *pCart, const char *pFilename, const unsigned int Address);
+int devcart_upload_buffer(devcart_t *pCart, const unsigned char *pData,
+                          const unsigned int Address, const unsigned int Size);
+// like devcart_upload and devcart_execute, but from memory rather than a
+// file: ELF images go to their own addresses, anything else is byte
+// swapped (on a copy) and goes to Address
+int devcart_upload_image(devcart_t *pCart, const unsigned char *pData,
+                         const unsigned int Size, const unsigned int Address);
+int devcart_execute_image(devcart_t *pCart, const unsigned char *pData,
+                          const unsigned int Size, const unsigned int Address);
+// upload split into stages, for callers that produce the data incrementally
+int devcart_upload_begin(devcart_t *pCart, const unsigned int Address,
+                         const unsigned int Size);
+int devcart_upload_data(devcart_t *pCart, const unsigned char *pData,
+                        const unsigned int Size);
+int devcart_upload_end(devcart_t *pCart, const unsigned char Checksum);
+// upload_end is checksum + result. Several uploads can be sent before
+// collecting their results, which come back in the same order.
+int devcart_upload_checksum(devcart_t *pCart, const unsigned char Checksum);
+int devcart_upload_result(devcart_t *pCart);
+int devcart_execute(devcart_t *pCart, const char *pFilename, const unsigned int Address);
+// reads through raw libusb bulk transfers instead of libftdi (see usbread.h)
+void devcart_set_raw_reads(devcart_t *pCart, const int Enable);
+// byte swaps file uploads to the given layout (see swap.h), 0 if it's bad
+int devcart_set_swap(devcart_t *pCart, const char *pLayout);
+int devcart_swapping(devcart_t *pCart);
+// ftdi_read_data and ftdi_write_data on the open device, via whichever
+// backend is selected, captured or replayed (see session.h)
+int devcart_read(devcart_t *pCart, unsigned char *pBuffer, const int Size);
+int devcart_write(devcart_t *pCart, const unsigned char *pData, const int Size);
+//"VID:PID" of the open device, used to tag console output
+const char *devcart_get_id(devcart_t *pCart);
+//longest a read that gets data can wait by itself, in ns: the FTDI holds
+//back a partial packet for its latency timer. A read that took longer was
+//waiting for the other end to send something
+long long devcart_get_latency(devcart_t *pCart);
+//what went wrong with the last failed read or write
+const char *devcart_get_error(devcart_t *pCart);
 
 #endif // DEVCART_H
@@ -0,0 +1,195 @@
+/*
+    elf.c: ELF program loading
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "elf.h"
+
+#define EI_CLASS (4)
+#define EI_DATA (5)
+#define ELFCLASS32 (1)
+#define ELFDATA2MSB (2)
+#define EHDR_SIZE (52)
+#define PHDR_SIZE (32)
+#define PT_LOAD (1)
+#define PF_W (2)
+
+/* The stub, r4 walks a table of (start, end) pairs ending with end 0:
+
+   00  mov.l   table,r4
+   02  mov.l   entry,r3
+   04  mov     #0,r0
+   06 next:
+       mov.l   @r4+,r1
+   08  mov.l   @r4+,r2
+   0a  tst     r2,r2
+   0c  bt      done
+   0e loop:
+       cmp/hs  r2,r1
+   10  bt      next
+   12  mov.b   r0,@r1
+   14  bra     loop
+   16  add     #1,r1
+   18 done:
+       jmp     @r3
+   1a  nop
+   1c table: .long
+   20 entry: .long
+   24  pairs */
+static const unsigned short stub_code[] =
+{
+    0xd406, 0xd307, 0xe000, 0x6146, 0x6246, 0x2228, 0x8904, 0x3122,
+    0x89f9, 0x2100, 0xaffb, 0x7101, 0x432b, 0x0009
+};
+
+static unsigned int GetDword(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+           ((unsigned int)p[2] << 8) | p[3];
+}
+
+static unsigned int GetWord(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 8) | p[1];
+}
+
+static void PutDword(unsigned char *p, unsigned int value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+int elf_is_elf(const unsigned char *pData, size_t size)
+{
+    return size >= 4 && !memcmp(pData, "\x7f" "ELF", 4);
+}
+
+int elf_parse(const unsigned char *pData, size_t size, elf_image_t *pImage)
+{
+    const unsigned char    *phdr;
+    elf_segment_t          *segment;
+    unsigned int            phoff, phentsize, phnum, offset, ii;
+
+    memset(pImage, 0, sizeof(elf_image_t));
+    if (size < EHDR_SIZE || !elf_is_elf(pData, size) ||
+        pData[EI_CLASS] != ELFCLASS32 || pData[EI_DATA] != ELFDATA2MSB)
+    {
+        printf("Not a big endian 32 bit ELF file\n");
+        return 0;
+    }
+
+    pImage->entry = GetDword(&pData[24]);
+    phoff = GetDword(&pData[28]);
+    phentsize = GetWord(&pData[42]);
+    phnum = GetWord(&pData[44]);
+    if (phentsize < PHDR_SIZE || phoff > size || phnum > (size - phoff) / phentsize)
+    {
+        printf("Bad ELF program headers\n");
+        return 0;
+    }
+
+    for (ii = 0; ii < phnum; ii++)
+    {
+        phdr = &pData[phoff + ii * phentsize];
+        if (GetDword(&phdr[0]) != PT_LOAD || GetDword(&phdr[20]) == 0)
+        {
+            continue;
+        }
+        if (pImage->count == ELF_MAX_SEGMENTS)
+        {
+            printf("Too many ELF segments\n");
+            return 0;
+        }
+
+        segment = &pImage->segments[pImage->count++];
+        offset = GetDword(&phdr[4]);
+        segment->address = GetDword(&phdr[12]);     // p_paddr
+        segment->file_size = GetDword(&phdr[16]);
+        segment->mem_size = GetDword(&phdr[20]);
+        segment->writable = (GetDword(&phdr[24]) & PF_W) != 0;
+        if (offset > size || segment->file_size > size - offset ||
+            segment->file_size > segment->mem_size)
+        {
+            printf("Bad ELF segment\n");
+            return 0;
+        }
+        segment->data = &pData[offset];
+    }
+
+    if (pImage->count == 0)
+    {
+        printf("No loadable ELF segments\n");
+        return 0;
+    }
+    return 1;
+}
+
+unsigned int elf_end(const elf_image_t *pImage)
+{
+    unsigned int    end = 0, ii;
+
+    for (ii = 0; ii < (unsigned int)pImage->count; ii++)
+    {
+        if (pImage->segments[ii].address + pImage->segments[ii].mem_size > end)
+        {
+            end = pImage->segments[ii].address + pImage->segments[ii].mem_size;
+        }
+    }
+    return (end + 15) & ~15u;
+}
+
+unsigned int elf_build_stub(const elf_image_t *pImage, unsigned int address,
+                            unsigned char *pStub)
+{
+    const elf_segment_t    *segment;
+    unsigned int            size = ELF_STUB_SIZE, ii;
+
+    for (ii = 0; ii < sizeof(stub_code) / sizeof(stub_code[0]); ii++)
+    {
+        pStub[ii * 2] = (unsigned char)(stub_code[ii] >> 8);
+        pStub[ii * 2 + 1] = (unsigned char)stub_code[ii];
+    }
+    PutDword(&pStub[0x1c], address + ELF_STUB_SIZE);
+    PutDword(&pStub[0x20], pImage->entry);
+
+    for (ii = 0; ii < (unsigned int)pImage->count; ii++)
+    {
+        segment = &pImage->segments[ii];
+        if (segment->mem_size > segment->file_size)
+        {
+            PutDword(&pStub[size], segment->address + segment->file_size);
+            PutDword(&pStub[size + 4], segment->address + segment->mem_size);
+            size += 8;
+        }
+    }
+    PutDword(&pStub[size], 0);
+    PutDword(&pStub[size + 4], 0);
+    return size + 8;
+}
@@ -0,0 +1,40 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stddef.h>
+
+/* Just enough ELF to load a linked SH-2 program: big endian, 32 bit,
+   PT_LOAD segments placed at their physical addresses. */
+
+#define ELF_MAX_SEGMENTS (16)
+// clears BSS before jumping to the entry point, followed by the table
+#define ELF_STUB_SIZE (0x24)
+
+typedef struct
+{
+    unsigned int            address;
+    unsigned int            file_size;  // bytes from the file at data
+    unsigned int            mem_size;   // anything past file_size is BSS
+    int                     writable;
+    const unsigned char    *data;
+} elf_segment_t;
+
+typedef struct
+{
+    unsigned int    entry;
+    int             count;
+    elf_segment_t   segments[ELF_MAX_SEGMENTS];
+} elf_image_t;
+
+int elf_is_elf(const unsigned char *pData, size_t size);
+//pImage's segments point into pData, returns 0 if it can't be loaded
+int elf_parse(const unsigned char *pData, size_t size, elf_image_t *pImage);
+//builds SH-2 code that zeroes every segment's BSS then jumps to the entry
+//point, to run from address. returns its size, at most
+//ELF_STUB_SIZE + (ELF_MAX_SEGMENTS + 1) * 8
+unsigned int elf_build_stub(const elf_image_t *pImage, unsigned int address,
+                            unsigned char *pStub);
+//first free address past every segment, for the stub
+unsigned int elf_end(const elf_image_t *pImage);
+
+#endif // ELF_H
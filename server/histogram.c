@@ -0,0 +1,115 @@
+/*
+    histogram.c: log-linear latency histograms
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "histogram.h"
+
+static int Bucket(unsigned long long value)
+{
+    int bits;
+
+    if (value >= (1ull << HISTOGRAM_MAX_BITS))
+    {
+        value = (1ull << HISTOGRAM_MAX_BITS) - 1;
+    }
+    if (value < HISTOGRAM_SUB_BUCKETS)
+    {
+        return (int)value;
+    }
+    bits = 63 - __builtin_clzll(value);
+    return (bits - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+           (int)((value >> (bits - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+// the largest value that lands in a bucket
+static unsigned long long BucketTop(int bucket)
+{
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+
+    if (shift < 0)
+    {
+        return bucket;
+    }
+    return ((unsigned long long)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS + 1)
+            << shift) - 1;
+}
+
+void histogram_record(histogram_t *pHistogram, unsigned long long value)
+{
+    unsigned long long max = __atomic_load_n(&pHistogram->max, __ATOMIC_RELAXED);
+
+    __atomic_add_fetch(&pHistogram->counts[Bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pHistogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pHistogram->sum, value, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&pHistogram->max, &max, value, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void histogram_merge(histogram_t *pTo, const histogram_t *pFrom)
+{
+    int ii;
+
+    for (ii = 0; ii < HISTOGRAM_BUCKETS; ii++)
+    {
+        pTo->counts[ii] += pFrom->counts[ii];
+    }
+    pTo->count += pFrom->count;
+    pTo->sum += pFrom->sum;
+    if (pFrom->max > pTo->max)
+    {
+        pTo->max = pFrom->max;
+    }
+}
+
+unsigned long long histogram_quantile(const histogram_t *pHistogram, double quantile)
+{
+    unsigned long long  wanted = (unsigned long long)(quantile * pHistogram->count + 0.5);
+    unsigned long long  seen = 0;
+    int                 ii;
+
+    if (pHistogram->count == 0)
+    {
+        return 0;
+    }
+    if (wanted < 1)
+    {
+        wanted = 1;
+    }
+    for (ii = 0; ii < HISTOGRAM_BUCKETS; ii++)
+    {
+        seen += pHistogram->counts[ii];
+        if (seen >= wanted)
+        {
+            break;
+        }
+    }
+    if (ii == HISTOGRAM_BUCKETS || BucketTop(ii) > pHistogram->max)
+    {
+        return pHistogram->max;
+    }
+    return BucketTop(ii);
+}
@@ -0,0 +1,30 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/* Log-linear histogram like HdrHistogram: 16 buckets per power of two, so
+   quantiles are within about 6%. Values are in whatever unit the caller
+   records, -o metrics use nanoseconds and satload microseconds. Recording
+   is safe from several threads at once. */
+
+#define HISTOGRAM_SUB_BITS (4)
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+// anything from 2^40 up goes in the last bucket
+#define HISTOGRAM_MAX_BITS (40)
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct
+{
+    unsigned long long  counts[HISTOGRAM_BUCKETS];
+    unsigned long long  count;
+    unsigned long long  sum;
+    unsigned long long  max;
+} histogram_t;
+
+void histogram_record(histogram_t *pHistogram, unsigned long long value);
+//adds everything recorded in pFrom to pTo
+void histogram_merge(histogram_t *pTo, const histogram_t *pFrom);
+//the value quantile (0 to 1) of the recordings are at or below, as the top
+//of its bucket but never past the largest recorded. 0 when it's empty
+unsigned long long histogram_quantile(const histogram_t *pHistogram, double quantile);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,743 @@
+/*
+    link.c: framed, multiplexed link to the client library
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ftdi.h"
+
+#include "bufpool.h"
+#include "console.h"
+#include "crc.h"
+#include "devcart.h"
+#include "link.h"
+#include "metrics.h"
+#include "queue.h"
+#include "timeline.h"
+
+#define RX_BUF_SIZE (4096)
+#define RX_QUEUE_SIZE (64)
+/* Resync requests are repeated until one is answered, less and less often
+   and only so many times. A client that isn't reading would otherwise see
+   the FIFO fill up until our writes time out, and one that reads again
+   finds the requests still waiting for it. */
+#define RESYNC_RETRY_US (20000)
+#define RESYNC_RETRY_MAX_US (1000000)
+#define RESYNC_MAX_SENDS (16)
+// queued frames are sent together, as many as fit in one USB transfer
+#define TX_WRITE_SIZE (WRITE_PAYLOAD_SIZE)
+
+enum
+{
+    ACK_NONE = 0,
+    ACK_NEW,    // purge everything queued, then answer
+    ACK_REPEAT  // answer a retried request, the queues are already current
+};
+
+typedef struct
+{
+    const unsigned char    *data;
+    unsigned char          *slot;   // room for the header before data, or NULL
+    unsigned int            len;
+    void                   *release;
+    void                  (*free)(void *);  // what release goes to
+} tx_frame_t;
+
+// tx queues are only touched by the sending thread, so no atomics needed
+typedef struct
+{
+    tx_frame_t      frames[LINK_TX_FRAMES];
+    unsigned int    head;
+    unsigned int    tail;
+} tx_queue_t;
+
+struct link
+{
+    tx_queue_t      tx_queues[CHAN_COUNT];
+    unsigned char  *tx_buf;
+    devcart_t      *cart;
+    console_t      *console;    // where console frames go
+
+    pthread_t       rx_thread;
+    int             rx_running;
+    int             rx_alive;
+    spsc_queue_t    rx_messages;
+    unsigned char   rx_buf[RX_BUF_SIZE];
+
+    // incoming frame parser state
+    unsigned char   rx_header[FRAME_HEADER_SIZE];
+    unsigned int    rx_header_len;
+    unsigned int    rx_remaining;
+    int             rx_channel;
+    int             rx_drop;        // payload of the current frame is thrown away
+    int             rx_in_sequence;
+    unsigned char   rx_seq;         // next sequence number expected
+    link_msg_t     *rx_msg;
+
+    /* Resync state. The reader thread notices lost bytes, but frames are
+       sent from the server thread, so requests to send are passed over in
+       flags. */
+    int             hunting;        // waiting for our resync to be answered
+    int             resync_pending; // a resync request has to go out
+    unsigned char   resync_nonce;
+    int             ack_pending;    // the client's resync has to be answered
+    unsigned char   ack_nonce;
+    int             rx_acked;       // the last client resync we answered
+    unsigned char   rx_acked_nonce;
+    unsigned int    epoch;
+    unsigned char   tx_seq;
+    // resends of our resync, only touched by the sending side
+    long long       resync_sent;    // metrics_now() at the last one
+    long long       resync_retry_us;
+    unsigned int    resync_sends;
+    link_stats_t    stats;
+};
+
+static void CountStat(unsigned int *counter)
+{
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+static void StartResync(link_t *pLink)
+{
+    CountStat(&pLink->stats.resyncs);
+    metrics_count(METRICS_RETRIES);
+    timeline_instant("resync", "link");
+    __atomic_add_fetch(&pLink->epoch, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&pLink->resync_nonce, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&pLink->resync_pending, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&pLink->hunting, 1, __ATOMIC_RELEASE);
+}
+
+static int HeaderValid(link_t *pLink)
+{
+    const unsigned char    *header = pLink->rx_header;
+    unsigned int            len = (header[3] << 8) | header[4];
+
+    return header[0] == FRAME_SYNC &&
+           crc_finalize(crc_update(crc_init(), header, FRAME_HEADER_SIZE - 1)) == header[5] &&
+           header[1] < CHAN_COUNT && len <= FRAME_MAX_PAYLOAD;
+}
+
+// drops a bad header up to the next byte that could start a good one
+static void RescanHeader(link_t *pLink)
+{
+    unsigned int ii, jj;
+
+    for (ii = 1; ii < pLink->rx_header_len && pLink->rx_header[ii] != FRAME_SYNC; ii++);
+    for (jj = 0; ii < pLink->rx_header_len; ii++, jj++)
+    {
+        pLink->rx_header[jj] = pLink->rx_header[ii];
+    }
+    __atomic_add_fetch(&pLink->stats.skipped_bytes, pLink->rx_header_len - jj, __ATOMIC_RELAXED);
+    pLink->rx_header_len = jj;
+}
+
+static void BeginFrame(link_t *pLink)
+{
+    int searching = __atomic_load_n(&pLink->hunting, __ATOMIC_ACQUIRE);
+
+    pLink->rx_channel = pLink->rx_header[1];
+    pLink->rx_remaining = (pLink->rx_header[3] << 8) | pLink->rx_header[4];
+    pLink->rx_in_sequence = pLink->rx_header[2] == pLink->rx_seq;
+    pLink->rx_seq = pLink->rx_header[2] + 1;
+    pLink->rx_drop = 0;
+
+    // control frames are checked once they're complete, since resync
+    // messages are accepted whatever their sequence number
+    if (pLink->rx_channel == CHAN_CONTROL)
+    {
+        pLink->rx_msg = malloc(sizeof(link_msg_t));
+        if (pLink->rx_msg != NULL)
+        {
+            pLink->rx_msg->len = 0;
+        }
+    }
+    else if (searching)
+    {
+        pLink->rx_drop = 1;
+    }
+    else if (!pLink->rx_in_sequence)
+    {
+        CountStat(&pLink->stats.sequence_gaps);
+        StartResync(pLink);
+        pLink->rx_drop = 1;
+    }
+}
+
+static void EndControlFrame(link_t *pLink)
+{
+    link_msg_t *msg = pLink->rx_msg;
+    int         searching = __atomic_load_n(&pLink->hunting, __ATOMIC_ACQUIRE);
+
+    pLink->rx_msg = NULL;
+    if (msg == NULL)
+    {
+        return;
+    }
+
+    if (msg->len == 2 && msg->data[0] == FUNC_RESYNC)
+    {
+        if (!searching && pLink->rx_acked && msg->data[1] == pLink->rx_acked_nonce)
+        {
+            // a retry of a request we already answered, the answer may
+            // have been lost. Nothing is thrown away this time
+            int none = ACK_NONE;
+            __atomic_compare_exchange_n(&pLink->ack_pending, &none, ACK_REPEAT, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+        else
+        {
+            // the client lost track. Whatever either side was doing is
+            // void, and if we were resyncing too this settles it
+            CountStat(&pLink->stats.peer_resyncs);
+            metrics_count(METRICS_RETRIES);
+            timeline_instant("client resync", "link");
+            __atomic_add_fetch(&pLink->epoch, 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&pLink->ack_nonce, msg->data[1], __ATOMIC_RELEASE);
+            __atomic_store_n(&pLink->ack_pending, ACK_NEW, __ATOMIC_RELEASE);
+            __atomic_store_n(&pLink->hunting, 0, __ATOMIC_RELEASE);
+            pLink->rx_acked = 1;
+            pLink->rx_acked_nonce = msg->data[1];
+        }
+        pLink->rx_seq = 1;
+        free(msg);
+    }
+    else if (msg->len == 2 && msg->data[0] == FUNC_RESYNC_ACK)
+    {
+        // stale answers are ignored, but like every resync frame they
+        // restart the sequence count
+        if (searching && msg->data[1] == __atomic_load_n(&pLink->resync_nonce, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(&pLink->hunting, 0, __ATOMIC_RELEASE);
+        }
+        pLink->rx_seq = 1;
+        free(msg);
+    }
+    else if (searching)
+    {
+        free(msg);
+    }
+    else if (!pLink->rx_in_sequence)
+    {
+        CountStat(&pLink->stats.sequence_gaps);
+        StartResync(pLink);
+        free(msg);
+    }
+    else
+    {
+        msg->epoch = __atomic_load_n(&pLink->epoch, __ATOMIC_ACQUIRE);
+        spsc_push_wait(&pLink->rx_messages, msg);
+    }
+}
+
+static void Demux(link_t *pLink, const unsigned char *data, unsigned int len)
+{
+    unsigned int count;
+
+    while (len > 0)
+    {
+        if (pLink->rx_header_len < FRAME_HEADER_SIZE)
+        {
+            if (pLink->rx_header_len == 0 && *data != FRAME_SYNC)
+            {
+                CountStat(&pLink->stats.skipped_bytes);
+                if (!__atomic_load_n(&pLink->hunting, __ATOMIC_ACQUIRE))
+                {
+                    CountStat(&pLink->stats.bad_headers);
+                    StartResync(pLink);
+                }
+                data++;
+                len--;
+                continue;
+            }
+
+            pLink->rx_header[pLink->rx_header_len++] = *data++;
+            len--;
+            if (pLink->rx_header_len < FRAME_HEADER_SIZE)
+            {
+                continue;
+            }
+            if (!HeaderValid(pLink))
+            {
+                if (!__atomic_load_n(&pLink->hunting, __ATOMIC_ACQUIRE))
+                {
+                    CountStat(&pLink->stats.bad_headers);
+                    StartResync(pLink);
+                }
+                RescanHeader(pLink);
+                continue;
+            }
+            BeginFrame(pLink);
+        }
+
+        count = len < pLink->rx_remaining ? len : pLink->rx_remaining;
+        if (pLink->rx_drop)
+        {
+            // lost frame, or waiting for the resync answer
+        }
+        else if (pLink->rx_channel == CHAN_CONSOLE)
+        {
+            console_write(pLink->console, data, count);
+        }
+        else if (pLink->rx_channel == CHAN_CONTROL && pLink->rx_msg != NULL)
+        {
+            memcpy(&pLink->rx_msg->data[pLink->rx_msg->len], data, count);
+            pLink->rx_msg->len += count;
+        }
+        // nothing sends bulk or stream data to the server yet
+
+        data += count;
+        len -= count;
+        pLink->rx_remaining -= count;
+        if (pLink->rx_remaining == 0)
+        {
+            if (pLink->rx_channel == CHAN_CONTROL)
+            {
+                EndControlFrame(pLink);
+            }
+            pLink->rx_header_len = 0;
+        }
+    }
+}
+
+static void *RxThread(void *pArg)
+{
+    link_t     *pLink = pArg;
+    int         status;
+    long long   start;
+
+    timeline_thread("usb rx");
+    while (__atomic_load_n(&pLink->rx_running, __ATOMIC_ACQUIRE))
+    {
+        start = metrics_now();
+        status = devcart_read(pLink->cart, pLink->rx_buf, RX_BUF_SIZE);
+        if (status < 0)
+        {
+            printf("Read error: %s\n", devcart_get_error(pLink->cart));
+            break;
+        }
+        // reads that time out are the link idling, and ones that waited for
+        // the client to send something go apart from the USB read times
+        if (status > 0)
+        {
+            metrics_phase(metrics_now() - start > devcart_get_latency(pLink->cart) ?
+                          METRICS_LINK_IDLE : METRICS_USB_READ, start);
+            metrics_bytes(status);
+        }
+
+        start = metrics_now();
+        Demux(pLink, pLink->rx_buf, status);
+        if (status > 0)
+        {
+            timeline_span("demux", "link", start);
+        }
+    }
+
+    __atomic_store_n(&pLink->rx_alive, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void Release(tx_frame_t *frame)
+{
+    if (frame->release != NULL)
+    {
+        frame->free(frame->release);
+    }
+}
+
+// throws away every queued frame
+static void Purge(link_t *pLink)
+{
+    tx_queue_t *queue;
+    int         ii;
+
+    for (ii = 0; ii < CHAN_COUNT; ii++)
+    {
+        queue = &pLink->tx_queues[ii];
+        while (queue->tail != queue->head)
+        {
+            Release(&queue->frames[queue->tail % LINK_TX_FRAMES]);
+            queue->tail++;
+        }
+    }
+}
+
+link_t *link_start(devcart_t *pCart, console_t *pConsole)
+{
+    link_t *pLink = calloc(1, sizeof(link_t));
+
+    if (pLink == NULL)
+    {
+        printf("Memory allocation error\n");
+        return NULL;
+    }
+    pLink->cart = pCart;
+    pLink->console = pConsole;
+    pLink->resync_retry_us = RESYNC_RETRY_US;
+    pLink->ack_pending = ACK_NONE;
+
+    // frames that aren't sent from where they are go out of this one buffer,
+    // so keep it pinned for the session
+    pLink->tx_buf = bufpool_get(TX_WRITE_SIZE);
+    if (pLink->tx_buf == NULL || !spsc_init(&pLink->rx_messages, RX_QUEUE_SIZE))
+    {
+        printf("Memory allocation error\n");
+        bufpool_put(pLink->tx_buf);
+        free(pLink);
+        return NULL;
+    }
+
+    pLink->rx_running = 1;
+    pLink->rx_alive = 1;
+    if (pthread_create(&pLink->rx_thread, NULL, RxThread, pLink))
+    {
+        printf("Error starting USB reader thread\n");
+        spsc_free(&pLink->rx_messages);
+        bufpool_put(pLink->tx_buf);
+        free(pLink);
+        return NULL;
+    }
+
+    return pLink;
+}
+
+void link_stop(link_t *pLink)
+{
+    link_msg_t *msg;
+    int         spins = 0;
+
+    __atomic_store_n(&pLink->rx_running, 0, __ATOMIC_RELEASE);
+    // the reader may be waiting for room for a message
+    while (link_alive(pLink))
+    {
+        while ((msg = spsc_pop(&pLink->rx_messages)) != NULL)
+        {
+            free(msg);
+        }
+        queue_backoff(&spins);
+    }
+    pthread_join(pLink->rx_thread, NULL);
+
+    while ((msg = spsc_pop(&pLink->rx_messages)) != NULL)
+    {
+        free(msg);
+    }
+    spsc_free(&pLink->rx_messages);
+    free(pLink->rx_msg);
+
+    Purge(pLink);
+    bufpool_put(pLink->tx_buf);
+    free(pLink);
+}
+
+int link_alive(link_t *pLink)
+{
+    return __atomic_load_n(&pLink->rx_alive, __ATOMIC_ACQUIRE);
+}
+
+link_msg_t *link_receive(link_t *pLink)
+{
+    return spsc_pop(&pLink->rx_messages);
+}
+
+unsigned int link_epoch(link_t *pLink)
+{
+    return __atomic_load_n(&pLink->epoch, __ATOMIC_ACQUIRE);
+}
+
+void link_resync(link_t *pLink)
+{
+    StartResync(pLink);
+}
+
+void link_get_stats(link_t *pLink, link_stats_t *pStats)
+{
+    pStats->resyncs = __atomic_load_n(&pLink->stats.resyncs, __ATOMIC_RELAXED);
+    pStats->peer_resyncs = __atomic_load_n(&pLink->stats.peer_resyncs, __ATOMIC_RELAXED);
+    pStats->resync_sends = __atomic_load_n(&pLink->stats.resync_sends, __ATOMIC_RELAXED);
+    pStats->bad_headers = __atomic_load_n(&pLink->stats.bad_headers, __ATOMIC_RELAXED);
+    pStats->sequence_gaps = __atomic_load_n(&pLink->stats.sequence_gaps, __ATOMIC_RELAXED);
+    pStats->skipped_bytes = __atomic_load_n(&pLink->stats.skipped_bytes, __ATOMIC_RELAXED);
+}
+
+unsigned int link_queued(link_t *pLink, int channel)
+{
+    return pLink->tx_queues[channel].head - pLink->tx_queues[channel].tail;
+}
+
+static int Queue(link_t *pLink, int channel, const unsigned char *data, unsigned char *slot,
+                 unsigned int len, void *release, void (*Free)(void *))
+{
+    tx_queue_t *queue = &pLink->tx_queues[channel];
+    tx_frame_t *frame;
+
+    if (len > FRAME_MAX_PAYLOAD || queue->head - queue->tail >= LINK_TX_FRAMES)
+    {
+        return 0;
+    }
+
+    frame = &queue->frames[queue->head % LINK_TX_FRAMES];
+    frame->data = data;
+    frame->slot = slot;
+    frame->len = len;
+    frame->release = release;
+    frame->free = Free;
+    queue->head++;
+    return 1;
+}
+
+int link_queue(link_t *pLink, int channel, const unsigned char *data, unsigned int len,
+               void *release)
+{
+    return Queue(pLink, channel, data, NULL, len, release, free);
+}
+
+int link_queue_copy(link_t *pLink, int channel, const unsigned char *data, unsigned int len)
+{
+    unsigned char *copy = malloc(len ? len : 1);
+
+    if (copy == NULL)
+    {
+        return 0;
+    }
+
+    memcpy(copy, data, len);
+    if (!link_queue(pLink, channel, copy, len, copy))
+    {
+        free(copy);
+        return 0;
+    }
+
+    return 1;
+}
+
+int link_queue_split(link_t *pLink, int channel, const unsigned char *data, unsigned int len,
+                     void *release)
+{
+    unsigned int frames = (len + FRAME_MAX_PAYLOAD - 1) / FRAME_MAX_PAYLOAD;
+    unsigned int count;
+
+    if (LINK_TX_FRAMES - link_queued(pLink, channel) < frames)
+    {
+        return 0;
+    }
+
+    while (len > 0)
+    {
+        count = len < FRAME_MAX_PAYLOAD ? len : FRAME_MAX_PAYLOAD;
+        Queue(pLink, channel, data, NULL, count, count == len ? release : NULL, free);
+        data += count;
+        len -= count;
+    }
+
+    return 1;
+}
+
+int link_queue_slots(link_t *pLink, int channel, unsigned char *data, unsigned int len,
+                     void *release, void (*Free)(void *))
+{
+    unsigned int frames = (len + FRAME_MAX_PAYLOAD - 1) / FRAME_MAX_PAYLOAD;
+    unsigned int count;
+
+    if (LINK_TX_FRAMES - link_queued(pLink, channel) < frames)
+    {
+        return 0;
+    }
+
+    while (len > 0)
+    {
+        count = len < FRAME_MAX_PAYLOAD ? len : FRAME_MAX_PAYLOAD;
+        Queue(pLink, channel, &data[FRAME_HEADER_SIZE], data, count,
+              count == len ? release : NULL, Free);
+        data += FRAME_SLOT_SIZE;
+        len -= count;
+    }
+
+    return 1;
+}
+
+static void WriteHeader(unsigned char *header, int channel, unsigned char seq, unsigned int len)
+{
+    header[0] = FRAME_SYNC;
+    header[1] = (unsigned char)channel;
+    header[2] = seq;
+    header[3] = (unsigned char)(len >> 8);
+    header[4] = (unsigned char)len;
+    header[5] = crc_finalize(crc_update(crc_init(), header, FRAME_HEADER_SIZE - 1));
+}
+
+static int Write(link_t *pLink, const unsigned char *data, unsigned int len)
+{
+    unsigned int    sent = 0;
+    int             status;
+    long long       start;
+
+    start = metrics_now();
+    while (sent < len)
+    {
+        status = devcart_write(pLink->cart, &data[sent], len - sent);
+        if (status < 0)
+        {
+            printf("Send data error: %s\n", devcart_get_error(pLink->cart));
+            metrics_count(METRICS_WRITE_ERRORS);
+            return -1;
+        }
+        sent += status;
+    }
+    metrics_phase(METRICS_USB_WRITE, start);
+    metrics_bytes(len);
+
+    return 1;
+}
+
+// sends a resync request or answer, normally in place of anything queued
+static int SendResync(link_t *pLink, unsigned char command, unsigned char nonce, int purge)
+{
+    unsigned char msg[2];
+
+    msg[0] = command;
+    msg[1] = nonce;
+    if (purge)
+    {
+        Purge(pLink);
+    }
+    pLink->tx_seq = 1;
+    memcpy(&pLink->tx_buf[FRAME_HEADER_SIZE], msg, sizeof(msg));
+    WriteHeader(pLink->tx_buf, CHAN_CONTROL, 0, sizeof(msg));
+    return Write(pLink, pLink->tx_buf, FRAME_HEADER_SIZE + sizeof(msg));
+}
+
+// the frame after the taken ones that goes out next, highest priority first
+static tx_frame_t *Peek(link_t *pLink, const unsigned int *taken, int *pChannel)
+{
+    tx_queue_t *queue;
+    int         ii;
+
+    for (ii = 0; ii < CHAN_COUNT; ii++)
+    {
+        queue = &pLink->tx_queues[ii];
+        if (queue->head - queue->tail > taken[ii])
+        {
+            *pChannel = ii;
+            return &queue->frames[(queue->tail + taken[ii]) % LINK_TX_FRAMES];
+        }
+    }
+    return NULL;
+}
+
+int link_send_next(link_t *pLink)
+{
+    tx_queue_t     *queue;
+    tx_frame_t     *frame;
+    unsigned char  *out;
+    unsigned int    taken[CHAN_COUNT] = { 0 };
+    unsigned int    size = 0;
+    int             ii, channel, ack;
+
+    ack = __atomic_exchange_n(&pLink->ack_pending, ACK_NONE, __ATOMIC_ACQ_REL);
+    if (ack != ACK_NONE)
+    {
+        return SendResync(pLink, FUNC_RESYNC_ACK,
+                          __atomic_load_n(&pLink->ack_nonce, __ATOMIC_ACQUIRE), ack == ACK_NEW);
+    }
+
+    // nothing else goes out until the client answers
+    if (__atomic_load_n(&pLink->hunting, __ATOMIC_ACQUIRE))
+    {
+        if (__atomic_exchange_n(&pLink->resync_pending, 0, __ATOMIC_ACQ_REL))
+        {
+            pLink->resync_retry_us = RESYNC_RETRY_US;
+            pLink->resync_sends = 0;
+        }
+        else if (pLink->resync_sends >= RESYNC_MAX_SENDS ||
+                 metrics_now() - pLink->resync_sent <= pLink->resync_retry_us * 1000ll)
+        {
+            return 0;
+        }
+        else if (pLink->resync_retry_us < RESYNC_RETRY_MAX_US)
+        {
+            pLink->resync_retry_us *= 2;
+            if (pLink->resync_retry_us > RESYNC_RETRY_MAX_US)
+            {
+                pLink->resync_retry_us = RESYNC_RETRY_MAX_US;
+            }
+        }
+        CountStat(&pLink->stats.resync_sends);
+        pLink->resync_sent = metrics_now();
+        pLink->resync_sends++;
+        return SendResync(pLink, FUNC_RESYNC,
+                          __atomic_load_n(&pLink->resync_nonce, __ATOMIC_ACQUIRE), 1);
+    }
+
+    frame = Peek(pLink, taken, &channel);
+    if (frame == NULL)
+    {
+        return 0;
+    }
+
+    /* Frames queued with room for their header go out from where they are,
+       along with any that follow on right behind them. The rest are copied
+       into pLink->tx_buf together, one after the other. */
+    out = frame->slot != NULL ? frame->slot : pLink->tx_buf;
+    while (frame != NULL && size + FRAME_HEADER_SIZE + frame->len <= TX_WRITE_SIZE)
+    {
+        if (out == pLink->tx_buf)
+        {
+            if (frame->slot != NULL)
+            {
+                break;
+            }
+            memcpy(&out[size + FRAME_HEADER_SIZE], frame->data, frame->len);
+        }
+        else if (frame->slot != &out[size])
+        {
+            break;
+        }
+        WriteHeader(&out[size], channel, pLink->tx_seq++, frame->len);
+        size += FRAME_HEADER_SIZE + frame->len;
+        taken[channel]++;
+        frame = Peek(pLink, taken, &channel);
+    }
+
+    if (Write(pLink, out, size) < 0)
+    {
+        return -1;
+    }
+
+    for (ii = 0; ii < CHAN_COUNT; ii++)
+    {
+        queue = &pLink->tx_queues[ii];
+        for (; taken[ii] > 0; taken[ii]--)
+        {
+            Release(&queue->frames[queue->tail % LINK_TX_FRAMES]);
+            queue->tail++;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,98 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "console.h"
+#include "devcart.h"
+
+/* Framed link to the client library. Everything the server and the Saturn
+   exchange is split into frames on logical channels:
+
+       sync (0x5a), channel, sequence number, payload length (2 bytes,
+       big endian), CRC-8 of the previous five bytes, payload
+
+   A reader thread demultiplexes incoming frames: console text goes straight
+   to the console thread and control messages are queued for the server.
+   Outgoing frames are queued per channel and sent highest priority first,
+   so control and console frames preempt bulk data at frame boundaries.
+
+   Sequence numbers count every frame sent in each direction. A bad header
+   or a gap in the sequence means bytes were lost, so the receiver starts a
+   resync: it sends CONTROL [FUNC_RESYNC nonce] and drops everything until
+   [FUNC_RESYNC_ACK nonce] comes back. The other end throws away its queued
+   frames before answering. Both of those frames carry sequence number 0 and
+   the count carries on from 1 after them. */
+
+#define FRAME_SYNC (0x5a)
+#define FRAME_HEADER_SIZE (6)
+#define FRAME_MAX_PAYLOAD (1024)
+// a frame laid out in a buffer, see link_queue_slots
+#define FRAME_SLOT_SIZE (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD)
+#define LINK_TX_FRAMES (256)
+
+// in priority order, highest first
+enum
+{
+    CHAN_CONTROL = 0,
+    CHAN_CONSOLE,
+    CHAN_STREAM,
+    CHAN_BULK,
+    CHAN_COUNT
+};
+
+// one control frame from the client
+typedef struct
+{
+    unsigned int    epoch;  // link_epoch() when it arrived
+    unsigned int    len;
+    unsigned char   data[FRAME_MAX_PAYLOAD];
+} link_msg_t;
+
+typedef struct
+{
+    unsigned int    resyncs;        // started by this end
+    unsigned int    peer_resyncs;   // started by the client
+    unsigned int    resync_sends;   // resync requests sent, including retries
+    unsigned int    bad_headers;    // bad sync byte, CRC or length
+    unsigned int    sequence_gaps;  // frames missing from the sequence
+    unsigned int    skipped_bytes;  // thrown away looking for a header
+} link_stats_t;
+
+typedef struct link link_t;
+
+//frames go over pCart until link_stop, console text to pConsole. Each cart
+//gets a link of its own
+link_t *link_start(devcart_t *pCart, console_t *pConsole);
+void link_stop(link_t *pLink);
+//returns 0 once the reader thread has hit a read error
+int link_alive(link_t *pLink);
+//next control message from the client, or NULL. Free it when done.
+link_msg_t *link_receive(link_t *pLink);
+//goes up on every resync. Messages from an older epoch and anything
+//queued before the change belong to an exchange that was abandoned
+unsigned int link_epoch(link_t *pLink);
+//starts a resync from this end, e.g. when the client stops answering
+void link_resync(link_t *pLink);
+void link_get_stats(link_t *pLink, link_stats_t *pStats);
+
+/* The sending side must only be used from one thread. Queued data has to
+   stay valid until it's sent, release is passed to free() afterwards
+   (NULL for static data). */
+unsigned int link_queued(link_t *pLink, int channel);
+int link_queue(link_t *pLink, int channel, const unsigned char *data, unsigned int len,
+               void *release);
+int link_queue_copy(link_t *pLink, int channel, const unsigned char *data, unsigned int len);
+//splits data into as many frames as needed, release goes with the last one
+int link_queue_split(link_t *pLink, int channel, const unsigned char *data, unsigned int len,
+                     void *release);
+//queues len bytes laid out as FRAME_SLOT_SIZE slots from data: room for a
+//header, then FRAME_MAX_PAYLOAD bytes of payload (less in the last one).
+//The headers are written into the room and the frames go to USB straight
+//from the buffer instead of being copied. release is passed to Free.
+int link_queue_slots(link_t *pLink, int channel, unsigned char *data, unsigned int len,
+                     void *release, void (*Free)(void *));
+//sends the highest priority queued frames, as many as fit in one write,
+//returns 0 if nothing was queued (or a resync is waiting for an answer)
+//and -1 on error
+int link_send_next(link_t *pLink);
+
+#endif // LINK_H
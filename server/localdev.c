@@ -0,0 +1,139 @@
+/*
+    localdev.c: local socket in place of the cart
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "localdev.h"
+
+// reads give up after this long, like a USB read timing out
+#define READ_TIMEOUT_MS (10)
+// a client that goes away mustn't kill the server with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS (MSG_NOSIGNAL)
+#else
+#define SEND_FLAGS (0)
+#endif
+
+static int listen_fd = -1;
+static int client_fd = -1;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+int localdev_open(const char *pPath)
+{
+    struct sockaddr_un address;
+
+    if (strlen(pPath) >= sizeof(address.sun_path))
+    {
+        printf("Socket path '%s' is too long\n", pPath);
+        return 0;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, pPath);
+    unlink(pPath);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listen_fd, 1) < 0)
+    {
+        printf("Can't listen on '%s': %s\n", pPath, strerror(errno));
+        localdev_close();
+        return 0;
+    }
+    strcpy(socket_path, pPath);
+
+    printf("Waiting for a client on %s\n", pPath);
+    client_fd = accept(listen_fd, NULL, NULL);
+    if (client_fd < 0)
+    {
+        printf("Error accepting a client: %s\n", strerror(errno));
+        localdev_close();
+        return 0;
+    }
+#ifdef SO_NOSIGPIPE
+    {
+        int on = 1;
+
+        setsockopt(client_fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    return 1;
+}
+
+void localdev_close(void)
+{
+    if (client_fd >= 0)
+    {
+        close(client_fd);
+        client_fd = -1;
+    }
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+    }
+}
+
+int localdev_active(void)
+{
+    return client_fd >= 0;
+}
+
+int localdev_read(unsigned char *pBuffer, int size)
+{
+    struct pollfd   fd = {client_fd, POLLIN, 0};
+    ssize_t         got;
+
+    if (poll(&fd, 1, READ_TIMEOUT_MS) <= 0)
+    {
+        return 0;
+    }
+    got = read(client_fd, pBuffer, size);
+    if (got < 0 && (errno == EINTR || errno == EAGAIN))
+    {
+        return 0;
+    }
+    return got > 0 ? (int)got : -1;
+}
+
+int localdev_write(const unsigned char *pData, int len)
+{
+    ssize_t written;
+
+    do
+    {
+        written = send(client_fd, pData, len, SEND_FLAGS);
+    } while (written < 0 && errno == EINTR);
+    return written < 0 ? -1 : (int)written;
+}
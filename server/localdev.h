@@ -0,0 +1,18 @@
+#ifndef LOCALDEV_H
+#define LOCALDEV_H
+
+/* A Unix socket in place of the cart (-z). The server listens on the path
+   and treats the first program to connect as the Saturn, so software
+   clients like satload can drive the file server without hardware. */
+
+//waits for the client to connect
+int localdev_open(const char *pPath);
+void localdev_close(void);
+int localdev_active(void);
+
+//like ftdi_read_data: 0 if nothing came in for a while, -1 once the
+//client has gone
+int localdev_read(unsigned char *pBuffer, int size);
+int localdev_write(const unsigned char *pData, int len);
+
+#endif // LOCALDEV_H
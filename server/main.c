@@ -35,7 +35,17 @@
 #include <sys/time.h>
 
 #include "devcart.h"
+#include "localdev.h"
+#include "metrics.h"
+#include "reload.h"
 #include "server.h"
+#include "session.h"
+#include "shmring.h"
+#include "snapshot.h"
+#include "store.h"
+#include "swap.h"
+#include "timeline.h"
+#include "trace.h"
 
 static void PrintUsage(const char *pProgname);
 static void ParseNumericArg(const char *pArg, unsigned int *pResult);
@@ -50,6 +60,23 @@ int main(int argc, char **argv)
     int             VID = 0x0403, PID = 0x6001;
     char           *pVID = NULL, *pPID = NULL;
     char           *server_dir = NULL;
+    int             workers = SERVER_DEFAULT_WORKERS;
+    char           *snapshot_file = NULL, *restore_file = NULL;
+    char           *store_dir = NULL, *diff_a = NULL, *diff_b = NULL;
+    char           *trace_file = NULL;
+    char           *image_file = NULL;
+    int             watch = 0;
+    char           *metrics_file = NULL;
+    char           *timeline_file = NULL;
+    char           *capture_file = NULL, *replay_file = NULL;
+    int             realtime = 1;
+    char           *socket_path = NULL;
+    char           *ring_name = NULL;
+    int             raw_reads = 0;
+    char           *swap_spec = NULL;
+    swap_layout_t   swap_layout;
+    devcart_t      *cart;
+    shmring_t      *ring = NULL;
 
     if ((pVID = getenv("VID")))
         sscanf(pVID, "%x", &VID);
@@ -139,36 +166,280 @@ int main(int argc, char **argv)
                 ii += 2;
             }
         }
+        else if (!strcmp(argv[ii], "-m") || !strcmp(argv[ii], "-M"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                snapshot_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-r") || !strcmp(argv[ii], "-R"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                restore_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-k") || !strcmp(argv[ii], "-K"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                store_dir = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-c") || !strcmp(argv[ii], "-C"))
+        {
+            if (argc < ii + 3)
+            {
+                error = 1;
+            }
+            else
+            {
+                diff_a = argv[ii + 1];
+                diff_b = argv[ii + 2];
+                ii += 3;
+            }
+        }
+        else if (!strcmp(argv[ii], "-b") || !strcmp(argv[ii], "-B"))
+        {
+            raw_reads = 1;
+            ii++;
+        }
+        else if (!strcmp(argv[ii], "-t") || !strcmp(argv[ii], "-T"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                trace_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-e") || !strcmp(argv[ii], "-E"))
+        {
+            if (argc < ii + 2 || !swap_parse(argv[ii + 1], &swap_layout))
+            {
+                error = 1;
+            }
+            else
+            {
+                swap_spec = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-i") || !strcmp(argv[ii], "-I"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                image_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-o") || !strcmp(argv[ii], "-O"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                metrics_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-l") || !strcmp(argv[ii], "-L"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                timeline_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-a") || !strcmp(argv[ii], "-A"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                capture_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-n") || !strcmp(argv[ii], "-N"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                replay_file = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-z") || !strcmp(argv[ii], "-Z"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                socket_path = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-y") || !strcmp(argv[ii], "-Y"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                ring_name = argv[ii + 1];
+                ii += 2;
+            }
+        }
+        else if (!strcmp(argv[ii], "-f") || !strcmp(argv[ii], "-F"))
+        {
+            realtime = 0;
+            ii++;
+        }
+        else if (!strcmp(argv[ii], "-w") || !strcmp(argv[ii], "-W"))
+        {
+            watch = 1;
+            ii++;
+        }
+        else if (!strcmp(argv[ii], "-j") || !strcmp(argv[ii], "-J"))
+        {
+            if (argc < ii + 2)
+            {
+                error = 1;
+            }
+            else
+            {
+                workers = atoi(argv[ii + 1]);
+                ii += 2;
+            }
+        }
+        else
+        {
+            error = 1;
+        }
     }
 
-    if (error || (!function))
+    if (error || (!function && !server && !snapshot_file && !restore_file && !diff_a && !ring_name) ||
+        (diff_a && !store_dir) || (watch && (function != FUNC_EXEC || !server)) ||
+        (capture_file && replay_file) || (socket_path && replay_file) || (ring_name && server))
     {
         PrintUsage(argv[0]);
     }
-    else
+    else if (diff_a && !function && !server && !snapshot_file && !restore_file && !ring_name)
     {
-        if (devcart_init(VID, PID))
+        // comparing stored snapshots doesn't need the cart
+        store_diff(store_dir, diff_a, diff_b);
+    }
+    else if ((!metrics_file || metrics_open(metrics_file)) &&
+             (!timeline_file || timeline_open(timeline_file)) &&
+             (!capture_file || session_capture_open(capture_file)) &&
+             (!replay_file || session_replay_open(replay_file, realtime)) &&
+             (!socket_path || localdev_open(socket_path)))
+    {
+        if ((cart = devcart_open(VID, PID, 0)) != NULL)
         {
-            atexit(devcart_close);
+            devcart_set_raw_reads(cart, raw_reads);
+            if (swap_spec)
+            {
+                devcart_set_swap(cart, swap_spec);
+            }
             signal(SIGINT, Signal);
             switch (function)
             {
             case FUNC_DOWNLOAD:
-                devcart_download(pFilename, address, length);
+                metrics_begin(METRICS_DOWNLOAD);
+                metrics_end(devcart_download(cart, pFilename, address, length));
                 break;
             case FUNC_UPLOAD:
-                devcart_upload(pFilename, address);
+                metrics_begin(METRICS_UPLOAD);
+                metrics_end(devcart_upload(cart, pFilename, address));
                 break;
             case 3:
-                devcart_execute(pFilename, address);
+                metrics_begin(METRICS_EXECUTE);
+                metrics_end(devcart_execute(cart, pFilename, address));
                 break;
             }
 
-            if (server)
+            if (snapshot_file)
             {
-                server_run(server_dir);
+                metrics_begin(METRICS_SNAPSHOT);
+                metrics_end(snapshot_save(cart, snapshot_file, store_dir));
             }
+
+            if (restore_file)
+            {
+                metrics_begin(METRICS_RESTORE);
+                metrics_end(snapshot_restore(cart, restore_file, store_dir));
+            }
+
+            if (diff_a)
+            {
+                store_diff(store_dir, diff_a, diff_b);
+            }
+
+            // runs until satbug is stopped
+            if (ring_name && (ring = shmring_create(ring_name, SHMRING_DEFAULT_SIZE)) != NULL)
+            {
+                shmring_serve(ring, cart);
+            }
+
+            if (server && (!trace_file || trace_open(trace_file)))
+            {
+                if (!watch || reload_start(pFilename, address))
+                {
+                    metrics_begin(METRICS_SERVER);
+                    server_run(cart, server_dir, image_file, workers);
+                    metrics_end(1);
+                    reload_stop();
+                }
+                trace_close();
+            }
+
+            // everything that used the cart has been stopped and joined
+            shmring_close(ring);
+            devcart_close(cart);
         }
+        // written on the way out, even after ^C, once nothing records
+        metrics_close();
+        timeline_close();
+        session_close();
     }
 
     return 0;
@@ -190,19 +461,54 @@ static void PrintUsage(const char *pProgname)
     printf("Options:\n");
     printf("    -v  <VID>                     Device VID (Default 0x0403)\n");
     printf("    -p  <PID>                     Device PID (Default 0x6001)\n");
+    printf("    -j  <workers>                 File server preparation threads (Default %d)\n",
+           SERVER_DEFAULT_WORKERS);
+    printf("    -b                            Read with raw USB bulk transfers\n");
+    printf("    -t  <file>                    Record a timing trace of file server requests\n");
+    printf("    -e  <layout>                  Byte swap -u and -x data: 2 or 4 for every 16 or\n");
+    printf("                                  32 bit word, or record fields like 4,2,2,4x1/16\n");
+    printf("    -i  <image>                   CD image (.iso, .bin or .cue) for the file\n");
+    printf("                                  server to answer sector reads from\n");
+    printf("    -o  <file>                    Write transfer metrics on exit and SIGUSR1,\n");
+    printf("                                  as JSON if file ends in .json, otherwise in\n");
+    printf("                                  Prometheus text format\n");
+    printf("    -l  <file>                    Write a timeline of every thread's work as\n");
+    printf("                                  Chrome trace JSON, for ui.perfetto.dev\n");
+    printf("    -a  <file>                    Capture all USB traffic to file\n");
+    printf("    -n  <file>                    Replay a captured session instead of using\n");
+    printf("                                  the cart, with the same commands\n");
+    printf("    -f                            Replay as fast as possible rather than at\n");
+    printf("                                  the recorded speed\n");
+    printf("    -z  <socket>                  Talk to a client on a Unix socket, like\n");
+    printf("                                  satload, instead of the cart\n");
+    printf("    -w                            With -x and -s, send the program's changes\n");
+    printf("                                  when it's rebuilt (see Devcart_PollReload)\n");
+    printf("    -k  <directory>               Keep snapshots in a deduplicating store,\n");
+    printf("                                  -m and -r then take a snapshot name\n");
     printf("\n");
     printf("Commands:\n");
     printf("    -d  <file>  <address>  <size> Download data to file\n");
     printf("    -u  <file>  <address>         Upload data from file\n");
     printf("    -x  <file>  <address>         Upload program and execute\n");
+    printf("    -m  <file>                    Save a snapshot of all memory to file\n");
+    printf("    -r  <file>                    Restore memory from a snapshot\n");
+    printf("    -c  <name>  <name>            Compare two snapshots in the store (-k)\n");
     printf("    -s  <directory>               Start debug fileserver & console\n");
+    printf("    -y  <name>                    Upload what local programs post to a shared\n");
+    printf("                                  memory ring (see shmring.h)\n");
+    printf("ELF files given to -u and -x load to their own addresses, -x runs them\n");
+    printf("from their entry point\n");
     printf("USB IDs are given in hexadecimal, other arguments in decimal\n");
     printf("or hexadecimal (preceded by '0x')\n");
 }
 
+// the server and the ring return at their next pass and main tears
+// everything down once their threads are joined. A second ^C doesn't wait
 static void Signal(int sig)
 {
-    exit(EXIT_FAILURE);
+    server_stop();
+    shmring_stop();
+    signal(SIGINT, SIG_DFL);
 }
 
 //static void DoConsole(void)
@@ -0,0 +1,362 @@
+/*
+    metrics.c: transfer metrics
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "histogram.h"
+#include "metrics.h"
+#include "timeline.h"
+
+#define METRICS_PATH_SIZE (1024)
+
+typedef struct
+{
+    histogram_t         phases[METRICS_PHASES];    // nanoseconds
+    unsigned long long  counters[METRICS_COUNTERS];
+    unsigned long long  bytes;
+    double              throughput; // bytes per second of the last run
+    long long           finished;   // wall clock seconds of the last run
+    int                 used;
+} command_metrics_t;
+
+static const char *command_names[METRICS_COMMANDS] =
+{
+    "upload", "download", "execute", "snapshot", "restore", "server"
+};
+static const char *phase_names[METRICS_PHASES] =
+{
+    "file_io", "crc", "usb_write", "usb_read", "ack_wait", "request", "link_idle", "total"
+};
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static command_metrics_t *metrics = NULL;
+static char metrics_path[METRICS_PATH_SIZE];
+static int command = METRICS_UPLOAD;
+static long long command_start;
+static unsigned long long command_bytes;
+static volatile sig_atomic_t write_requested = 0;
+
+static double Quantile(const histogram_t *histogram, double quantile)
+{
+    return histogram_quantile(histogram, quantile) / 1e9;
+}
+
+static void Signal(int sig)
+{
+    write_requested = 1;
+}
+
+int metrics_open(const char *pFilename)
+{
+    metrics = calloc(METRICS_COMMANDS, sizeof(command_metrics_t));
+    if (metrics == NULL)
+    {
+        printf("Memory allocation error\n");
+        return 0;
+    }
+    snprintf(metrics_path, sizeof(metrics_path), "%s", pFilename);
+    signal(SIGUSR1, Signal);
+    return 1;
+}
+
+long long metrics_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ll + now.tv_nsec;
+}
+
+void metrics_begin(int Command)
+{
+    command = Command;
+    command_start = metrics_now();
+    command_bytes = metrics ? metrics[command].bytes : 0;
+    if (metrics != NULL)
+    {
+        metrics[command].used = 1;
+    }
+}
+
+int metrics_end(int ok)
+{
+    command_metrics_t  *current;
+    long long           elapsed = metrics_now() - command_start;
+
+    metrics_phase(METRICS_TOTAL, command_start);
+    if (metrics == NULL)
+    {
+        return ok;
+    }
+
+    current = &metrics[command];
+    if (!ok)
+    {
+        metrics_count(METRICS_FAILURES);
+    }
+    else if (elapsed > 0 && current->bytes > command_bytes)
+    {
+        current->throughput = (current->bytes - command_bytes) * 1e9 / elapsed;
+    }
+    current->finished = time(NULL);
+    return ok;
+}
+
+void metrics_phase(int phase, long long start)
+{
+    histogram_t        *histogram;
+    unsigned long long  elapsed;
+
+    // requests are pipelined, they overlap each other
+    if (phase == METRICS_REQUEST)
+    {
+        timeline_async(phase_names[phase], command_names[command], start);
+    }
+    else
+    {
+        timeline_span(phase_names[phase], command_names[command], start);
+    }
+    if (metrics == NULL)
+    {
+        return;
+    }
+
+    // the file server's workers record too
+    histogram = &metrics[command].phases[phase];
+    elapsed = (unsigned long long)(metrics_now() - start);
+    histogram_record(histogram, elapsed);
+}
+
+void metrics_bytes(unsigned long long bytes)
+{
+    if (metrics != NULL)
+    {
+        __atomic_add_fetch(&metrics[command].bytes, bytes, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_count(int counter)
+{
+    if (metrics != NULL)
+    {
+        __atomic_add_fetch(&metrics[command].counters[counter], 1, __ATOMIC_RELAXED);
+    }
+}
+
+// one metric family, counters first to last are its samples
+static void WriteCounter(FILE *File, const char *name, const char *help, int first, int last)
+{
+    int ii, jj;
+
+    fprintf(File, "# HELP %s %s\n", name, help);
+    fprintf(File, "# TYPE %s counter\n", name);
+    for (ii = 0; ii < METRICS_COMMANDS; ii++)
+    {
+        for (jj = first; metrics[ii].used && jj <= last; jj++)
+        {
+            fprintf(File, "%s{command=\"%s\"%s} %llu\n", name, command_names[ii],
+                    jj == METRICS_WRITE_ERRORS ? ",op=\"write\"" :
+                    jj == METRICS_READ_ERRORS ? ",op=\"read\"" : "",
+                    metrics[ii].counters[jj]);
+        }
+    }
+}
+
+static void WritePrometheus(FILE *File)
+{
+    const histogram_t  *histogram;
+    int                         ii, jj, kk;
+
+    fprintf(File, "# HELP satbug_phase_seconds Time spent in each phase of a command.\n");
+    fprintf(File, "# TYPE satbug_phase_seconds summary\n");
+    for (ii = 0; ii < METRICS_COMMANDS; ii++)
+    {
+        for (jj = 0; jj < METRICS_PHASES; jj++)
+        {
+            histogram = &metrics[ii].phases[jj];
+            if (histogram->count == 0)
+            {
+                continue;
+            }
+            for (kk = 0; kk < (int)(sizeof(quantiles) / sizeof(quantiles[0])); kk++)
+            {
+                fprintf(File, "satbug_phase_seconds{command=\"%s\",phase=\"%s\",quantile=\"%g\"} %.9f\n",
+                        command_names[ii], phase_names[jj], quantiles[kk],
+                        Quantile(histogram, quantiles[kk]));
+            }
+            fprintf(File, "satbug_phase_seconds{command=\"%s\",phase=\"%s\",quantile=\"1\"} %.9f\n",
+                    command_names[ii], phase_names[jj], histogram->max / 1e9);
+            fprintf(File, "satbug_phase_seconds_sum{command=\"%s\",phase=\"%s\"} %.9f\n",
+                    command_names[ii], phase_names[jj], histogram->sum / 1e9);
+            fprintf(File, "satbug_phase_seconds_count{command=\"%s\",phase=\"%s\"} %llu\n",
+                    command_names[ii], phase_names[jj], histogram->count);
+        }
+    }
+
+    fprintf(File, "# HELP satbug_bytes_total Bytes moved over USB by a command.\n");
+    fprintf(File, "# TYPE satbug_bytes_total counter\n");
+    for (ii = 0; ii < METRICS_COMMANDS; ii++)
+    {
+        if (metrics[ii].used)
+        {
+            fprintf(File, "satbug_bytes_total{command=\"%s\"} %llu\n",
+                    command_names[ii], metrics[ii].bytes);
+        }
+    }
+    fprintf(File, "# HELP satbug_throughput_bytes_per_second Throughput of the last successful run.\n");
+    fprintf(File, "# TYPE satbug_throughput_bytes_per_second gauge\n");
+    for (ii = 0; ii < METRICS_COMMANDS; ii++)
+    {
+        if (metrics[ii].throughput > 0.0)
+        {
+            fprintf(File, "satbug_throughput_bytes_per_second{command=\"%s\"} %.0f\n",
+                    command_names[ii], metrics[ii].throughput);
+        }
+    }
+    fprintf(File, "# HELP satbug_last_run_timestamp_seconds When a command last finished.\n");
+    fprintf(File, "# TYPE satbug_last_run_timestamp_seconds gauge\n");
+    for (ii = 0; ii < METRICS_COMMANDS; ii++)
+    {
+        if (metrics[ii].finished > 0)
+        {
+            fprintf(File, "satbug_last_run_timestamp_seconds{command=\"%s\"} %lld\n",
+                    command_names[ii], metrics[ii].finished);
+        }
+    }
+
+    WriteCounter(File, "satbug_retries_total", "Link resynchronisations.",
+                 METRICS_RETRIES, METRICS_RETRIES);
+    WriteCounter(File, "satbug_failures_total", "Commands and file server requests that failed.",
+                 METRICS_FAILURES, METRICS_FAILURES);
+    WriteCounter(File, "satbug_ftdi_errors_total", "Errors returned by libftdi.",
+                 METRICS_WRITE_ERRORS, METRICS_READ_ERRORS);
+}
+
+static void WriteJson(FILE *File)
+{
+    static const char  *counter_names[METRICS_COUNTERS] =
+    {
+        "retries", "failures", "ftdi_write_errors", "ftdi_read_errors"
+    };
+    const command_metrics_t    *current;
+    const histogram_t          *histogram;
+    int                         ii, jj, kk, first = 1, first_phase;
+
+    fprintf(File, "{\n  \"timestamp\": %lld,\n  \"commands\": {", (long long)time(NULL));
+    for (ii = 0; ii < METRICS_COMMANDS; ii++)
+    {
+        current = &metrics[ii];
+        if (!current->used)
+        {
+            continue;
+        }
+        fprintf(File, "%s\n    \"%s\": {\n", first ? "" : ",", command_names[ii]);
+        first = 0;
+        fprintf(File, "      \"bytes\": %llu,\n", current->bytes);
+        fprintf(File, "      \"throughput\": %.0f,\n", current->throughput);
+        fprintf(File, "      \"last_run\": %lld,\n", current->finished);
+        for (jj = 0; jj < METRICS_COUNTERS; jj++)
+        {
+            fprintf(File, "      \"%s\": %llu,\n", counter_names[jj], current->counters[jj]);
+        }
+        fprintf(File, "      \"phases\": {");
+        first_phase = 1;
+        for (jj = 0; jj < METRICS_PHASES; jj++)
+        {
+            histogram = &current->phases[jj];
+            if (histogram->count == 0)
+            {
+                continue;
+            }
+            fprintf(File, "%s\n        \"%s\": {\"count\": %llu, \"sum\": %.9f",
+                    first_phase ? "" : ",", phase_names[jj], histogram->count,
+                    histogram->sum / 1e9);
+            first_phase = 0;
+            for (kk = 0; kk < (int)(sizeof(quantiles) / sizeof(quantiles[0])); kk++)
+            {
+                fprintf(File, ", \"p%g\": %.9f", quantiles[kk] * 100,
+                        Quantile(histogram, quantiles[kk]));
+            }
+            fprintf(File, ", \"max\": %.9f}", histogram->max / 1e9);
+        }
+        fprintf(File, "\n      }\n    }");
+    }
+    fprintf(File, "\n  }\n}\n");
+}
+
+// written next to the file and renamed over it, so a collector never sees
+// half of it
+static void WriteMetrics(void)
+{
+    char    temp[METRICS_PATH_SIZE + 8];
+    size_t  len = strlen(metrics_path);
+    FILE   *File;
+
+    snprintf(temp, sizeof(temp), "%s.tmp", metrics_path);
+    File = fopen(temp, "w");
+    if (File == NULL)
+    {
+        printf("Error creating metrics file '%s'\n", temp);
+        return;
+    }
+    if (len >= 5 && !strcmp(&metrics_path[len - 5], ".json"))
+    {
+        WriteJson(File);
+    }
+    else
+    {
+        WritePrometheus(File);
+    }
+    if (fclose(File) != 0 || rename(temp, metrics_path) != 0)
+    {
+        printf("Error writing metrics file '%s'\n", metrics_path);
+        remove(temp);
+    }
+}
+
+void metrics_check(void)
+{
+    if (write_requested && metrics != NULL)
+    {
+        write_requested = 0;
+        WriteMetrics();
+    }
+}
+
+void metrics_close(void)
+{
+    if (metrics != NULL)
+    {
+        WriteMetrics();
+        free(metrics);
+        metrics = NULL;
+    }
+}
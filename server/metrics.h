@@ -0,0 +1,68 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/* Transfer metrics (-o). The time each command spends in file I/O, CRC,
+   USB writes, USB reads and waiting for the target's answer goes into a
+   histogram per phase, along with bytes moved, retries, failures and
+   libftdi errors. The file server's link reads that sat waiting for the
+   client are kept apart from its USB reads. The file is written as
+   Prometheus text for node_exporter's textfile collector, or as JSON if
+   its name ends in .json, when satbug exits and on SIGUSR1 while the file
+   server runs.
+
+   Histograms are log-linear like HdrHistogram: 16 buckets per power of
+   two of nanoseconds, so quantiles are within about 6%. */
+
+enum
+{
+    METRICS_UPLOAD = 0,
+    METRICS_DOWNLOAD,
+    METRICS_EXECUTE,
+    METRICS_SNAPSHOT,
+    METRICS_RESTORE,
+    METRICS_SERVER,
+    METRICS_COMMANDS
+};
+
+enum
+{
+    METRICS_FILE_IO = 0,
+    METRICS_CRC,
+    METRICS_USB_WRITE,
+    METRICS_USB_READ,
+    METRICS_ACK_WAIT,   // the target working out its answer
+    METRICS_REQUEST,    // a file server request, arrival to the client's ack
+    METRICS_LINK_IDLE,  // file server link reads that waited on the client
+    METRICS_TOTAL,      // a whole command
+    METRICS_PHASES
+};
+
+enum
+{
+    METRICS_RETRIES = 0,        // link resyncs
+    METRICS_FAILURES,
+    METRICS_WRITE_ERRORS,       // from libftdi
+    METRICS_READ_ERRORS,
+    METRICS_COUNTERS
+};
+
+int metrics_open(const char *pFilename);
+//writes the file a last time, once no other thread can be recording
+void metrics_close(void);
+//monotonic nanoseconds, cheap enough to call when metrics are off
+long long metrics_now(void);
+
+//everything recorded until metrics_end belongs to command
+void metrics_begin(int command);
+//records the command's total time and throughput, returns ok
+int metrics_end(int ok);
+
+//time since start, metrics_now() from before the phase
+void metrics_phase(int phase, long long start);
+void metrics_bytes(unsigned long long bytes);
+void metrics_count(int counter);
+
+//writes the file if SIGUSR1 asked for it
+void metrics_check(void);
+
+#endif // METRICS_H
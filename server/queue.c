@@ -0,0 +1,344 @@
+/*
+    queue.c: lock-free single producer/single consumer queue
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "queue.h"
+
+#define QUEUE_SPINS (64)
+#define QUEUE_YIELDS (64)
+#define QUEUE_MIN_SLEEP_US (50)
+
+static void InitWaiter(queue_waiter_t *w)
+{
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    w->sleepers = 0;
+}
+
+static void FreeWaiter(queue_waiter_t *w)
+{
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->lock);
+}
+
+// called after moving head or tail. The fence pairs with the one in
+// Sleep, so either the sleeper sees the move or this sees the sleeper
+static void Wake(queue_waiter_t *w)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->sleepers, __ATOMIC_RELAXED) != 0)
+    {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+// announces a sleeper, the caller then rechecks what it's waiting for
+static void SleepBegin(queue_waiter_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    __atomic_add_fetch(&w->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void SleepEnd(queue_waiter_t *w, int wait)
+{
+    if (wait)
+    {
+        pthread_cond_wait(&w->wake, &w->lock);
+    }
+    __atomic_sub_fetch(&w->sleepers, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// returns 0 once spinning and yielding haven't helped
+static int Spin(int *spins)
+{
+    if (*spins < QUEUE_SPINS)
+    {
+        (*spins)++;
+        return 1;
+    }
+    if (*spins < QUEUE_SPINS + QUEUE_YIELDS)
+    {
+        (*spins)++;
+        sched_yield();
+        return 1;
+    }
+    return 0;
+}
+
+int spsc_init(spsc_queue_t *q, unsigned int size)
+{
+    unsigned int slots = 2;
+
+    while (slots < size)
+    {
+        slots <<= 1;
+    }
+
+    q->slots = calloc(slots, sizeof(void *));
+    q->mask = slots - 1;
+    q->head = 0;
+    q->tail = 0;
+    if (q->slots == NULL)
+    {
+        return 0;
+    }
+
+    InitWaiter(&q->waiter);
+    return 1;
+}
+
+void spsc_free(spsc_queue_t *q)
+{
+    if (q->slots != NULL)
+    {
+        FreeWaiter(&q->waiter);
+    }
+    free(q->slots);
+    q->slots = NULL;
+}
+
+int spsc_push(spsc_queue_t *q, void *item)
+{
+    unsigned int head = q->head;
+    unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail > q->mask)
+    {
+        return 0;
+    }
+
+    q->slots[head & q->mask] = item;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    Wake(&q->waiter);
+    return 1;
+}
+
+void *spsc_pop(spsc_queue_t *q)
+{
+    unsigned int tail = q->tail;
+    unsigned int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    void *item;
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    item = q->slots[tail & q->mask];
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    Wake(&q->waiter);
+    return item;
+}
+
+// spin briefly, then yield, then sleep so an idle side doesn't burn a core
+void queue_backoff_max(int *spins, long max_us)
+{
+    struct timespec delay;
+    long            us = QUEUE_MIN_SLEEP_US;
+    int             doublings;
+
+    if (Spin(spins))
+    {
+        return;
+    }
+    for (doublings = *spins - QUEUE_SPINS - QUEUE_YIELDS; doublings > 0 && us < max_us;
+         doublings--)
+    {
+        us *= 2;
+    }
+    if (us < max_us)
+    {
+        (*spins)++;
+    }
+    else
+    {
+        us = max_us;
+    }
+    delay.tv_sec = us / 1000000;
+    delay.tv_nsec = us % 1000000 * 1000;
+    nanosleep(&delay, NULL);
+}
+
+void queue_backoff(int *spins)
+{
+    queue_backoff_max(spins, QUEUE_MIN_SLEEP_US);
+}
+
+void spsc_push_wait(spsc_queue_t *q, void *item)
+{
+    int spins = 0;
+
+    while (!spsc_push(q, item))
+    {
+        if (!Spin(&spins))
+        {
+            SleepBegin(&q->waiter);
+            SleepEnd(&q->waiter, q->head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) > q->mask);
+        }
+    }
+}
+
+void *spsc_pop_wait(spsc_queue_t *q)
+{
+    int spins = 0;
+    void *item;
+
+    while ((item = spsc_pop(q)) == NULL)
+    {
+        if (!Spin(&spins))
+        {
+            SleepBegin(&q->waiter);
+            SleepEnd(&q->waiter, __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->tail);
+        }
+    }
+
+    return item;
+}
+
+int ring_init(byte_ring_t *r, unsigned int size)
+{
+    unsigned int bytes = 2;
+
+    while (bytes < size)
+    {
+        bytes <<= 1;
+    }
+
+    r->data = malloc(bytes);
+    r->mask = bytes - 1;
+    r->head = 0;
+    r->tail = 0;
+    if (r->data == NULL)
+    {
+        return 0;
+    }
+
+    InitWaiter(&r->waiter);
+    return 1;
+}
+
+void ring_free(byte_ring_t *r)
+{
+    if (r->data != NULL)
+    {
+        FreeWaiter(&r->waiter);
+    }
+    free(r->data);
+    r->data = NULL;
+}
+
+unsigned int ring_space(byte_ring_t *r)
+{
+    return r->mask + 1 - (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+}
+
+void ring_copy_in(byte_ring_t *r, unsigned int offset, const void *data, unsigned int len)
+{
+    unsigned int start = (r->head + offset) & r->mask;
+    unsigned int first = r->mask + 1 - start;
+
+    if (first >= len)
+    {
+        memcpy(&r->data[start], data, len);
+    }
+    else
+    {
+        memcpy(&r->data[start], data, first);
+        memcpy(r->data, (const unsigned char *)data + first, len - first);
+    }
+}
+
+void ring_publish(byte_ring_t *r, unsigned int len)
+{
+    __atomic_store_n(&r->head, r->head + len, __ATOMIC_RELEASE);
+    Wake(&r->waiter);
+}
+
+unsigned int ring_used(byte_ring_t *r)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail;
+}
+
+void ring_copy_out(byte_ring_t *r, unsigned int offset, void *data, unsigned int len)
+{
+    unsigned int start = (r->tail + offset) & r->mask;
+    unsigned int first = r->mask + 1 - start;
+
+    if (first >= len)
+    {
+        memcpy(data, &r->data[start], len);
+    }
+    else
+    {
+        memcpy(data, &r->data[start], first);
+        memcpy((unsigned char *)data + first, r->data, len - first);
+    }
+}
+
+unsigned int ring_peek(byte_ring_t *r, unsigned int offset, unsigned char **data)
+{
+    unsigned int start = (r->tail + offset) & r->mask;
+
+    *data = &r->data[start];
+    return r->mask + 1 - start;
+}
+
+void ring_release(byte_ring_t *r, unsigned int len)
+{
+    __atomic_store_n(&r->tail, r->tail + len, __ATOMIC_RELEASE);
+}
+
+unsigned int ring_wait(byte_ring_t *r, const int *running)
+{
+    unsigned int used;
+    int spins = 0;
+
+    while ((used = ring_used(r)) == 0 && __atomic_load_n(running, __ATOMIC_ACQUIRE))
+    {
+        if (!Spin(&spins))
+        {
+            SleepBegin(&r->waiter);
+            SleepEnd(&r->waiter, ring_used(r) == 0 && __atomic_load_n(running, __ATOMIC_ACQUIRE));
+            return ring_used(r);
+        }
+    }
+
+    return used;
+}
+
+void ring_wake(byte_ring_t *r)
+{
+    Wake(&r->waiter);
+}
@@ -0,0 +1,83 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+/* Lock-free single producer/single consumer queue of pointers.
+   Exactly one thread may push and exactly one thread may pop. */
+
+#include <pthread.h>
+
+#define QUEUE_CACHE_LINE (64)
+
+/* Where a side that's run out of spinning sleeps until the other side
+   moves. The other side only takes the lock when someone's asleep. */
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    unsigned int    sleepers;
+} queue_waiter_t;
+
+typedef struct
+{
+    void          **slots;
+    unsigned int    mask;
+    unsigned char   pad0[QUEUE_CACHE_LINE];
+    unsigned int    head; /* next slot to write, owned by the producer */
+    unsigned char   pad1[QUEUE_CACHE_LINE];
+    unsigned int    tail; /* next slot to read, owned by the consumer */
+    unsigned char   pad2[QUEUE_CACHE_LINE];
+    queue_waiter_t  waiter;
+} spsc_queue_t;
+
+//size is rounded up to a power of two
+int spsc_init(spsc_queue_t *q, unsigned int size);
+void spsc_free(spsc_queue_t *q);
+//returns 0 if the queue is full
+int spsc_push(spsc_queue_t *q, void *item);
+//returns NULL if the queue is empty
+void *spsc_pop(spsc_queue_t *q);
+//blocking versions, these spin briefly and then sleep until the other side
+//pushes or pops
+void spsc_push_wait(spsc_queue_t *q, void *item);
+void *spsc_pop_wait(spsc_queue_t *q);
+
+/* Lock-free single producer/single consumer byte ring. Data is copied in
+   and only becomes visible to the consumer once published, so a producer
+   can write a multi-part record and publish it in one go. */
+typedef struct
+{
+    unsigned char  *data;
+    unsigned int    mask;
+    unsigned char   pad0[QUEUE_CACHE_LINE];
+    unsigned int    head; /* published bytes, owned by the producer */
+    unsigned char   pad1[QUEUE_CACHE_LINE];
+    unsigned int    tail; /* consumed bytes, owned by the consumer */
+    unsigned char   pad2[QUEUE_CACHE_LINE];
+    queue_waiter_t  waiter;
+} byte_ring_t;
+
+//size is rounded up to a power of two
+int ring_init(byte_ring_t *r, unsigned int size);
+void ring_free(byte_ring_t *r);
+//producer side
+unsigned int ring_space(byte_ring_t *r);
+void ring_copy_in(byte_ring_t *r, unsigned int offset, const void *data, unsigned int len);
+void ring_publish(byte_ring_t *r, unsigned int len);
+//consumer side
+unsigned int ring_used(byte_ring_t *r);
+void ring_copy_out(byte_ring_t *r, unsigned int offset, void *data, unsigned int len);
+//gets a pointer to the contiguous bytes at offset, returns how many there are
+unsigned int ring_peek(byte_ring_t *r, unsigned int offset, unsigned char **data);
+void ring_release(byte_ring_t *r, unsigned int len);
+//spins briefly and then sleeps until something's published or *running has
+//been cleared and ring_wake called. Returns ring_used, which may still be 0
+unsigned int ring_wait(byte_ring_t *r, const int *running);
+void ring_wake(byte_ring_t *r);
+
+//for waits that can't block on a queue: spins, yields, then sleeps, twice
+//as long each time up to max_us microseconds
+void queue_backoff_max(int *spins, long max_us);
+//the same with short sleeps, for loops that poll several things at once
+void queue_backoff(int *spins);
+
+#endif // QUEUE_H
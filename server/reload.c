@@ -0,0 +1,541 @@
+/*
+    reload.c: watch mode program reloading
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#endif
+
+#include "elf.h"
+#include "reload.h"
+
+// builds write the file in pieces, wait for it to settle before loading it
+#define SETTLE_US (100000ll)
+#define POLL_US (250000ll)
+// unchanged gaps shorter than this are sent rather than starting a new copy
+#define MERGE_GAP (32)
+#define RELOAD_PATH_SIZE (1024)
+
+/* The stub, r4 walks a table of (dest, src, len) ending with len 0. src 0
+   means fill with zeros:
+
+   00  mov.l   table,r4
+   02  mov.l   entry,r3
+   04  mov.l   ccr,r5
+   06 next:
+       mov.l   @r4+,r1
+   08  mov.l   @r4+,r2
+   0a  mov.l   @r4+,r6
+   0c  tst     r6,r6
+   0e  bt      done
+   10 loop:
+       mov     #0,r0
+   12  tst     r2,r2
+   14  bt      store
+   16  mov.b   @r2+,r0
+   18 store:
+       mov.b   r0,@r1
+   1a  add     #1,r1
+   1c  dt      r6
+   1e  bf      loop
+   20  bra     next
+   22  nop
+   24 done:
+       mov.b   @r5,r0      purge the cache, the code changed
+   26  or      #0x10,r0
+   28  mov.b   r0,@r5
+   2a  tst     r3,r3
+   2c  bt      return      entry 0 goes back to the hook
+   2e  jmp     @r3
+   30  nop
+   32 return:
+       rts
+   34  nop
+   38 table: .long
+   3c entry: .long
+   40 ccr: .long 0xfffffe92
+   44  entries */
+static const unsigned short stub_code[] =
+{
+    0xd40d, 0xd30e, 0xd50e, 0x6146, 0x6246, 0x6646, 0x2668, 0x8909,
+    0xe000, 0x2228, 0x8900, 0x6024, 0x2100, 0x7101, 0x4610, 0x8bf7,
+    0xaff1, 0x0009, 0x6050, 0xcb10, 0x2500, 0x2338, 0x8901, 0x432b,
+    0x0009, 0x000b, 0x0009, 0x0009
+};
+#define STUB_SIZE (0x44)
+#define STUB_CCR (0xfffffe92)
+#define ENTRY_SIZE (12)
+
+typedef struct
+{
+    unsigned char  *file;
+    size_t          size;
+    elf_image_t     elf;    // a flat binary is one read-only segment
+} image_t;
+
+typedef struct
+{
+    unsigned int            dest;
+    unsigned int            len;
+    const unsigned char    *src;   // NULL for zeros
+} patch_t;
+
+static pthread_mutex_t reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static char watch_path[RELOAD_PATH_SIZE];
+static unsigned int flat_address;
+static int watching = 0;
+// what the target has, the newest build, and the build last sent
+static image_t *current = NULL, *pending = NULL, *sent = NULL;
+
+static long long changed_at;
+static int changed = 0;
+static int too_big = 0;
+static long long last_poll = 0;
+static struct stat last_stat;
+#ifdef __linux__
+static int inotify_fd = -1;
+static const char *watch_name;
+#endif
+
+static long long Now(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (long long)now.tv_sec * 1000000ll + now.tv_usec;
+}
+
+static void PutDword(unsigned char *p, unsigned int value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static void FreeImage(image_t *image)
+{
+    if (image != NULL && image != current && image != pending && image != sent)
+    {
+        free(image->file);
+        free(image);
+    }
+}
+
+static image_t *LoadImage(void)
+{
+    image_t    *image = calloc(1, sizeof(image_t));
+    long        size;
+    FILE       *File;
+
+    File = fopen(watch_path, "rb");
+    if (image == NULL || File == NULL)
+    {
+        free(image);
+        if (File != NULL)
+        {
+            fclose(File);
+        }
+        return NULL;
+    }
+    fseek(File, 0, SEEK_END);
+    size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    image->file = size > 0 ? malloc(size) : NULL;
+    if (image->file == NULL || fread(image->file, 1, size, File) != (size_t)size)
+    {
+        fclose(File);
+        free(image->file);
+        free(image);
+        return NULL;
+    }
+    fclose(File);
+    image->size = size;
+
+    if (elf_is_elf(image->file, image->size))
+    {
+        if (!elf_parse(image->file, image->size, &image->elf))
+        {
+            free(image->file);
+            free(image);
+            return NULL;
+        }
+    }
+    else
+    {
+        image->elf.entry = flat_address;
+        image->elf.count = 1;
+        image->elf.segments[0].address = flat_address;
+        image->elf.segments[0].file_size = image->size;
+        image->elf.segments[0].mem_size = image->size;
+        image->elf.segments[0].data = image->file;
+    }
+    return image;
+}
+
+int reload_start(const char *pFilename, unsigned int address)
+{
+    snprintf(watch_path, sizeof(watch_path), "%s", pFilename);
+    flat_address = address;
+    current = LoadImage();
+    if (current == NULL)
+    {
+        printf("Can't watch the file '%s'\n", pFilename);
+        return 0;
+    }
+    stat(watch_path, &last_stat);
+
+#ifdef __linux__
+    // watch the directory, builds often replace the file rather than
+    // writing to it
+    {
+        char    directory[RELOAD_PATH_SIZE];
+        char   *slash;
+
+        strcpy(directory, watch_path);
+        slash = strrchr(directory, '/');
+        strcpy(slash ? slash + 1 : directory, slash ? "" : ".");
+        watch_name = strrchr(watch_path, '/') ? strrchr(watch_path, '/') + 1 : watch_path;
+        inotify_fd = inotify_init1(IN_NONBLOCK);
+        if (inotify_fd >= 0 &&
+            inotify_add_watch(inotify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+        {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+    }
+#endif
+
+    watching = 1;
+    changed = 0;
+    printf("Watching %s for changes\n", watch_path);
+    return 1;
+}
+
+void reload_stop(void)
+{
+    image_t *images[3];
+    int      ii, jj;
+
+#ifdef __linux__
+    if (inotify_fd >= 0)
+    {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+#endif
+    watching = 0;
+    images[0] = current;
+    images[1] = pending;
+    images[2] = sent;
+    current = pending = sent = NULL;
+    for (ii = 0; ii < 3; ii++)
+    {
+        for (jj = 0; jj < ii && images[jj] != images[ii]; jj++);
+        if (jj == ii)
+        {
+            FreeImage(images[ii]);
+        }
+    }
+}
+
+static int FileChanged(long long now)
+{
+    struct stat info;
+
+#ifdef __linux__
+    if (inotify_fd >= 0)
+    {
+        char                    events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        struct inotify_event   *event;
+        ssize_t                 len;
+        ssize_t                 pos;
+        int                     found = 0;
+
+        while ((len = read(inotify_fd, events, sizeof(events))) > 0)
+        {
+            for (pos = 0; pos < len; pos += sizeof(struct inotify_event) + event->len)
+            {
+                event = (struct inotify_event *)&events[pos];
+                if (event->len > 0 && !strcmp(event->name, watch_name))
+                {
+                    found = 1;
+                }
+            }
+        }
+        return found;
+    }
+#endif
+
+    if (now - last_poll < POLL_US)
+    {
+        return 0;
+    }
+    last_poll = now;
+    if (stat(watch_path, &info) != 0 ||
+        (info.st_mtime == last_stat.st_mtime && info.st_size == last_stat.st_size))
+    {
+        return 0;
+    }
+    last_stat = info;
+    return 1;
+}
+
+void reload_check(void)
+{
+    image_t    *image, *old;
+    long long   now;
+
+    if (!watching)
+    {
+        return;
+    }
+
+    now = Now();
+    if (FileChanged(now))
+    {
+        changed = 1;
+        changed_at = now;
+        return;
+    }
+    if (!changed || now - changed_at < SETTLE_US)
+    {
+        return;
+    }
+
+    changed = 0;
+    image = LoadImage();
+    if (image == NULL)
+    {
+        printf("Couldn't load the rebuilt %s, waiting for the next change\n", watch_path);
+        return;
+    }
+
+    pthread_mutex_lock(&reload_lock);
+    old = pending;
+    pending = image;
+    too_big = 0;
+    FreeImage(old);
+    pthread_mutex_unlock(&reload_lock);
+    printf("%s changed, waiting for the client to poll\n", watch_path);
+}
+
+static int AddPatch(patch_t **ppPatches, int *pCount, int *pCapacity, unsigned int dest,
+                    unsigned int len, const unsigned char *src)
+{
+    patch_t *grown;
+
+    if (*pCount == *pCapacity)
+    {
+        *pCapacity = *pCapacity ? *pCapacity * 2 : 64;
+        grown = realloc(*ppPatches, *pCapacity * sizeof(patch_t));
+        if (grown == NULL)
+        {
+            return 0;
+        }
+        *ppPatches = grown;
+    }
+    (*ppPatches)[*pCount].dest = dest;
+    (*ppPatches)[*pCount].len = len;
+    (*ppPatches)[*pCount].src = src;
+    (*pCount)++;
+    return 1;
+}
+
+// works out what has to change to turn base into image
+static patch_t *Diff(const image_t *base, const image_t *image, int hook, int *pCount)
+{
+    const elf_segment_t    *seg, *old;
+    patch_t                *patches = NULL;
+    unsigned char          *differs;
+    unsigned int            from, to, start, last, ii, jj, kk;
+    int                     capacity = 0, ok = 1;
+
+    *pCount = 0;
+    for (ii = 0; ii < (unsigned int)image->elf.count && ok; ii++)
+    {
+        seg = &image->elf.segments[ii];
+        differs = malloc(seg->file_size ? seg->file_size : 1);
+        if (differs == NULL)
+        {
+            ok = 0;
+            break;
+        }
+        memset(differs, 1, seg->file_size);
+
+        // only compare with what was sent before if the target still has it
+        for (jj = 0; (hook || !seg->writable) && jj < (unsigned int)base->elf.count; jj++)
+        {
+            old = &base->elf.segments[jj];
+            from = seg->address > old->address ? seg->address : old->address;
+            to = seg->address + seg->file_size < old->address + old->file_size ?
+                 seg->address + seg->file_size : old->address + old->file_size;
+            for (kk = from; kk < to; kk++)
+            {
+                differs[kk - seg->address] =
+                    seg->data[kk - seg->address] != old->data[kk - old->address];
+            }
+        }
+
+        for (kk = 0; kk < seg->file_size && ok; kk = last + 1)
+        {
+            if (!differs[kk])
+            {
+                last = kk;
+                continue;
+            }
+            start = last = kk;
+            for (jj = kk + 1; jj < seg->file_size && jj - last <= MERGE_GAP; jj++)
+            {
+                if (differs[jj])
+                {
+                    last = jj;
+                }
+            }
+            ok = AddPatch(&patches, pCount, &capacity, seg->address + start,
+                          last - start + 1, &seg->data[start]);
+        }
+        free(differs);
+
+        if (ok && !hook && seg->mem_size > seg->file_size)
+        {
+            ok = AddPatch(&patches, pCount, &capacity, seg->address + seg->file_size,
+                          seg->mem_size - seg->file_size, NULL);
+        }
+    }
+
+    if (!ok)
+    {
+        printf("Memory allocation error\n");
+        free(patches);
+        return NULL;
+    }
+    return patches;
+}
+
+unsigned char *reload_build(unsigned int staging, unsigned int size, int flags,
+                            unsigned int *pSize)
+{
+    patch_t        *patches;
+    image_t        *old;
+    unsigned char  *blob = NULL, *entry;
+    unsigned int    total, data, program = 0;
+    int             count = 0, ii;
+
+    pthread_mutex_lock(&reload_lock);
+    if (!watching || pending == NULL || current == NULL)
+    {
+        pthread_mutex_unlock(&reload_lock);
+        return NULL;
+    }
+
+    patches = Diff(current, pending, flags & RELOAD_HOOK, &count);
+    total = STUB_SIZE + (count + 1) * ENTRY_SIZE;
+    for (ii = 0; patches != NULL && ii < count; ii++)
+    {
+        total += patches[ii].src != NULL ? patches[ii].len : 0;
+    }
+    for (ii = 0; ii < pending->elf.count; ii++)
+    {
+        program += pending->elf.segments[ii].file_size;
+    }
+
+    if (patches != NULL && total > size)
+    {
+        // the client keeps polling, only say so once per build
+        if (!too_big)
+        {
+            printf("The changes (%u bytes) don't fit in the client's %u byte buffer\n",
+                   total, size);
+            too_big = 1;
+        }
+    }
+    else if (patches != NULL && (blob = malloc(total)) != NULL)
+    {
+        for (ii = 0; ii < (int)(sizeof(stub_code) / sizeof(stub_code[0])); ii++)
+        {
+            blob[ii * 2] = (unsigned char)(stub_code[ii] >> 8);
+            blob[ii * 2 + 1] = (unsigned char)stub_code[ii];
+        }
+        PutDword(&blob[0x38], staging + STUB_SIZE);
+        PutDword(&blob[0x3c], flags & RELOAD_HOOK ? 0 : pending->elf.entry);
+        PutDword(&blob[0x40], STUB_CCR);
+
+        entry = &blob[STUB_SIZE];
+        data = STUB_SIZE + (count + 1) * ENTRY_SIZE;
+        for (ii = 0; ii < count; ii++, entry += ENTRY_SIZE)
+        {
+            PutDword(&entry[0], patches[ii].dest);
+            PutDword(&entry[4], patches[ii].src != NULL ? staging + data : 0);
+            PutDword(&entry[8], patches[ii].len);
+            if (patches[ii].src != NULL)
+            {
+                memcpy(&blob[data], patches[ii].src, patches[ii].len);
+                data += patches[ii].len;
+            }
+        }
+        memset(entry, 0, ENTRY_SIZE);
+
+        old = sent;
+        sent = pending;
+        FreeImage(old);
+        *pSize = total;
+        printf("Reloading: %d changes, %u bytes sent for a %u byte program\n",
+               count, total, program);
+    }
+
+    free(patches);
+    pthread_mutex_unlock(&reload_lock);
+    return blob;
+}
+
+void reload_done(void)
+{
+    image_t *old;
+
+    pthread_mutex_lock(&reload_lock);
+    if (sent != NULL)
+    {
+        old = current;
+        current = sent;
+        if (pending == sent)
+        {
+            pending = NULL;
+        }
+        sent = NULL;
+        FreeImage(old);
+    }
+    pthread_mutex_unlock(&reload_lock);
+}
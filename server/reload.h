@@ -0,0 +1,30 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+/* Watch mode (-w). After -x the file server keeps an eye on the program
+   file, and when it's rebuilt works out which bytes differ from what the
+   target has. A client polling with Devcart_PollReload gets the changes as
+   one upload into a buffer of its own: a copy stub, its table, then the
+   changed bytes. The stub patches the program, purges the cache and
+   either jumps to the entry point or returns to the client's reload hook.
+
+   Restarting from the entry point resends writable segments in full and
+   clears BSS, since the running program has changed them. With a hook the
+   program carries on, so only bytes that differ from the last upload are
+   sent. */
+
+#define RELOAD_HOOK (1 << 0)    // request flag, return to the client's hook
+
+//address is where -x put a flat binary
+int reload_start(const char *pFilename, unsigned int address);
+void reload_stop(void);
+//main loop, notices the file changing
+void reload_check(void);
+//builds the changes for a client buffer at staging, or returns NULL if
+//there aren't any or they don't fit. safe to call from a worker
+unsigned char *reload_build(unsigned int staging, unsigned int size, int flags,
+                            unsigned int *pSize);
+//the client has the changes reload_build returned last
+void reload_done(void);
+
+#endif // RELOAD_H
@@ -0,0 +1,174 @@
+/*
+    satbundle.c: builds bundles for the file server
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "bundle.h"
+
+static int CompareNames(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// every file in the directory in name order, apart from other bundles
+static int ReadDirectory(const char *pDirectory, char ***pppNames, int *pCount)
+{
+    char            path[1024];
+    char          **grown;
+    struct dirent  *entry;
+    struct stat     info;
+    size_t          len;
+    int             capacity = 0;
+    DIR            *Dir;
+
+    *pppNames = NULL;
+    *pCount = 0;
+    Dir = opendir(pDirectory);
+    if (Dir == NULL)
+    {
+        printf("Can't open the directory '%s'\n", pDirectory);
+        return 0;
+    }
+
+    while ((entry = readdir(Dir)) != NULL)
+    {
+        snprintf(path, sizeof(path), "%s/%s", pDirectory, entry->d_name);
+        len = strlen(entry->d_name);
+        if (stat(path, &info) || !S_ISREG(info.st_mode) ||
+            (len >= strlen(BUNDLE_EXTENSION) &&
+             !strcmp(&entry->d_name[len - strlen(BUNDLE_EXTENSION)], BUNDLE_EXTENSION)) ||
+            (len >= strlen(BUNDLE_LIST_EXTENSION) &&
+             !strcmp(&entry->d_name[len - strlen(BUNDLE_LIST_EXTENSION)], BUNDLE_LIST_EXTENSION)))
+        {
+            continue;
+        }
+
+        if (*pCount == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            grown = realloc(*pppNames, capacity * sizeof(char *));
+            if (grown == NULL)
+            {
+                break;
+            }
+            *pppNames = grown;
+        }
+        (*pppNames)[*pCount] = strdup(entry->d_name);
+        if ((*pppNames)[*pCount] == NULL)
+        {
+            break;
+        }
+        (*pCount)++;
+    }
+    closedir(Dir);
+
+    if (entry != NULL)
+    {
+        printf("Memory allocation error\n");
+        bundle_free_names(*pppNames, *pCount);
+        return 0;
+    }
+
+    qsort(*pppNames, *pCount, sizeof(char *), CompareNames);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    char  **names;
+    int     count, ok, ii;
+    FILE   *File;
+
+    if (argc < 3 || (argc == 4 && (!strcmp(argv[3], "-l") || !strcmp(argv[3], "-t"))))
+    {
+        printf("Usage: %s <directory> <bundle> [-l <list> | -t <trace> | <file> ...]\n", argv[0]);
+        printf("Packs files from the served directory into one bundle, in the order given by\n");
+        printf("a list of names, a trace recorded with satbug -t, or the command line. With\n");
+        printf("none of these every file in the directory goes in, in name order\n");
+        return 1;
+    }
+
+    if (argc == 5 && !strcmp(argv[3], "-l"))
+    {
+        ok = bundle_read_list(argv[4], &names, &count);
+        if (!ok)
+        {
+            printf("Can't read the list '%s'\n", argv[4]);
+        }
+    }
+    else if (argc == 5 && !strcmp(argv[3], "-t"))
+    {
+        ok = bundle_read_trace(argv[4], &names, &count);
+    }
+    else if (argc > 3)
+    {
+        count = argc - 3;
+        names = malloc(count * sizeof(char *));
+        ok = names != NULL;
+        for (ii = 0; ok && ii < count; ii++)
+        {
+            names[ii] = strdup(argv[3 + ii]);
+        }
+    }
+    else
+    {
+        ok = ReadDirectory(argv[1], &names, &count);
+    }
+    if (!ok)
+    {
+        return 1;
+    }
+
+    File = fopen(argv[2], "wb");
+    if (File == NULL)
+    {
+        printf("Can't create the file '%s'\n", argv[2]);
+        bundle_free_names(names, count);
+        return 1;
+    }
+    ok = bundle_build(File, argv[1], names, count);
+    if (fclose(File))
+    {
+        ok = 0;
+    }
+    if (!ok)
+    {
+        printf("Error writing the bundle '%s'\n", argv[2]);
+        remove(argv[2]);
+    }
+    else
+    {
+        printf("%d files bundled into '%s'\n", count, argv[2]);
+    }
+
+    bundle_free_names(names, count);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,1113 @@
+/*
+    satgadget.c: virtual devcart on dummy_hcd for testing without hardware
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef __linux__
+#define _GNU_SOURCE     // pthread_timedjoin_np
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <linux/usb/functionfs.h>
+#include "ftdi.h"
+
+#include "crc.h"
+#include "devcart.h"
+
+/* An FT245 on the far side of the kernel's USB stack. The gadget is put
+   together in configfs from a FunctionFS function, so it can be bound to
+   dummy_hcd's UDC and show up to libusb as a local device. satbug then runs
+   unmodified, libftdi and all, against:
+
+   - the FT245R's VID/PID and bcdDevice, with one vendor interface and
+     bulk endpoints 0x81 and 0x02, the addresses libftdi expects
+   - the vendor control requests libftdi sends, including the latency timer
+   - two modem status bytes at the start of every IN packet, and status only
+     packets whenever the latency timer runs out with nothing to send
+
+   Behind that is the cart's boot firmware: uploads, downloads and execute,
+   on memory laid out like the Saturn's. Once a program has been started the
+   link can be passed through to a Unix socket, so a client like satload can
+   play the program and drive the file server. */
+
+#define CONFIGFS_DIR "/sys/kernel/config/usb_gadget/satbug"
+#define UDC_DIR "/sys/class/udc"
+#define FFS_NAME "satbug"
+#define DEFAULT_FFS_DIR "/dev/ffs-" FFS_NAME
+
+// what an FT245R with nothing wrong sends in front of every packet
+#define MODEM_STATUS (0x01)
+#define LINE_STATUS (0x60)
+#define DEFAULT_LATENCY_MS (16)
+
+#define FS_PACKET_SIZE (64)
+#define HS_PACKET_SIZE (512)
+// most packets queued on the IN endpoint in one go
+#define IN_PACKETS (64)
+#define OUT_BUF_SIZE (16*1024)
+#define FIFO_SIZE (256*1024)
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    unsigned char   data[FIFO_SIZE];
+    unsigned int    head, count;
+    int             closed;
+} fifo_t;
+
+typedef struct
+{
+    struct usb_interface_descriptor         intf;
+    struct usb_endpoint_descriptor_no_audio in, out;
+} __attribute__((packed)) ft245_descs_t;
+
+// the same regions satbug snapshots
+static const struct
+{
+    unsigned int    address;
+    unsigned int    size;
+} regions[] =
+{
+    {0x00200000, 0x100000},
+    {0x06000000, 0x100000},
+    {0x25A00000, 0x80000},
+    {0x25C00000, 0x80000},
+    {0x25E00000, 0x80000},
+    {0x25F00000, 0x1000},
+};
+#define NUM_REGIONS (sizeof(regions) / sizeof(regions[0]))
+static unsigned char *memory[NUM_REGIONS];
+
+static int ep0 = -1, ep_in = -1, ep_out = -1;
+static fifo_t in_fifo, out_fifo;    // to and from the host
+static int client = -1;
+static volatile int running, stopping;
+
+static pthread_mutex_t state_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t state_changed = PTHREAD_COND_INITIALIZER;
+static int enabled;
+static unsigned int enables;
+static int latency_ms = DEFAULT_LATENCY_MS;
+
+static void FifoInit(fifo_t *pFifo)
+{
+    pthread_mutex_init(&pFifo->lock, NULL);
+    pthread_cond_init(&pFifo->changed, NULL);
+    pFifo->head = pFifo->count = 0;
+    pFifo->closed = 0;
+}
+
+static void FifoClose(fifo_t *pFifo)
+{
+    pthread_mutex_lock(&pFifo->lock);
+    pFifo->closed = 1;
+    pthread_cond_broadcast(&pFifo->changed);
+    pthread_mutex_unlock(&pFifo->lock);
+}
+
+static void FifoClear(fifo_t *pFifo)
+{
+    pthread_mutex_lock(&pFifo->lock);
+    pFifo->head = pFifo->count = 0;
+    pthread_cond_broadcast(&pFifo->changed);
+    pthread_mutex_unlock(&pFifo->lock);
+}
+
+// blocks while the FIFO is full, 0 once it's closed
+static int FifoPut(fifo_t *pFifo, const unsigned char *pData, unsigned int len)
+{
+    unsigned int chunk, tail;
+
+    pthread_mutex_lock(&pFifo->lock);
+    while (len > 0 && !pFifo->closed)
+    {
+        if (pFifo->count == FIFO_SIZE)
+        {
+            pthread_cond_wait(&pFifo->changed, &pFifo->lock);
+            continue;
+        }
+        tail = (pFifo->head + pFifo->count) % FIFO_SIZE;
+        chunk = FIFO_SIZE - pFifo->count;
+        if (chunk > FIFO_SIZE - tail)
+        {
+            chunk = FIFO_SIZE - tail;
+        }
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(&pFifo->data[tail], pData, chunk);
+        pFifo->count += chunk;
+        pData += chunk;
+        len -= chunk;
+        pthread_cond_broadcast(&pFifo->changed);
+    }
+    pthread_mutex_unlock(&pFifo->lock);
+    return !pFifo->closed;
+}
+
+/* Waits until at least min bytes are in the FIFO, or for timeout_ms (-1 for
+   as long as it takes), then takes up to max. Returns the number taken. */
+static unsigned int FifoGet(fifo_t *pFifo, unsigned char *pData, unsigned int max,
+                            unsigned int min, int timeout_ms)
+{
+    struct timespec deadline;
+    unsigned int    taken = 0, chunk;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000l;
+    if (deadline.tv_nsec >= 1000000000l)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000l;
+    }
+
+    pthread_mutex_lock(&pFifo->lock);
+    while (pFifo->count < min && !pFifo->closed)
+    {
+        if (timeout_ms < 0)
+        {
+            pthread_cond_wait(&pFifo->changed, &pFifo->lock);
+        }
+        else if (pthread_cond_timedwait(&pFifo->changed, &pFifo->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    while (taken < max && pFifo->count > 0)
+    {
+        chunk = FIFO_SIZE - pFifo->head;
+        if (chunk > pFifo->count)
+        {
+            chunk = pFifo->count;
+        }
+        if (chunk > max - taken)
+        {
+            chunk = max - taken;
+        }
+        memcpy(&pData[taken], &pFifo->data[pFifo->head], chunk);
+        pFifo->head = (pFifo->head + chunk) % FIFO_SIZE;
+        pFifo->count -= chunk;
+        taken += chunk;
+    }
+    if (taken > 0)
+    {
+        pthread_cond_broadcast(&pFifo->changed);
+    }
+    pthread_mutex_unlock(&pFifo->lock);
+    return taken;
+}
+
+// exactly len bytes from the host, 0 once the FIFO is closed
+static int Receive(unsigned char *pData, unsigned int len)
+{
+    unsigned int got;
+
+    while (len > 0)
+    {
+        got = FifoGet(&out_fifo, pData, len, 1, -1);
+        if (got == 0)
+        {
+            return 0;
+        }
+        pData += got;
+        len -= got;
+    }
+    return 1;
+}
+
+static unsigned int GetDword(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// where size bytes at address live in the emulated memory, or NULL
+static unsigned char *Locate(unsigned int address, unsigned int size)
+{
+    unsigned int ii;
+
+    for (ii = 0; ii < NUM_REGIONS; ii++)
+    {
+        if (address >= regions[ii].address &&
+            address - regions[ii].address < regions[ii].size &&
+            size <= regions[ii].size - (address - regions[ii].address))
+        {
+            return &memory[ii][address - regions[ii].address];
+        }
+    }
+    return NULL;
+}
+
+// [FUNC_DOWNLOAD address size]: the memory, then its checksum
+static int Download(void)
+{
+    static const unsigned char zeros[4096];
+    unsigned char   header[8], checksum;
+    unsigned char  *source;
+    unsigned int    address, size, sent, chunk;
+    crc_t           crc = crc_init();
+
+    if (!Receive(header, sizeof(header)))
+    {
+        return 0;
+    }
+    address = GetDword(&header[0]);
+    size = GetDword(&header[4]);
+    source = Locate(address, size);
+    if (source == NULL)
+    {
+        printf("Download from unmapped memory %08x-%08x, sending zeros\n", address, address + size);
+    }
+
+    for (sent = 0; sent < size; sent += chunk)
+    {
+        chunk = size - sent < sizeof(zeros) ? size - sent : sizeof(zeros);
+        crc = crc_update(crc, source ? &source[sent] : zeros, chunk);
+        if (!FifoPut(&in_fifo, source ? &source[sent] : zeros, chunk))
+        {
+            return 0;
+        }
+    }
+    checksum = crc_finalize(crc);
+    return FifoPut(&in_fifo, &checksum, 1);
+}
+
+// [FUNC_UPLOAD address size], the data and its checksum: 0 back if it's good
+static int Upload(void)
+{
+    unsigned char   header[8], buf[4096], checksum, result;
+    unsigned char  *dest;
+    unsigned int    address, size, received, chunk;
+    crc_t           crc = crc_init();
+
+    if (!Receive(header, sizeof(header)))
+    {
+        return 0;
+    }
+    address = GetDword(&header[0]);
+    size = GetDword(&header[4]);
+    dest = Locate(address, size);
+    if (dest == NULL)
+    {
+        printf("Upload to unmapped memory %08x-%08x\n", address, address + size);
+    }
+
+    for (received = 0; received < size; received += chunk)
+    {
+        chunk = size - received < sizeof(buf) ? size - received : sizeof(buf);
+        if (!Receive(buf, chunk))
+        {
+            return 0;
+        }
+        crc = crc_update(crc, buf, chunk);
+        if (dest != NULL)
+        {
+            memcpy(&dest[received], buf, chunk);
+        }
+    }
+    if (!Receive(&checksum, 1))
+    {
+        return 0;
+    }
+    result = dest != NULL && checksum == crc_finalize(crc) ? 0 : 1;
+    return FifoPut(&in_fifo, &result, 1);
+}
+
+// everything from the host goes to the client, or nowhere without one
+static void PassThrough(void)
+{
+    unsigned char   buf[OUT_BUF_SIZE];
+    unsigned int    got, sent;
+    ssize_t         written;
+    int             connected = client >= 0;
+
+    while ((got = FifoGet(&out_fifo, buf, sizeof(buf), 1, -1)) > 0)
+    {
+        for (sent = 0; connected && sent < got; sent += written)
+        {
+            written = send(client, &buf[sent], got - sent, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR)
+            {
+                written = 0;
+            }
+            else if (written < 0)
+            {
+                printf("The client has gone away\n");
+                connected = 0;
+            }
+        }
+    }
+}
+
+static void *FirmwareThread(void *pArg)
+{
+    unsigned char   cmd, entry[4];
+    int             ok = 1;
+
+    (void)pArg;
+    while (ok && !running)
+    {
+        ok = Receive(&cmd, 1);
+        if (!ok)
+        {
+            break;
+        }
+        switch (cmd)
+        {
+        case FUNC_DOWNLOAD:
+            ok = Download();
+            break;
+
+        case FUNC_UPLOAD:
+            ok = Upload();
+            break;
+
+        case FUNC_EXEC:
+            ok = Receive(entry, sizeof(entry));
+            if (ok)
+            {
+                printf("Executing %08x\n", GetDword(entry));
+                pthread_mutex_lock(&state_lock);
+                running = 1;
+                pthread_cond_broadcast(&state_changed);
+                pthread_mutex_unlock(&state_lock);
+            }
+            break;
+
+        default:
+            printf("Unknown command %d\n", cmd);
+            break;
+        }
+    }
+
+    if (ok)
+    {
+        PassThrough();
+    }
+    return NULL;
+}
+
+// everything from the client goes to the host, once a program is running
+static void *ClientThread(void *pArg)
+{
+    unsigned char   buf[OUT_BUF_SIZE];
+    ssize_t         got;
+
+    (void)pArg;
+    pthread_mutex_lock(&state_lock);
+    while (!running && !stopping)
+    {
+        pthread_cond_wait(&state_changed, &state_lock);
+    }
+    pthread_mutex_unlock(&state_lock);
+
+    while (!stopping)
+    {
+        got = read(client, buf, sizeof(buf));
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            printf("The client has gone away\n");
+            break;
+        }
+        if (!FifoPut(&in_fifo, buf, got))
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// the IN endpoint's wMaxPacketSize at the speed it was enabled at
+static unsigned int WaitEnabled(unsigned int *pEnables)
+{
+    struct usb_endpoint_descriptor desc;
+
+    pthread_mutex_lock(&state_lock);
+    while (!enabled && !stopping)
+    {
+        pthread_cond_wait(&state_changed, &state_lock);
+    }
+    *pEnables = enables;
+    pthread_mutex_unlock(&state_lock);
+
+    if (ioctl(ep_in, FUNCTIONFS_ENDPOINT_DESC, &desc) < 0)
+    {
+        return FS_PACKET_SIZE;
+    }
+    return le16toh(desc.wMaxPacketSize) & 0x7ff;
+}
+
+/* The FT245 sends a packet once it has a full one, or when the latency
+   timer runs out, even if there's only the status to send. */
+static void *InThread(void *pArg)
+{
+    static unsigned char    packets[IN_PACKETS * HS_PACKET_SIZE];
+    unsigned char           data[IN_PACKETS * HS_PACKET_SIZE];
+    unsigned int            packet_size = FS_PACKET_SIZE, payload, got, pos, ii, seen = 0;
+    ssize_t                 written;
+
+    (void)pArg;
+    while (!stopping)
+    {
+        if (!enabled || seen != enables)
+        {
+            packet_size = WaitEnabled(&seen);
+            if (packet_size < 8 || packet_size > HS_PACKET_SIZE)
+            {
+                packet_size = FS_PACKET_SIZE;
+            }
+            continue;
+        }
+
+        payload = packet_size - 2;
+        got = FifoGet(&in_fifo, data, IN_PACKETS * payload, payload, latency_ms);
+        pos = 0;
+        ii = 0;
+        do
+        {
+            packets[pos++] = MODEM_STATUS;
+            packets[pos++] = LINE_STATUS;
+            memcpy(&packets[pos], &data[ii], got - ii < payload ? got - ii : payload);
+            pos += got - ii < payload ? got - ii : payload;
+            ii += got - ii < payload ? got - ii : payload;
+        } while (ii < got);
+
+        do
+        {
+            written = write(ep_in, packets, pos);
+        } while (written < 0 && errno == EINTR && !stopping);
+        if (written < 0 && !stopping)
+        {
+            // the host went away mid transfer, a real chip loses it too
+            usleep(1000);
+        }
+    }
+    return NULL;
+}
+
+static void *OutThread(void *pArg)
+{
+    unsigned char   buf[OUT_BUF_SIZE];
+    ssize_t         got;
+
+    (void)pArg;
+    while (!stopping)
+    {
+        got = read(ep_out, buf, sizeof(buf));
+        if (got > 0)
+        {
+            FifoPut(&out_fifo, buf, got);
+        }
+        else if (got < 0 && errno != EINTR)
+        {
+            usleep(1000);
+        }
+    }
+    return NULL;
+}
+
+// answers a control request, or stalls it by going the wrong way
+static void Answer(const struct usb_ctrlrequest *pSetup, unsigned char *pData,
+                   unsigned int len, int stall)
+{
+    ssize_t done;
+
+    if (((pSetup->bRequestType & USB_DIR_IN) != 0) != stall)
+    {
+        done = write(ep0, pData, len);
+    }
+    else
+    {
+        done = read(ep0, pData, len);
+    }
+    if (done < 0 && !stall)
+    {
+        printf("Control request %02x failed: %s\n", pSetup->bRequest, strerror(errno));
+    }
+}
+
+static void HandleSetup(const struct usb_ctrlrequest *pSetup)
+{
+    unsigned char   reply[64];
+    unsigned int    length = le16toh(pSetup->wLength), value = le16toh(pSetup->wValue);
+
+    if ((pSetup->bRequestType & USB_TYPE_MASK) != USB_TYPE_VENDOR)
+    {
+        Answer(pSetup, reply, 0, 1);
+        return;
+    }
+
+    if (pSetup->bRequestType & USB_DIR_IN)
+    {
+        // anything else, like the pins or a blank EEPROM, reads as zeros
+        memset(reply, 0, sizeof(reply));
+        switch (pSetup->bRequest)
+        {
+        case SIO_POLL_MODEM_STATUS_REQUEST:
+            reply[0] = MODEM_STATUS;
+            reply[1] = LINE_STATUS;
+            break;
+
+        case SIO_GET_LATENCY_TIMER_REQUEST:
+            reply[0] = (unsigned char)latency_ms;
+            break;
+        }
+        Answer(pSetup, reply, length < sizeof(reply) ? length : sizeof(reply), 0);
+        return;
+    }
+
+    switch (pSetup->bRequest)
+    {
+    case SIO_RESET_REQUEST:
+        if (value == SIO_RESET_SIO || value == SIO_RESET_PURGE_RX)
+        {
+            FifoClear(&in_fifo);
+        }
+        if (value == SIO_RESET_SIO || value == SIO_RESET_PURGE_TX)
+        {
+            FifoClear(&out_fifo);
+        }
+        break;
+
+    case SIO_SET_LATENCY_TIMER_REQUEST:
+        latency_ms = (value & 0xff) ? (value & 0xff) : 1;
+        break;
+    }
+    Answer(pSetup, reply, length < sizeof(reply) ? length : sizeof(reply), 0);
+}
+
+static void *Ep0Thread(void *pArg)
+{
+    struct usb_functionfs_event events[4];
+    ssize_t                     got;
+    int                         ii;
+
+    (void)pArg;
+    while (!stopping)
+    {
+        got = read(ep0, events, sizeof(events));
+        if (got < 0)
+        {
+            if (errno != EINTR)
+            {
+                usleep(1000);
+            }
+            continue;
+        }
+
+        for (ii = 0; ii < got / (ssize_t)sizeof(events[0]); ii++)
+        {
+            switch (events[ii].type)
+            {
+            case FUNCTIONFS_ENABLE:
+                pthread_mutex_lock(&state_lock);
+                enabled = 1;
+                enables++;
+                pthread_cond_broadcast(&state_changed);
+                pthread_mutex_unlock(&state_lock);
+                printf("Host connected\n");
+                // libftdi doesn't look the endpoints up, it assumes these
+                if (ioctl(ep_in, FUNCTIONFS_ENDPOINT_REVMAP) != 0x81 ||
+                    ioctl(ep_out, FUNCTIONFS_ENDPOINT_REVMAP) != 0x02)
+                {
+                    printf("The UDC didn't give the endpoints addresses 0x81 and 0x02, libftdi won't find them\n");
+                }
+                break;
+
+            case FUNCTIONFS_DISABLE:
+            case FUNCTIONFS_UNBIND:
+                pthread_mutex_lock(&state_lock);
+                if (enabled)
+                {
+                    printf("Host disconnected\n");
+                }
+                enabled = 0;
+                pthread_mutex_unlock(&state_lock);
+                break;
+
+            case FUNCTIONFS_SETUP:
+                HandleSetup(&events[ii].u.setup);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void FillInterface(ft245_descs_t *pDescs, unsigned int packet_size)
+{
+    pDescs->intf.bLength = USB_DT_INTERFACE_SIZE;
+    pDescs->intf.bDescriptorType = USB_DT_INTERFACE;
+    pDescs->intf.bNumEndpoints = 2;
+    pDescs->intf.bInterfaceClass = USB_CLASS_VENDOR_SPEC;
+    pDescs->intf.bInterfaceSubClass = 0xff;
+    pDescs->intf.bInterfaceProtocol = 0xff;
+    pDescs->intf.iInterface = 1;
+
+    pDescs->in.bLength = USB_DT_ENDPOINT_SIZE;
+    pDescs->in.bDescriptorType = USB_DT_ENDPOINT;
+    pDescs->in.bEndpointAddress = 1 | USB_DIR_IN;
+    pDescs->in.bmAttributes = USB_ENDPOINT_XFER_BULK;
+    pDescs->in.wMaxPacketSize = htole16(packet_size);
+
+    pDescs->out = pDescs->in;
+    pDescs->out.bEndpointAddress = 2 | USB_DIR_OUT;
+}
+
+// the FunctionFS descriptors and strings, then the endpoints they create
+static int OpenEndpoints(const char *pFfsDir)
+{
+    struct
+    {
+        struct usb_functionfs_descs_head_v2 header;
+        __le32                              fs_count;
+        __le32                              hs_count;
+        ft245_descs_t                       fs, hs;
+    } __attribute__((packed)) descriptors;
+    struct
+    {
+        struct usb_functionfs_strings_head  header;
+        __le16                              language;
+        char                                interface[sizeof("FT245R USB FIFO")];
+    } __attribute__((packed)) strings;
+    char    path[1024];
+
+    memset(&descriptors, 0, sizeof(descriptors));
+    descriptors.header.magic = htole32(FUNCTIONFS_DESCRIPTORS_MAGIC_V2);
+    descriptors.header.length = htole32(sizeof(descriptors));
+    // the vendor requests go to the device, not the interface
+    descriptors.header.flags = htole32(FUNCTIONFS_HAS_FS_DESC | FUNCTIONFS_HAS_HS_DESC |
+                                       FUNCTIONFS_ALL_CTRL_RECIP);
+    descriptors.fs_count = htole32(3);
+    descriptors.hs_count = htole32(3);
+    FillInterface(&descriptors.fs, FS_PACKET_SIZE);
+    FillInterface(&descriptors.hs, HS_PACKET_SIZE);
+
+    strings.header.magic = htole32(FUNCTIONFS_STRINGS_MAGIC);
+    strings.header.length = htole32(sizeof(strings));
+    strings.header.str_count = htole32(1);
+    strings.header.lang_count = htole32(1);
+    strings.language = htole16(0x0409);
+    strcpy(strings.interface, "FT245R USB FIFO");
+
+    snprintf(path, sizeof(path), "%s/ep0", pFfsDir);
+    ep0 = open(path, O_RDWR);
+    if (ep0 < 0)
+    {
+        printf("Can't open '%s': %s\n", path, strerror(errno));
+        return 0;
+    }
+    if (write(ep0, &descriptors, sizeof(descriptors)) < 0 ||
+        write(ep0, &strings, sizeof(strings)) < 0)
+    {
+        printf("FunctionFS didn't take the descriptors: %s\n", strerror(errno));
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), "%s/ep1", pFfsDir);
+    ep_in = open(path, O_RDWR);
+    snprintf(path, sizeof(path), "%s/ep2", pFfsDir);
+    ep_out = open(path, O_RDWR);
+    if (ep_in < 0 || ep_out < 0)
+    {
+        printf("Can't open the endpoints in '%s': %s\n", pFfsDir, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static int WriteAttribute(const char *pPath, const char *pValue)
+{
+    int fd = open(pPath, O_WRONLY);
+    int ok = fd >= 0 && write(fd, pValue, strlen(pValue)) == (ssize_t)strlen(pValue);
+
+    if (!ok)
+    {
+        printf("Can't write '%s' to '%s': %s\n", pValue, pPath, strerror(errno));
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return ok;
+}
+
+static int MakeDir(const char *pPath)
+{
+    if (mkdir(pPath, 0755) && errno != EEXIST)
+    {
+        printf("Can't create '%s': %s\n", pPath, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static void RemoveGadget(const char *pFfsDir)
+{
+    umount(pFfsDir);
+    rmdir(pFfsDir);
+    unlink(CONFIGFS_DIR "/configs/c.1/ffs." FFS_NAME);
+    rmdir(CONFIGFS_DIR "/configs/c.1/strings/0x409");
+    rmdir(CONFIGFS_DIR "/configs/c.1");
+    rmdir(CONFIGFS_DIR "/functions/ffs." FFS_NAME);
+    rmdir(CONFIGFS_DIR "/strings/0x409");
+    rmdir(CONFIGFS_DIR);
+}
+
+// a configfs gadget with one FunctionFS function, mounted on pFfsDir
+static int CreateGadget(const char *pFfsDir, int VID, int PID)
+{
+    char id[16];
+    int  ok;
+
+    if (mkdir(CONFIGFS_DIR, 0755) && errno != EEXIST)
+    {
+        printf("Can't create the gadget: %s\n", strerror(errno));
+        printf("Is configfs mounted, and are libcomposite and dummy_hcd loaded?\n");
+        return 0;
+    }
+
+    ok = MakeDir(CONFIGFS_DIR "/strings/0x409") &&
+         MakeDir(CONFIGFS_DIR "/configs/c.1") &&
+         MakeDir(CONFIGFS_DIR "/configs/c.1/strings/0x409") &&
+         MakeDir(CONFIGFS_DIR "/functions/ffs." FFS_NAME);
+    snprintf(id, sizeof(id), "0x%04x", VID);
+    ok = ok && WriteAttribute(CONFIGFS_DIR "/idVendor", id);
+    snprintf(id, sizeof(id), "0x%04x", PID);
+    ok = ok && WriteAttribute(CONFIGFS_DIR "/idProduct", id) &&
+         // libftdi goes by this to tell it's an FT245R/FT232R
+         WriteAttribute(CONFIGFS_DIR "/bcdDevice", "0x0600") &&
+         WriteAttribute(CONFIGFS_DIR "/bcdUSB", "0x0200") &&
+         WriteAttribute(CONFIGFS_DIR "/strings/0x409/manufacturer", "FTDI") &&
+         WriteAttribute(CONFIGFS_DIR "/strings/0x409/product", "FT245R USB FIFO") &&
+         WriteAttribute(CONFIGFS_DIR "/strings/0x409/serialnumber", "SATBUG00") &&
+         WriteAttribute(CONFIGFS_DIR "/configs/c.1/MaxPower", "90") &&
+         WriteAttribute(CONFIGFS_DIR "/configs/c.1/strings/0x409/configuration", "FT245");
+    if (ok && symlink(CONFIGFS_DIR "/functions/ffs." FFS_NAME, CONFIGFS_DIR "/configs/c.1/ffs." FFS_NAME) &&
+        errno != EEXIST)
+    {
+        printf("Can't add the function to the configuration: %s\n", strerror(errno));
+        ok = 0;
+    }
+    // the real chip is full speed only, older kernels don't have the option
+    if (ok && access(CONFIGFS_DIR "/max_speed", W_OK) == 0)
+    {
+        WriteAttribute(CONFIGFS_DIR "/max_speed", "full-speed");
+    }
+
+    ok = ok && MakeDir(pFfsDir);
+    if (ok && mount(FFS_NAME, pFfsDir, "functionfs", 0, NULL))
+    {
+        printf("Can't mount FunctionFS on '%s': %s\n", pFfsDir, strerror(errno));
+        ok = 0;
+    }
+
+    if (!ok)
+    {
+        RemoveGadget(pFfsDir);
+    }
+    return ok;
+}
+
+// the named UDC, or the first dummy_hcd one
+static int BindGadget(const char *pUdc)
+{
+    char            name[256] = "";
+    struct dirent  *entry;
+    DIR            *Dir;
+
+    if (pUdc != NULL)
+    {
+        snprintf(name, sizeof(name), "%s", pUdc);
+    }
+    else if ((Dir = opendir(UDC_DIR)) != NULL)
+    {
+        while ((entry = readdir(Dir)) != NULL)
+        {
+            if (entry->d_name[0] != '.' && (name[0] == '\0' || !strncmp(entry->d_name, "dummy_udc", 9)))
+            {
+                snprintf(name, sizeof(name), "%s", entry->d_name);
+            }
+        }
+        closedir(Dir);
+    }
+    if (name[0] == '\0')
+    {
+        printf("No UDC to bind to, is dummy_hcd loaded?\n");
+        return 0;
+    }
+
+    printf("Binding to %s\n", name);
+    return WriteAttribute(CONFIGFS_DIR "/UDC", name);
+}
+
+static int AcceptClient(const char *pPath)
+{
+    struct sockaddr_un  address;
+    int                 listener;
+
+    if (strlen(pPath) >= sizeof(address.sun_path))
+    {
+        printf("Socket path '%s' is too long\n", pPath);
+        return 0;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, pPath);
+    unlink(pPath);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listener, 1) < 0)
+    {
+        printf("Can't listen on '%s': %s\n", pPath, strerror(errno));
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        return 0;
+    }
+
+    printf("Waiting for a client on %s\n", pPath);
+    client = accept(listener, NULL, NULL);
+    close(listener);
+    unlink(pPath);
+    if (client < 0)
+    {
+        printf("Error accepting a client: %s\n", strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+static void Interrupted(int sig)
+{
+    (void)sig;
+}
+
+// interrupts a thread until it has noticed stopping and finished
+static void StopThread(pthread_t thread)
+{
+    struct timespec deadline;
+
+    do
+    {
+        pthread_kill(thread, SIGUSR1);
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100000000l;
+        if (deadline.tv_nsec >= 1000000000l)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000l;
+        }
+    } while (pthread_timedjoin_np(thread, NULL, &deadline) == ETIMEDOUT);
+}
+
+int main(int argc, char **argv)
+{
+    const char         *ffs_dir = DEFAULT_FFS_DIR, *udc = NULL, *socket_path = NULL;
+    char               *pVID, *pPID;
+    int                 VID = 0x0403, PID = 0x6001;
+    int                 created = 0, error = 0, ok, sig, ii;
+    unsigned int        rr;
+    pthread_t           threads[5];
+    int                 num_threads = 0;
+    struct sigaction    action;
+    sigset_t            signals;
+
+    if ((pVID = getenv("VID")))
+        sscanf(pVID, "%x", &VID);
+    if ((pPID = getenv("PID")))
+        sscanf(pPID, "%x", &PID);
+
+    for (ii = 1; ii < argc && !error; ii++)
+    {
+        if (!strcmp(argv[ii], "-m") && ii + 1 < argc)
+        {
+            ffs_dir = argv[++ii];
+            created = -1;
+        }
+        else if (!strcmp(argv[ii], "-u") && ii + 1 < argc)
+        {
+            udc = argv[++ii];
+        }
+        else if (!strcmp(argv[ii], "-z") && ii + 1 < argc)
+        {
+            socket_path = argv[++ii];
+        }
+        else if (!strcmp(argv[ii], "-r"))
+        {
+            running = 1;
+        }
+        else
+        {
+            error = 1;
+        }
+    }
+    if (error || (running && !socket_path) || (created < 0 && udc))
+    {
+        printf("Usage: %s [-m <directory> | -u <udc>] [-z <socket> [-r]]\n", argv[0]);
+        printf("Presents a virtual FT245 devcart through configfs and dummy_hcd, so satbug\n");
+        printf("can be run against it with no hardware. Needs root, configfs and the\n");
+        printf("libcomposite, usb_f_fs and dummy_hcd modules. The VID and PID variables\n");
+        printf("work as they do for satbug\n");
+        printf("    -m  <directory>               Use a FunctionFS instance that's already\n");
+        printf("                                  mounted and set up rather than making one\n");
+        printf("    -u  <udc>                     Bind to this UDC (the first dummy_udc)\n");
+        printf("    -z  <socket>                  Once a program is executed, pass the link\n");
+        printf("                                  through to a client on a Unix socket, like\n");
+        printf("                                  satload\n");
+        printf("    -r                            Pass it through straight away, for\n");
+        printf("                                  satbug -s without -x\n");
+        return 1;
+    }
+
+    for (rr = 0; rr < NUM_REGIONS; rr++)
+    {
+        memory[rr] = calloc(1, regions[rr].size);
+        if (memory[rr] == NULL)
+        {
+            printf("Memory allocation error\n");
+            return 1;
+        }
+    }
+    if (socket_path && !AcceptClient(socket_path))
+    {
+        return 1;
+    }
+
+    // SIGINT and SIGTERM are waited for below, SIGUSR1 breaks threads out
+    // of blocking reads
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = Interrupted;
+    sigaction(SIGUSR1, &action, NULL);
+
+    FifoInit(&in_fifo);
+    FifoInit(&out_fifo);
+    if (created == 0)
+    {
+        created = CreateGadget(ffs_dir, VID, PID);
+        if (!created)
+        {
+            return 1;
+        }
+    }
+    ok = OpenEndpoints(ffs_dir);
+    if (ok)
+    {
+        ok = pthread_create(&threads[num_threads++], NULL, Ep0Thread, NULL) == 0 &&
+             pthread_create(&threads[num_threads++], NULL, InThread, NULL) == 0 &&
+             pthread_create(&threads[num_threads++], NULL, OutThread, NULL) == 0 &&
+             pthread_create(&threads[num_threads++], NULL, FirmwareThread, NULL) == 0 &&
+             (client < 0 || pthread_create(&threads[num_threads++], NULL, ClientThread, NULL) == 0);
+        if (!ok)
+        {
+            printf("Can't start the gadget's threads\n");
+            num_threads--;
+        }
+    }
+    if (ok && created > 0)
+    {
+        ok = BindGadget(udc);
+    }
+
+    if (ok)
+    {
+        printf("Emulating %04x:%04x, press Ctrl+C to stop\n", VID, PID);
+        sigwait(&signals, &sig);
+    }
+
+    stopping = 1;
+    pthread_mutex_lock(&state_lock);
+    pthread_cond_broadcast(&state_changed);
+    pthread_mutex_unlock(&state_lock);
+    FifoClose(&in_fifo);
+    FifoClose(&out_fifo);
+    if (created > 0)
+    {
+        WriteAttribute(CONFIGFS_DIR "/UDC", "\n");
+    }
+    if (client >= 0)
+    {
+        shutdown(client, SHUT_RDWR);
+    }
+    for (ii = 0; ii < num_threads; ii++)
+    {
+        StopThread(threads[ii]);
+    }
+
+    if (ep_out >= 0)
+        close(ep_out);
+    if (ep_in >= 0)
+        close(ep_in);
+    if (ep0 >= 0)
+        close(ep0);
+    if (client >= 0)
+        close(client);
+    if (created > 0)
+    {
+        RemoveGadget(ffs_dir);
+    }
+    return ok ? 0 : 1;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+    printf("%s needs Linux's FunctionFS and dummy_hcd\n", argv[0]);
+    return 1;
+}
+
+#endif // __linux__
@@ -0,0 +1,735 @@
+/*
+    satload.c: load generator for the file server
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef __linux__
+#define _GNU_SOURCE     // struct ucred
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "crc.h"
+#include "devcart.h"
+#include "histogram.h"
+#include "link.h"
+
+/* Load generator for the file server. It stands in for the Saturn on the
+   socket of satbug -z and keeps up to a pipeline's worth of downloads
+   outstanding, with console prints and directory changes mixed in. Every
+   file that comes back is checked against what was written, byte for byte
+   as well as by checksum, and the request rate, latency percentiles and the
+   server's memory use are reported as it goes. */
+
+#define LOAD_DIR "satload"
+// the server blocks once its preparation queue is full
+#define MAX_DEPTH (16)
+#define CONNECT_TIMEOUT_MS (5000)
+// outstanding downloads get this long to finish after the run
+#define DRAIN_TIMEOUT_MS (5000)
+#define RX_BUF_SIZE (64*1024)
+
+typedef struct
+{
+    char            name[24];
+    unsigned char  *data;
+    unsigned int    size;
+} load_file_t;
+
+typedef struct
+{
+    int         file;
+    long long   sent;
+} pending_t;
+
+typedef struct
+{
+    unsigned long long  requests;
+    unsigned long long  bytes;
+    histogram_t         latency;    // microseconds
+} tally_t;
+
+static int sock = -1;
+static unsigned char tx_seq, rx_seq;
+static unsigned char rx_buf[RX_BUF_SIZE];
+static unsigned int rx_len;
+
+static load_file_t *files;
+static int num_files;
+
+static pending_t pending[MAX_DEPTH];
+static int pending_head, pending_count;
+
+// the download at the head of the pipeline
+static int started;
+static unsigned int expected, received;
+static crc_t crc;
+static int bad;
+
+static tally_t interval, overall;
+static unsigned long long prints, chgdirs, failures;
+
+static long long Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ll + now.tv_nsec;
+}
+
+// in milliseconds
+static double Quantile(const histogram_t *histogram, double quantile)
+{
+    return histogram_quantile(histogram, quantile) / 1000.0;
+}
+
+// resident size in kilobytes, 0 if it can't be found out
+static unsigned long ReadRss(int pid)
+{
+    unsigned long   rss = 0;
+#ifdef __linux__
+    char            path[64], line[256];
+    FILE           *File;
+
+    if (pid > 0)
+    {
+        snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    }
+    else
+    {
+        strcpy(path, "/proc/self/status");
+    }
+    File = fopen(path, "r");
+    if (File == NULL)
+    {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), File))
+    {
+        if (sscanf(line, "VmRSS: %lu", &rss) == 1)
+        {
+            break;
+        }
+    }
+    fclose(File);
+#else
+    (void)pid;
+#endif
+    return rss;
+}
+
+static int ServerPid(void)
+{
+#ifdef __linux__
+    struct ucred    cred;
+    socklen_t       len = sizeof(cred);
+
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+    {
+        return cred.pid;
+    }
+#endif
+    return 0;
+}
+
+static unsigned int Random(unsigned int *pState)
+{
+    unsigned int x = *pState;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *pState = x;
+}
+
+// random data, with a run in every other file so fills get used too
+static int CreateFiles(const char *pDirectory, unsigned int min_size, unsigned int max_size)
+{
+    char            path[1024];
+    unsigned int    state, run, ii;
+    int             ff;
+    FILE           *File;
+
+    snprintf(path, sizeof(path), "%s/%s", pDirectory, LOAD_DIR);
+    if (mkdir(path, 0755) && errno != EEXIST)
+    {
+        printf("Can't create the directory '%s': %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    files = calloc(num_files, sizeof(load_file_t));
+    if (files == NULL)
+    {
+        printf("Memory allocation error\n");
+        return 0;
+    }
+    for (ff = 0; ff < num_files; ff++)
+    {
+        state = 0x9e3779b9u * (ff + 1);
+        snprintf(files[ff].name, sizeof(files[ff].name), "load%03d.bin", ff);
+        files[ff].size = min_size + (max_size > min_size ? Random(&state) % (max_size - min_size + 1) : 0);
+        files[ff].data = malloc(files[ff].size ? files[ff].size : 1);
+        if (files[ff].data == NULL)
+        {
+            printf("Memory allocation error\n");
+            return 0;
+        }
+        for (ii = 0; ii < files[ff].size; ii++)
+        {
+            files[ff].data[ii] = (unsigned char)(Random(&state) >> 24);
+        }
+        if (ff & 1)
+        {
+            run = files[ff].size / 2;
+            memset(&files[ff].data[files[ff].size / 4], (ff & 2) ? 0xff : 0x00, run);
+        }
+
+        snprintf(path, sizeof(path), "%s/%s/%s", pDirectory, LOAD_DIR, files[ff].name);
+        File = fopen(path, "wb");
+        if (File == NULL ||
+            fwrite(files[ff].data, 1, files[ff].size, File) != files[ff].size ||
+            fclose(File))
+        {
+            printf("Can't write the file '%s'\n", path);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int Connect(const char *pPath)
+{
+    struct sockaddr_un  address;
+    long long           give_up = Now() + CONNECT_TIMEOUT_MS * 1000000ll;
+
+    if (strlen(pPath) >= sizeof(address.sun_path))
+    {
+        printf("Socket path '%s' is too long\n", pPath);
+        return 0;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, pPath);
+
+    // satbug may still be starting up
+    for (;;)
+    {
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0)
+        {
+            break;
+        }
+        if (connect(sock, (struct sockaddr *)&address, sizeof(address)) == 0)
+        {
+#ifdef SO_NOSIGPIPE
+            int on = 1;
+
+            setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+            return 1;
+        }
+        close(sock);
+        sock = -1;
+        if (Now() > give_up)
+        {
+            break;
+        }
+        usleep(50000);
+    }
+    printf("Can't connect to '%s': %s\n", pPath, strerror(errno));
+    return 0;
+}
+
+static int SendFrame(int channel, const unsigned char *pData, unsigned int len)
+{
+    unsigned char   frame[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD];
+    unsigned int    sent = 0;
+    ssize_t         written;
+
+    frame[0] = FRAME_SYNC;
+    frame[1] = channel;
+    frame[2] = tx_seq++;
+    frame[3] = (unsigned char)(len >> 8);
+    frame[4] = (unsigned char)len;
+    frame[5] = crc_finalize(crc_update(crc_init(), frame, 5));
+    memcpy(&frame[FRAME_HEADER_SIZE], pData, len);
+    len += FRAME_HEADER_SIZE;
+
+    while (sent < len)
+    {
+#ifdef MSG_NOSIGNAL
+        written = send(sock, &frame[sent], len - sent, MSG_NOSIGNAL);
+#else
+        written = send(sock, &frame[sent], len - sent, 0);
+#endif
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            printf("The server has gone away\n");
+            return 0;
+        }
+        sent += written;
+    }
+    return 1;
+}
+
+static int SendString(int function, const char *pString)
+{
+    unsigned char msg[32];
+
+    msg[0] = function;
+    strcpy((char *)&msg[1], pString);
+    return SendFrame(CHAN_CONTROL, msg, strlen(pString) + 2);
+}
+
+static int SendDownload(int file, long long sent)
+{
+    unsigned char msg[32];
+    unsigned int  len;
+
+    msg[0] = FUNC_DOWNLOAD;
+    strcpy((char *)&msg[1], files[file].name);
+    len = strlen(files[file].name) + 2;
+    msg[len++] = DOWNLOAD_FILLS;
+
+    pending[(pending_head + pending_count) % MAX_DEPTH].file = file;
+    pending[(pending_head + pending_count) % MAX_DEPTH].sent = sent;
+    pending_count++;
+    return SendFrame(CHAN_CONTROL, msg, len);
+}
+
+static int SendPrint(void)
+{
+    char text[64];
+
+    snprintf(text, sizeof(text), "satload print %llu\n", ++prints);
+    return SendFrame(CHAN_CONSOLE, (unsigned char *)text, strlen(text));
+}
+
+static unsigned int GetDword(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// compares the next part of the file coming in, pData NULL for a fill
+static void Feed(const unsigned char *pData, unsigned int len, unsigned char value)
+{
+    const load_file_t  *file = &files[pending[pending_head].file];
+    unsigned char       run[256];
+    unsigned int        ii, chunk;
+
+    if (!started || received + len > expected || received + len > file->size)
+    {
+        bad = 1;
+        return;
+    }
+    if (pData != NULL)
+    {
+        bad |= memcmp(&file->data[received], pData, len) != 0;
+        crc = crc_update(crc, pData, len);
+    }
+    else
+    {
+        memset(run, value, sizeof(run));
+        for (ii = 0; ii < len; ii++)
+        {
+            bad |= file->data[received + ii] != value;
+        }
+        for (ii = 0; ii < len; ii += chunk)
+        {
+            chunk = len - ii < sizeof(run) ? len - ii : sizeof(run);
+            crc = crc_update(crc, run, chunk);
+        }
+    }
+    received += len;
+}
+
+static void Finish(int ok)
+{
+    long long latency = (Now() - pending[pending_head].sent) / 1000;
+
+    if (ok)
+    {
+        interval.requests++;
+        interval.bytes += expected;
+        histogram_record(&interval.latency, latency);
+    }
+    else
+    {
+        printf("Bad download of %s\n", files[pending[pending_head].file].name);
+        failures++;
+    }
+    pending_head = (pending_head + 1) % MAX_DEPTH;
+    pending_count--;
+    started = 0;
+}
+
+static int HandleControl(const unsigned char *pData, unsigned int len)
+{
+    unsigned char   ack[2];
+    int             ok;
+
+    if (len == 0)
+    {
+        return 1;
+    }
+    if (pData[0] == FUNC_RESYNC)
+    {
+        printf("The server started a resync\n");
+        return 0;
+    }
+    if (pending_count == 0)
+    {
+        printf("Unexpected control message %d\n", pData[0]);
+        return 0;
+    }
+
+    switch (pData[0])
+    {
+    case FUNC_UPLOAD:
+        if (len < 9 || started)
+        {
+            break;
+        }
+        expected = GetDword(&pData[5]);
+        if (expected == 0xffffffff)
+        {
+            printf("The server couldn't find %s\n", files[pending[pending_head].file].name);
+            Finish(0);
+            return 1;
+        }
+        started = 1;
+        received = 0;
+        crc = crc_init();
+        bad = expected != files[pending[pending_head].file].size;
+        return 1;
+
+    case FUNC_FILL:
+        if (len < 10 || GetDword(&pData[1]) != received)
+        {
+            bad = 1;
+            return 1;
+        }
+        Feed(NULL, GetDword(&pData[5]), pData[9]);
+        return 1;
+
+    case FUNC_CHECKSUM:
+        if (len < 2 || !started)
+        {
+            break;
+        }
+        ok = !bad && received == expected && crc_finalize(crc) == pData[1];
+        ack[0] = FUNC_ACK;
+        ack[1] = ok ? 0 : 1;
+        Finish(ok);
+        return SendFrame(CHAN_CONTROL, ack, sizeof(ack));
+    }
+    printf("Unexpected control message %d\n", pData[0]);
+    return 0;
+}
+
+// handles every whole frame received, 0 on a protocol error
+static int HandleFrames(void)
+{
+    unsigned int    pos = 0, len;
+    unsigned char  *frame;
+    int             ok = 1;
+
+    while (ok && rx_len - pos >= FRAME_HEADER_SIZE)
+    {
+        frame = &rx_buf[pos];
+        len = (frame[3] << 8) | frame[4];
+        if (frame[0] != FRAME_SYNC || frame[1] >= CHAN_COUNT || len > FRAME_MAX_PAYLOAD ||
+            crc_finalize(crc_update(crc_init(), frame, 5)) != frame[5])
+        {
+            printf("Bad frame header\n");
+            return 0;
+        }
+        if (rx_len - pos < FRAME_HEADER_SIZE + len)
+        {
+            break;
+        }
+        // nothing gets lost on a socket, so a gap is a server bug
+        if (frame[2] != rx_seq++)
+        {
+            printf("Frame %d missing\n", (unsigned char)(rx_seq - 1));
+            return 0;
+        }
+
+        if (frame[1] == CHAN_CONTROL)
+        {
+            ok = HandleControl(&frame[FRAME_HEADER_SIZE], len);
+        }
+        else if (frame[1] == CHAN_BULK)
+        {
+            Feed(&frame[FRAME_HEADER_SIZE], len, 0);
+        }
+        pos += FRAME_HEADER_SIZE + len;
+    }
+    memmove(rx_buf, &rx_buf[pos], rx_len - pos);
+    rx_len -= pos;
+    return ok;
+}
+
+// adds the interval to the totals and starts a new one
+static void Merge(void)
+{
+    overall.requests += interval.requests;
+    overall.bytes += interval.bytes;
+    histogram_merge(&overall.latency, &interval.latency);
+    memset(&interval, 0, sizeof(interval));
+}
+
+static void Report(double seconds, double elapsed, int server_pid)
+{
+    unsigned long server_rss = ReadRss(server_pid), own_rss = ReadRss(0);
+
+    printf("%7.1fs %8.1f req/s %8.2f MB/s  p50 %.3f p90 %.3f p99 %.3f max %.3f ms",
+           elapsed, interval.requests / seconds, interval.bytes / seconds / (1024.0 * 1024.0),
+           Quantile(&interval.latency, 0.5), Quantile(&interval.latency, 0.9),
+           Quantile(&interval.latency, 0.99), interval.latency.max / 1000.0);
+    if (server_rss)
+    {
+        printf("  rss %lu KB (self %lu KB)", server_rss, own_rss);
+    }
+    printf("\n");
+
+    Merge();
+}
+
+static int ParseArg(const char *pArg, unsigned int *pValue)
+{
+    char *end;
+
+    *pValue = strtoul(pArg, &end, 0);
+    return end != pArg && *end == '\0';
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int    min_size = 1024, max_size = 256*1024, rate = 0, depth = 4;
+    unsigned int    print_rate = 0, chgdir_every = 0, duration = 10, report_every = 1;
+    unsigned int    files_arg = 32, sent = 0;
+    unsigned long   start_rss = 0, warm_rss = 0, end_rss = 0;
+    long long       start, now, stop, next_send, next_print, next_report, last_report;
+    int             server_pid, error = 0, ok = 1, timeout, ii;
+    unsigned int    rand_state = 1;
+    struct pollfd   fd;
+    ssize_t         got;
+    char           *dash;
+
+    for (ii = 3; ii < argc && !error; ii += 2)
+    {
+        if (ii + 1 >= argc || argv[ii][0] != '-' || strlen(argv[ii]) != 2)
+        {
+            error = 1;
+            break;
+        }
+        switch (argv[ii][1])
+        {
+        case 'n':
+            error = !ParseArg(argv[ii + 1], &files_arg) || files_arg == 0 || files_arg > 1000;
+            break;
+        case 's':
+            dash = strchr(argv[ii + 1], '-');
+            if (dash != NULL)
+            {
+                *dash = '\0';
+                error = !ParseArg(argv[ii + 1], &min_size) || !ParseArg(dash + 1, &max_size);
+            }
+            else
+            {
+                error = !ParseArg(argv[ii + 1], &min_size);
+                max_size = min_size;
+            }
+            error |= min_size > max_size;
+            break;
+        case 'r':
+            error = !ParseArg(argv[ii + 1], &rate);
+            break;
+        case 'c':
+            error = !ParseArg(argv[ii + 1], &depth) || depth == 0 || depth > MAX_DEPTH;
+            break;
+        case 'p':
+            error = !ParseArg(argv[ii + 1], &print_rate);
+            break;
+        case 'd':
+            error = !ParseArg(argv[ii + 1], &chgdir_every);
+            break;
+        case 't':
+            error = !ParseArg(argv[ii + 1], &duration);
+            break;
+        case 'i':
+            error = !ParseArg(argv[ii + 1], &report_every) || report_every == 0;
+            break;
+        default:
+            error = 1;
+            break;
+        }
+    }
+
+    if (argc < 3 || error)
+    {
+        printf("Usage: %s <socket> <directory> [options]\n", argv[0]);
+        printf("Stands in for the Saturn on the socket of satbug -z <socket> -s <directory>\n");
+        printf("and downloads test files from it as fast as it can, or at a set rate. Every\n");
+        printf("file is checked, and the request rate, latency percentiles and the server's\n");
+        printf("memory use are reported as it goes. The test files are written to\n");
+        printf("<directory>/%s first\n", LOAD_DIR);
+        printf("    -n  <files>                   Number of test files (32)\n");
+        printf("    -s  <min>[-<max>]             File sizes in bytes (1024-262144)\n");
+        printf("    -r  <requests/s>              Download rate, 0 for flat out (0)\n");
+        printf("    -c  <downloads>               Downloads outstanding at once, up to %d (4)\n", MAX_DEPTH);
+        printf("    -p  <prints/s>                Console prints to send as well (0)\n");
+        printf("    -d  <downloads>               Change directory every so many downloads (0)\n");
+        printf("    -t  <seconds>                 How long to run for (10)\n");
+        printf("    -i  <seconds>                 Time between reports (1)\n");
+        return 1;
+    }
+
+    num_files = files_arg;
+    if (!CreateFiles(argv[2], min_size, max_size) || !Connect(argv[1]))
+    {
+        return 1;
+    }
+    server_pid = ServerPid();
+    start_rss = ReadRss(server_pid);
+    if (!SendString(FUNC_CHGDIR, LOAD_DIR))
+    {
+        return 1;
+    }
+
+    start = last_report = next_send = next_print = Now();
+    stop = start + duration * 1000000000ll;
+    next_report = start + report_every * 1000000000ll;
+    while (ok)
+    {
+        now = Now();
+        if (now < stop)
+        {
+            while (ok && pending_count < (int)depth && (rate == 0 || now >= next_send))
+            {
+                if (chgdir_every && sent && sent % chgdir_every == 0)
+                {
+                    ok = SendString(FUNC_CHGDIR, "..") && SendString(FUNC_CHGDIR, LOAD_DIR);
+                    chgdirs++;
+                }
+                // timed from when it should have gone, so a slow server
+                // can't hide its backlog by holding up the requests
+                ok = ok && SendDownload(Random(&rand_state) % num_files, rate ? next_send : now);
+                next_send += rate ? 1000000000ll / rate : 0;
+                sent++;
+            }
+            while (ok && print_rate && now >= next_print)
+            {
+                ok = SendPrint();
+                next_print += 1000000000ll / print_rate;
+            }
+        }
+        else if (pending_count == 0)
+        {
+            break;
+        }
+        else if (now > stop + DRAIN_TIMEOUT_MS * 1000000ll)
+        {
+            printf("%d downloads never finished\n", pending_count);
+            failures += pending_count;
+            break;
+        }
+
+        if (now >= next_report)
+        {
+            Report((now - last_report) / 1e9, (now - start) / 1e9, server_pid);
+            if (!warm_rss)
+            {
+                warm_rss = ReadRss(server_pid);
+            }
+            last_report = now;
+            next_report += report_every * 1000000000ll;
+        }
+
+        // wake up for whatever's due next
+        timeout = (int)((next_report - now) / 1000000) + 1;
+        if (now < stop && rate && pending_count < (int)depth && (next_send - now) / 1000000 < timeout)
+        {
+            timeout = (int)((next_send - now) / 1000000);
+        }
+        if (now < stop && print_rate && (next_print - now) / 1000000 < timeout)
+        {
+            timeout = (int)((next_print - now) / 1000000);
+        }
+        fd.fd = sock;
+        fd.events = POLLIN;
+        if (ok && poll(&fd, 1, timeout < 0 ? 0 : timeout) > 0)
+        {
+            got = read(sock, &rx_buf[rx_len], sizeof(rx_buf) - rx_len);
+            if (got <= 0 && !(got < 0 && errno == EINTR))
+            {
+                printf("The server has gone away\n");
+                ok = 0;
+            }
+            else if (got > 0)
+            {
+                rx_len += got;
+                ok = HandleFrames();
+            }
+        }
+    }
+
+    now = Now();
+    Merge();
+    end_rss = ReadRss(server_pid);
+
+    printf("%llu downloads (%.1f MB) in %.1fs, %.1f req/s, %llu failed\n",
+           overall.requests, overall.bytes / (1024.0 * 1024.0), (now - start) / 1e9,
+           overall.requests / ((now - start) / 1e9), failures);
+    printf("Latency p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f ms\n",
+           Quantile(&overall.latency, 0.5), Quantile(&overall.latency, 0.9),
+           Quantile(&overall.latency, 0.99), Quantile(&overall.latency, 0.999),
+           overall.latency.max / 1000.0);
+    printf("%llu prints, %llu directory changes\n", prints, chgdirs);
+    if (end_rss)
+    {
+        // the first interval fills the server's buffer pools, so growth
+        // after that is what points at a leak
+        printf("Server RSS %lu KB at the start, %lu KB after warm up, %lu KB at the end (%+ld KB)\n",
+               start_rss, warm_rss, end_rss, (long)end_rss - (long)(warm_rss ? warm_rss : start_rss));
+    }
+
+    close(sock);
+    return ok && failures == 0 ? 0 : 1;
+}
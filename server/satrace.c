@@ -0,0 +1,270 @@
+/*
+    satrace.c: file server trace report
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define DEFAULT_TOP (10)
+#define TIMELINE_WIDTH (60)
+
+enum
+{
+    PHASE_QUEUE = 0,    // request arrived until a worker had the file open
+    PHASE_READ,         // worker reading the file
+    PHASE_SEND,         // upload header queued until the last frame went out
+    PHASE_ACK,          // waiting for the client's checksum result
+    PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = {"queue", "read", "send", "ack"};
+static const char *result_names[] = {"ok", "missing", "failed", "aborted"};
+
+static long long Span(long long start, long long end)
+{
+    return start == TRACE_NEVER || end == TRACE_NEVER || end < start ? 0 : end - start;
+}
+
+static void Phases(const trace_entry_t *entry, long long *phases)
+{
+    phases[PHASE_QUEUE] = Span(entry->requested, entry->read_start);
+    phases[PHASE_READ] = Span(entry->read_start, entry->read_end);
+    phases[PHASE_SEND] = Span(entry->send_start, entry->send_end);
+    phases[PHASE_ACK] = Span(entry->send_end, entry->acked);
+}
+
+static long long Finished(const trace_entry_t *entry)
+{
+    long long times[] = {entry->acked, entry->send_end, entry->send_start,
+                         entry->read_end, entry->read_start};
+    unsigned int ii;
+
+    for (ii = 0; ii < sizeof(times) / sizeof(times[0]); ii++)
+    {
+        if (times[ii] != TRACE_NEVER)
+        {
+            return times[ii];
+        }
+    }
+    return entry->requested;
+}
+
+static int CompareTotal(const void *a, const void *b)
+{
+    const trace_entry_t *ea = a, *eb = b;
+    long long ta = Finished(ea) - ea->requested, tb = Finished(eb) - eb->requested;
+
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static const char *Result(int result)
+{
+    return result >= 0 && result <= TRACE_ABORTED ? result_names[result] : "?";
+}
+
+static void PrintSummary(const trace_entry_t *entries, int count, long long started)
+{
+    unsigned long long  bytes = 0;
+    long long           phases[PHASE_COUNT], totals[PHASE_COUNT] = {0}, end = 0;
+    int                 results[TRACE_ABORTED + 1] = {0};
+    time_t              seconds = started / 1000000;
+    int                 ii, jj;
+
+    for (ii = 0; ii < count; ii++)
+    {
+        Phases(&entries[ii], phases);
+        for (jj = 0; jj < PHASE_COUNT; jj++)
+        {
+            totals[jj] += phases[jj];
+        }
+        if (entries[ii].result >= 0 && entries[ii].result <= TRACE_ABORTED)
+        {
+            results[entries[ii].result]++;
+        }
+        if (entries[ii].result == TRACE_OK)
+        {
+            bytes += entries[ii].size;
+        }
+        if (Finished(&entries[ii]) > end)
+        {
+            end = Finished(&entries[ii]);
+        }
+    }
+
+    printf("Trace started %s", ctime(&seconds));
+    printf("%d requests over %.3f s: %d ok, %d missing, %d failed, %d aborted\n",
+           count, end / 1000000.0, results[TRACE_OK], results[TRACE_MISSING],
+           results[TRACE_FAILED], results[TRACE_ABORTED]);
+    printf("%llu bytes delivered\n\n", bytes);
+
+    // the same bytes go through every phase, so this shows which one limits the rate
+    printf("Phase      total ms   ms/request   KB/s\n");
+    for (jj = 0; jj < PHASE_COUNT; jj++)
+    {
+        printf("%-8s %10.1f %12.2f", phase_names[jj], totals[jj] / 1000.0,
+               count ? totals[jj] / 1000.0 / count : 0.0);
+        if (totals[jj] > 0)
+        {
+            printf(" %9.1f", (bytes / 1024.0) / (totals[jj] / 1000000.0));
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+static void PrintSlowest(trace_entry_t *entries, int count, int top)
+{
+    long long   phases[PHASE_COUNT];
+    int         ii;
+
+    qsort(entries, count, sizeof(trace_entry_t), CompareTotal);
+    printf("Slowest requests (ms)\n");
+    printf("   total    queue     read     send      ack       size  result   name\n");
+    for (ii = 0; ii < count && ii < top; ii++)
+    {
+        Phases(&entries[ii], phases);
+        printf("%8.1f %8.1f %8.1f %8.1f %8.1f %10u  %-8s %s\n",
+               (Finished(&entries[ii]) - entries[ii].requested) / 1000.0,
+               phases[PHASE_QUEUE] / 1000.0, phases[PHASE_READ] / 1000.0,
+               phases[PHASE_SEND] / 1000.0, phases[PHASE_ACK] / 1000.0,
+               entries[ii].size, Result(entries[ii].result), entries[ii].name);
+    }
+    printf("\n");
+}
+
+static void Mark(char *line, long long start, long long end, long long scale, char mark)
+{
+    long long ii;
+
+    if (start == TRACE_NEVER || end == TRACE_NEVER)
+    {
+        return;
+    }
+    for (ii = start / scale; ii <= end / scale && ii < TIMELINE_WIDTH; ii++)
+    {
+        line[ii] = mark;
+    }
+}
+
+// entries must be in request order
+static void PrintTimeline(const trace_entry_t *entries, int count)
+{
+    char        line[TIMELINE_WIDTH + 1];
+    long long   end = 1, scale;
+    int         ii;
+
+    for (ii = 0; ii < count; ii++)
+    {
+        if (Finished(&entries[ii]) > end)
+        {
+            end = Finished(&entries[ii]);
+        }
+    }
+    scale = end / TIMELINE_WIDTH + 1;
+
+    printf("Timeline, %.1f ms per column (q queued, r read, s send, a ack)\n", scale / 1000.0);
+    for (ii = 0; ii < count; ii++)
+    {
+        memset(line, ' ', TIMELINE_WIDTH);
+        line[TIMELINE_WIDTH] = '\0';
+        Mark(line, entries[ii].requested, entries[ii].read_start, scale, 'q');
+        Mark(line, entries[ii].read_start, entries[ii].read_end, scale, 'r');
+        Mark(line, entries[ii].send_start, entries[ii].send_end, scale, 's');
+        Mark(line, entries[ii].send_end, entries[ii].acked, scale, 'a');
+        printf("|%s| %s\n", line, entries[ii].name);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    trace_entry_t  *entries = NULL, *sorted, *grown;
+    int             count = 0, capacity = 0, top = DEFAULT_TOP;
+    long long       started;
+    FILE           *File;
+
+    if (argc < 2 || (argc > 2 && (argc != 4 || strcmp(argv[2], "-n"))))
+    {
+        printf("Usage: %s <trace> [-n <count>]\n", argv[0]);
+        printf("Reports on a file server trace recorded with satbug -t\n");
+        return 1;
+    }
+    if (argc == 4)
+    {
+        top = atoi(argv[3]);
+    }
+
+    File = fopen(argv[1], "rb");
+    if (File == NULL)
+    {
+        printf("Can't open the file '%s'\n", argv[1]);
+        return 1;
+    }
+    started = trace_read_header(File);
+    if (started == 0)
+    {
+        printf("'%s' isn't a trace\n", argv[1]);
+        fclose(File);
+        return 1;
+    }
+
+    for (;;)
+    {
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            grown = realloc(entries, capacity * sizeof(trace_entry_t));
+            if (grown == NULL)
+            {
+                printf("Memory allocation error\n");
+                break;
+            }
+            entries = grown;
+        }
+        if (!trace_read(File, &entries[count]))
+        {
+            break;
+        }
+        count++;
+    }
+    fclose(File);
+
+    PrintSummary(entries, count, started);
+    sorted = malloc((count ? count : 1) * sizeof(trace_entry_t));
+    if (sorted != NULL)
+    {
+        memcpy(sorted, entries, count * sizeof(trace_entry_t));
+        PrintSlowest(sorted, count, top);
+        free(sorted);
+    }
+    PrintTimeline(entries, count);
+
+    free(entries);
+    return 0;
+}
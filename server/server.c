@@ -30,117 +30,1384 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/uio.h>
 #include "ftdi.h"
 
+#include "bufpool.h"
+#include "bundle.h"
+#include "cdimage.h"
+#include "console.h"
+#include "convert.h"
 #include "crc.h"
 #include "devcart.h"
-
-#define CMD_BUF_SIZE (512)
-static unsigned char cmd_buf[CMD_BUF_SIZE];
-static char filename_buf[FILENAME_MAX];
+#include "link.h"
+#include "metrics.h"
+#include "queue.h"
+#include "reload.h"
+#include "server.h"
+#include "timeline.h"
+#include "trace.h"
 
 #define PATH_BUF_SIZE (512)
-static char path_buf[PATH_BUF_SIZE];
 
 #define SUBDIR_BUF_SIZE (9)
-static char subdir_buf[SUBDIR_BUF_SIZE];
+
+/* Files are read by a pool of preparation workers while the main thread
+   does nothing but USB I/O. Each worker is connected to the USB thread by
+   a pair of SPSC queues: requests go in, chunks of the staged response
+   come back out. Requests are handed out round-robin, so responses are
+   taken from the workers in the same order to preserve request order.
+   Chunks are fed to the link's bulk channel as it drains. */
+#define PREP_QUEUE_SIZE (16)
+// a chunk is a buffer of link frames, which just fits the buffer pool's
+// 64K granule
+#define PREP_CHUNK_FRAMES (63)
+#define PREP_CHUNK_SIZE (PREP_CHUNK_FRAMES * FRAME_MAX_PAYLOAD)
+// sent chunk buffers kept for reuse, per worker
+#define PREP_SPARE_BUFFERS (32)
+// runs of one byte value at least this long are sent as a FUNC_FILL
+// instead of data, for clients that take them. each one costs a wait for
+// the data before it to go out, so short runs aren't worth it
+#define FILL_MIN_RUN (1024)
+
+// the client checksums the whole file before answering, give it time
+#define ACK_TIMEOUT_US (5000000ll)
+
+enum
+{
+    CHUNK_HEADER = 0, // size = file size
+    CHUNK_DATA,       // size bytes at data
+    CHUNK_FILL,       // size bytes of value
+    CHUNK_END,        // checksum is valid
+    CHUNK_ERROR       // file couldn't be opened or read, checksum is
+                      // valid for the data sent so far
+};
+
+typedef struct
+{
+    int             quit;
+    char            path[PATH_BUF_SIZE];
+    const char     *name;       // the part of path the client asked for
+    long long       requested;  // trace time the request arrived
+    long long       arrived;    // metrics_now() when it arrived
+    int             sectors;    // a read from the CD image rather than a file
+    int             reload;     // watch mode changes rather than a file
+    int             fills;      // the client takes FUNC_FILL
+    int             missing;    // answered with DEVCART_NO_FILE, no questions asked
+    unsigned int    fad;
+    unsigned int    count;
+    unsigned int    staging;    // where the client will put reload changes
+    unsigned int    staging_size;
+    int             reload_flags;
+} prep_request_t;
+
+/* Stands in for a request there was no memory for, so the client still
+   gets an answer, in turn. It's never written to or freed. */
+static prep_request_t missing_request = { .path = "", .name = "", .missing = 1 };
+
+typedef struct prep_buffer prep_buffer_t;
+typedef struct server server_t;
+
+typedef struct
+{
+    int             type;
+    unsigned int    size;
+    crc_t           checksum;
+    unsigned char  *data;
+    prep_buffer_t  *buffer;     // data's buffer, NULL if data is from malloc
+    unsigned char   value;
+    long long       stamp;      // trace time it was staged
+    prep_request_t *request;    // comes back with the first chunk
+} prep_chunk_t;
+
+typedef struct
+{
+    pthread_t       thread;
+    spsc_queue_t    requests;
+    spsc_queue_t    chunks;
+    spsc_queue_t    spares;     // buffers the link has sent, coming back
+    prep_buffer_t  *idle;       // one the worker got back from staging
+    server_t       *server;
+} prep_worker_t;
+
+/* File data is read straight into these, laid out as link frames with
+   room for each header (see link_queue_slots), and goes to USB from them
+   as it is. The memory comes from the buffer pool, so it's pinned where
+   usbfs allows. Once a chunk has been sent, its buffer goes back to the
+   worker that filled it, so serving files doesn't allocate once they're
+   warmed up. */
+struct prep_buffer
+{
+    prep_worker_t  *worker;
+    unsigned char  *data;   // PREP_CHUNK_FRAMES slots of FRAME_SLOT_SIZE
+};
+
+static const unsigned char zero_buf[FRAME_MAX_PAYLOAD];
+
+// the response currently being sent
+enum
+{
+    XFER_IDLE = 0,
+    XFER_DATA,  // feeding chunks to the link
+    XFER_PAD,   // file read failed after the header went out
+    XFER_END,   // all data queued, checksum goes once it's sent
+    XFER_ACK    // waiting for the client's checksum result
+};
+
+typedef struct
+{
+    int                 state;
+    prep_worker_t      *worker;
+    unsigned int        size;
+    unsigned int        queued;
+    unsigned int        filled;
+    prep_chunk_t       *fill;   // waiting for the data before it to go out
+    crc_t               checksum;
+    int                 failed;
+    long long           before;     // metrics_now() as the header went out
+    long long           acking;     // and as the checksum did
+    prep_request_t     *request;
+    trace_entry_t       trace;
+} xfer_t;
+
+/* Everything one server_run has going, so a process can serve several
+   carts at once, each from a thread of its own. */
+struct server
+{
+    devcart_t          *cart;
+    link_t             *link;
+    console_t          *console;
+    const char         *directory;
+    cdimage_t          *image;
+    // converted assets are cached under the served directory
+    char                cache_dir[PATH_BUF_SIZE];
+    char                filename_buf[FILENAME_MAX];
+    char                subdir_buf[SUBDIR_BUF_SIZE];
+    prep_worker_t      *workers;
+    int                 num_workers;
+    unsigned int        requests_queued;
+    unsigned int        requests_served;
+    xfer_t              xfer;
+    int                 quit;
+    unsigned int        link_epoch_seen;
+    unsigned long long  fill_total;
+};
+
+// stops every server in the process
+static volatile sig_atomic_t stop_requested = 0;
+
+// staging waits for memory rather than failing a request half way through
+static void *Allocate(size_t size)
+{
+    void *block = malloc(size);
+
+    while (block == NULL)
+    {
+        usleep(1000);
+        block = malloc(size);
+    }
+    return block;
+}
+
+static void PushChunk(prep_worker_t *worker, int type, unsigned int size,
+                      crc_t checksum, unsigned char *data, prep_request_t *request)
+{
+    prep_chunk_t *chunk = Allocate(sizeof(prep_chunk_t));
+
+    chunk->type = type;
+    chunk->size = size;
+    chunk->checksum = checksum;
+    chunk->data = data;
+    chunk->buffer = NULL;
+    chunk->value = 0;
+    chunk->stamp = trace_enabled() ? trace_now() : 0;
+    chunk->request = request;
+    spsc_push_wait(&worker->chunks, chunk);
+}
+
+static void PushFill(prep_worker_t *worker, unsigned int size, unsigned char value)
+{
+    prep_chunk_t *chunk = Allocate(sizeof(prep_chunk_t));
+
+    memset(chunk, 0, sizeof(prep_chunk_t));
+    chunk->type = CHUNK_FILL;
+    chunk->size = size;
+    chunk->value = value;
+    chunk->stamp = trace_enabled() ? trace_now() : 0;
+    spsc_push_wait(&worker->chunks, chunk);
+}
+
+// called by the worker only
+static prep_buffer_t *GetBuffer(prep_worker_t *worker)
+{
+    prep_buffer_t *buffer = worker->idle;
+
+    worker->idle = NULL;
+    if (buffer == NULL)
+    {
+        buffer = spsc_pop(&worker->spares);
+    }
+    if (buffer == NULL)
+    {
+        buffer = Allocate(sizeof(prep_buffer_t));
+        buffer->worker = worker;
+        while ((buffer->data = bufpool_get(PREP_CHUNK_FRAMES * FRAME_SLOT_SIZE)) == NULL)
+        {
+            usleep(1000);
+        }
+    }
+    return buffer;
+}
+
+static void FreeBuffer(prep_buffer_t *buffer)
+{
+    if (buffer != NULL)
+    {
+        bufpool_put(buffer->data);
+        free(buffer);
+    }
+}
+
+// where the byte offset bytes into a buffer's data is
+static unsigned char *Payload(prep_buffer_t *buffer, unsigned int offset)
+{
+    return &buffer->data[offset / FRAME_MAX_PAYLOAD * FRAME_SLOT_SIZE + FRAME_HEADER_SIZE +
+                         offset % FRAME_MAX_PAYLOAD];
+}
+
+static crc_t ChecksumPayload(crc_t checksum, prep_buffer_t *buffer, unsigned int size)
+{
+    unsigned int offset, len;
+
+    for (offset = 0; offset < size; offset += len)
+    {
+        len = size - offset < FRAME_MAX_PAYLOAD ? size - offset : FRAME_MAX_PAYLOAD;
+        checksum = crc_update(checksum, Payload(buffer, offset), len);
+    }
+    return checksum;
+}
+
+// reads size bytes of file from offset on into the buffer's frames, one
+// preadv for the lot. the descriptor's own position isn't used, stdio may
+// have moved it anywhere
+static int ReadPayload(FILE *file, off_t offset, prep_buffer_t *buffer, unsigned int size)
+{
+    struct iovec    iov[PREP_CHUNK_FRAMES];
+    unsigned int    pos, len;
+    int             count = 0, first = 0;
+    ssize_t         got;
+
+    for (pos = 0; pos < size; pos += len)
+    {
+        len = size - pos < FRAME_MAX_PAYLOAD ? size - pos : FRAME_MAX_PAYLOAD;
+        iov[count].iov_base = Payload(buffer, pos);
+        iov[count].iov_len = len;
+        count++;
+    }
+
+    while (first < count)
+    {
+        got = preadv(fileno(file), &iov[first], count - first, offset);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return 0;
+        }
+        offset += got;
+        // carry on from part way through a frame after a short read
+        while (first < count && (size_t)got >= iov[first].iov_len)
+        {
+            got -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count)
+        {
+            iov[first].iov_base = (unsigned char *)iov[first].iov_base + got;
+            iov[first].iov_len -= got;
+        }
+    }
+    return 1;
+}
+
+// called by the server thread only, as the link lets go of buffers
+static void RecycleBuffer(void *release)
+{
+    prep_buffer_t *buffer = release;
+
+    if (!spsc_push(&buffer->worker->spares, buffer))
+    {
+        FreeBuffer(buffer);
+    }
+}
+
+static void FreeChunkData(prep_chunk_t *chunk)
+{
+    if (chunk->buffer != NULL)
+    {
+        RecycleBuffer(chunk->buffer);
+    }
+    else
+    {
+        free(chunk->data);
+    }
+}
+
+static void PushBuffer(prep_worker_t *worker, prep_buffer_t *buffer, unsigned int size)
+{
+    prep_chunk_t *chunk = Allocate(sizeof(prep_chunk_t));
+
+    memset(chunk, 0, sizeof(prep_chunk_t));
+    chunk->type = CHUNK_DATA;
+    chunk->size = size;
+    chunk->data = buffer->data;
+    chunk->buffer = buffer;
+    chunk->stamp = trace_enabled() ? trace_now() : 0;
+    spsc_push_wait(&worker->chunks, chunk);
+}
+
+// stages size bytes from offset into another buffer
+static void PushData(prep_worker_t *worker, prep_buffer_t *from, unsigned int offset,
+                     unsigned int size)
+{
+    prep_buffer_t  *copy = GetBuffer(worker);
+    unsigned int    done, len;
+
+    for (done = 0; done < size; done += len)
+    {
+        len = FRAME_MAX_PAYLOAD - done % FRAME_MAX_PAYLOAD;
+        if (len > FRAME_MAX_PAYLOAD - (offset + done) % FRAME_MAX_PAYLOAD)
+        {
+            len = FRAME_MAX_PAYLOAD - (offset + done) % FRAME_MAX_PAYLOAD;
+        }
+        if (len > size - done)
+        {
+            len = size - done;
+        }
+        memcpy(Payload(copy, done), Payload(from, offset + done), len);
+    }
+    PushBuffer(worker, copy, size);
+}
+
+// stages a run of value that ends at end as a fill, after the data from
+// start up to it, and returns where staging got to
+static unsigned int StageRun(prep_worker_t *worker, prep_buffer_t *buffer, unsigned int start,
+                             unsigned int end, unsigned int run, unsigned char value)
+{
+    if (end - run > start)
+    {
+        PushData(worker, buffer, start, end - run - start);
+    }
+    PushFill(worker, run, value);
+    return end;
+}
+
+/* Stages a block of file data, with long runs of one value as fills. The
+   pieces between fills are copied out, and then the block's buffer stays
+   with the worker for the next read. */
+static void StageData(prep_worker_t *worker, prep_buffer_t *buffer, unsigned int size)
+{
+    unsigned int    start = 0, pos, run = 0, len, ii;
+    unsigned char  *data, value = 0;
+
+    // a frame at a time, runs carry on from one into the next
+    for (pos = 0; pos < size; pos += len)
+    {
+        len = size - pos < FRAME_MAX_PAYLOAD ? size - pos : FRAME_MAX_PAYLOAD;
+        data = Payload(buffer, pos);
+        for (ii = 0; ii < len; ii++)
+        {
+            if (run > 0 && data[ii] == value)
+            {
+                run++;
+                continue;
+            }
+            if (run >= FILL_MIN_RUN)
+            {
+                start = StageRun(worker, buffer, start, pos + ii, run, value);
+            }
+            value = data[ii];
+            run = 1;
+        }
+    }
+    if (run >= FILL_MIN_RUN)
+    {
+        start = StageRun(worker, buffer, start, size, run, value);
+    }
+
+    if (start == 0)
+    {
+        PushBuffer(worker, buffer, size);
+        return;
+    }
+    if (start < size)
+    {
+        PushData(worker, buffer, start, size - start);
+    }
+    worker->idle = buffer;
+}
+
+// builds <name>.bdl from the list <name>.lst next to it, the files in the
+// list are relative to the list's directory
+static FILE *BuildBundle(const char *path)
+{
+    char            list[PATH_BUF_SIZE];
+    char            directory[PATH_BUF_SIZE];
+    char          **names;
+    char           *slash;
+    size_t          len = strlen(path);
+    size_t          ext = strlen(BUNDLE_EXTENSION);
+    FILE           *file;
+    int             count;
+
+    if (len < ext || strcmp(&path[len - ext], BUNDLE_EXTENSION) ||
+        len - ext + strlen(BUNDLE_LIST_EXTENSION) >= sizeof(list))
+    {
+        return NULL;
+    }
+    memcpy(list, path, len - ext);
+    strcpy(&list[len - ext], BUNDLE_LIST_EXTENSION);
+    if (!bundle_read_list(list, &names, &count))
+    {
+        return NULL;
+    }
+
+    strcpy(directory, path);
+    slash = strrchr(directory, '/');
+    strcpy(slash ? slash : directory, slash ? "" : ".");
+
+    file = tmpfile();
+    if (file != NULL && !bundle_build(file, directory, names, count))
+    {
+        fclose(file);
+        file = NULL;
+    }
+    bundle_free_names(names, count);
+    return file;
+}
+
+static void PrepareFile(prep_worker_t *worker, prep_request_t *request)
+{
+    const char     *path = request->path;
+    FILE           *file;
+    long            size;
+    unsigned int    remaining;
+    size_t          read;
+    prep_buffer_t  *buffer;
+    crc_t           checksum = crc_init();
+    long long       start = metrics_now();
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        file = BuildBundle(path);
+    }
+    if (file == NULL)
+    {
+        file = convert_open(path, worker->server->cache_dir);
+    }
+    if (file == NULL)
+    {
+        printf("Can't open the file '%s'\n", path);
+        PushChunk(worker, CHUNK_ERROR, 0, 0, NULL, request);
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0)
+    {
+        printf("Can't read the file '%s'\n", path);
+        PushChunk(worker, CHUNK_ERROR, 0, 0, NULL, request);
+        fclose(file);
+        return;
+    }
+    metrics_phase(METRICS_FILE_IO, start);
+    PushChunk(worker, CHUNK_HEADER, (unsigned int)size, 0, NULL, request);
+
+    remaining = (unsigned int)size;
+    while (remaining > 0)
+    {
+        read = remaining < PREP_CHUNK_SIZE ? remaining : PREP_CHUNK_SIZE;
+        buffer = GetBuffer(worker);
+        start = metrics_now();
+        if (!ReadPayload(file, (off_t)size - remaining, buffer, read))
+        {
+            printf("Error reading the file '%s'\n", path);
+            worker->idle = buffer;
+            PushChunk(worker, CHUNK_ERROR, 0, checksum, NULL, NULL);
+            fclose(file);
+            return;
+        }
+
+        metrics_phase(METRICS_FILE_IO, start);
+
+        start = metrics_now();
+        checksum = ChecksumPayload(checksum, buffer, read);
+        metrics_phase(METRICS_CRC, start);
+        if (request->fills)
+        {
+            StageData(worker, buffer, read);
+        }
+        else
+        {
+            PushBuffer(worker, buffer, read);
+        }
+        remaining -= read;
+    }
+
+    PushChunk(worker, CHUNK_END, 0, crc_finalize(checksum), NULL, NULL);
+    fclose(file);
+}
+
+static void PrepareSectors(prep_worker_t *worker, prep_request_t *request)
+{
+    cdimage_t      *image = worker->server->image;
+    unsigned int    fad = request->fad;
+    unsigned int    remaining = request->count;
+    unsigned int    count;
+    prep_buffer_t  *buffer;
+    crc_t           checksum = crc_init();
+    long long       start;
+
+    if (image == NULL || fad < CDIMAGE_FIRST_FAD ||
+        fad - CDIMAGE_FIRST_FAD > cdimage_sectors(image) ||
+        remaining > cdimage_sectors(image) - (fad - CDIMAGE_FIRST_FAD))
+    {
+        printf(image ? "Sectors out of range: %s\n" : "No CD image mounted for %s\n",
+               request->name);
+        PushChunk(worker, CHUNK_ERROR, 0, 0, NULL, request);
+        return;
+    }
+    PushChunk(worker, CHUNK_HEADER, remaining * CDIMAGE_SECTOR_SIZE, 0, NULL, request);
+
+    while (remaining > 0)
+    {
+        count = remaining < PREP_CHUNK_SIZE / CDIMAGE_SECTOR_SIZE ?
+                remaining : PREP_CHUNK_SIZE / CDIMAGE_SECTOR_SIZE;
+        buffer = GetBuffer(worker);
+        start = metrics_now();
+        if (!cdimage_read_frames(image, fad, count, Payload(buffer, 0), FRAME_MAX_PAYLOAD,
+                                 FRAME_SLOT_SIZE))
+        {
+            printf("Error reading %s\n", request->name);
+            worker->idle = buffer;
+            PushChunk(worker, CHUNK_ERROR, 0, checksum, NULL, NULL);
+            return;
+        }
+        metrics_phase(METRICS_FILE_IO, start);
+
+        start = metrics_now();
+        checksum = ChecksumPayload(checksum, buffer, count * CDIMAGE_SECTOR_SIZE);
+        metrics_phase(METRICS_CRC, start);
+        PushBuffer(worker, buffer, count * CDIMAGE_SECTOR_SIZE);
+        fad += count;
+        remaining -= count;
+    }
+
+    PushChunk(worker, CHUNK_END, 0, crc_finalize(checksum), NULL, NULL);
+}
+
+// nothing to reload is answered like a missing file
+static void PrepareReload(prep_worker_t *worker, prep_request_t *request)
+{
+    unsigned char  *data;
+    unsigned int    size;
+
+    data = reload_build(request->staging, request->staging_size, request->reload_flags, &size);
+    if (data == NULL)
+    {
+        PushChunk(worker, CHUNK_ERROR, 0, 0, NULL, request);
+        return;
+    }
+    PushChunk(worker, CHUNK_HEADER, size, 0, NULL, request);
+    PushChunk(worker, CHUNK_DATA, size, 0, data, NULL);
+    PushChunk(worker, CHUNK_END, 0, crc_finalize(crc_update(crc_init(), data, size)), NULL, NULL);
+}
+
+static void *PrepWorker(void *arg)
+{
+    prep_worker_t  *worker = arg;
+    prep_request_t *request;
+    long long       start;
+    char            name[PATH_BUF_SIZE];
+
+    timeline_thread("prep worker");
+    for (;;)
+    {
+        request = spsc_pop_wait(&worker->requests);
+        if (request->quit)
+        {
+            free(request);
+            break;
+        }
+
+        // the request goes back with the response and may be gone by the
+        // time the span ends
+        if (timeline_enabled())
+        {
+            snprintf(name, sizeof(name), "%s", request->name);
+        }
+        start = metrics_now();
+
+        // the request is handed back with the response
+        if (request->missing)
+        {
+            PushChunk(worker, CHUNK_ERROR, 0, 0, NULL, request);
+        }
+        else if (request->sectors)
+        {
+            PrepareSectors(worker, request);
+        }
+        else if (request->reload)
+        {
+            PrepareReload(worker, request);
+        }
+        else
+        {
+            PrepareFile(worker, request);
+        }
+        timeline_span(name, "prepare", start);
+    }
+
+    return NULL;
+}
+
+static int StartWorkers(server_t *server, int count)
+{
+    int ii;
+
+    server->workers = calloc(count, sizeof(prep_worker_t));
+    if (server->workers == NULL)
+    {
+        return 0;
+    }
+
+    for (ii = 0; ii < count; ii++)
+    {
+        server->workers[ii].server = server;
+        if (!spsc_init(&server->workers[ii].requests, PREP_QUEUE_SIZE) ||
+            !spsc_init(&server->workers[ii].chunks, PREP_QUEUE_SIZE) ||
+            !spsc_init(&server->workers[ii].spares, PREP_SPARE_BUFFERS) ||
+            pthread_create(&server->workers[ii].thread, NULL, PrepWorker, &server->workers[ii]))
+        {
+            printf("Error starting preparation worker\n");
+            spsc_free(&server->workers[ii].requests);
+            spsc_free(&server->workers[ii].chunks);
+            spsc_free(&server->workers[ii].spares);
+            break;
+        }
+    }
+
+    server->num_workers = ii;
+    server->requests_queued = 0;
+    server->requests_served = 0;
+    return server->num_workers > 0;
+}
+
+static void StopWorkers(server_t *server)
+{
+    prep_request_t *request;
+    prep_buffer_t  *buffer;
+    int             ii;
+
+    // every queued request has been served by now, so the workers are idle
+    for (ii = 0; ii < server->num_workers; ii++)
+    {
+        request = calloc(1, sizeof(prep_request_t));
+        request->quit = 1;
+        spsc_push_wait(&server->workers[ii].requests, request);
+        pthread_join(server->workers[ii].thread, NULL);
+        while ((buffer = spsc_pop(&server->workers[ii].spares)) != NULL)
+        {
+            FreeBuffer(buffer);
+        }
+        FreeBuffer(server->workers[ii].idle);
+        spsc_free(&server->workers[ii].requests);
+        spsc_free(&server->workers[ii].chunks);
+        spsc_free(&server->workers[ii].spares);
+    }
+
+    free(server->workers);
+    server->workers = NULL;
+    server->num_workers = 0;
+}
+
+static void PushRequest(server_t *server, prep_request_t *request)
+{
+    prep_worker_t *worker = &server->workers[server->requests_queued % server->num_workers];
+
+    spsc_push_wait(&worker->requests, request);
+    server->requests_queued++;
+}
+
+static void FreeRequest(prep_request_t *request)
+{
+    if (request != &missing_request)
+    {
+        free(request);
+    }
+}
+
+static void QueueRequest(server_t *server, int flags)
+{
+    prep_request_t *request = malloc(sizeof(prep_request_t));
+    int             len;
+
+    if (request == NULL)
+    {
+        printf("Memory allocation error\n");
+        PushRequest(server, &missing_request);
+        return;
+    }
+
+    request->quit = 0;
+    request->requested = trace_enabled() ? trace_now() : 0;
+    request->arrived = metrics_now();
+    request->sectors = 0;
+    request->reload = 0;
+    request->fills = (flags & DOWNLOAD_FILLS) != 0;
+    request->missing = 0;
+    if (server->subdir_buf[0] != '\0')
+    {
+        len = snprintf(request->path, PATH_BUF_SIZE, "%s/%s/%s", server->directory,
+                       server->subdir_buf, server->filename_buf);
+    }
+    else
+    {
+        len = snprintf(request->path, PATH_BUF_SIZE, "%s/%s", server->directory,
+                       server->filename_buf);
+    }
+    if (len < 0 || len >= PATH_BUF_SIZE)
+    {
+        printf("The path to %s is too long\n", server->filename_buf);
+        request->missing = 1;
+    }
+    else
+    {
+        printf("Requested to upload %s\n", request->path);
+    }
+    request->name = request->path;
+    if (strlen(request->path) > strlen(server->directory) + 1)
+    {
+        request->name += strlen(server->directory) + 1;
+    }
+
+    PushRequest(server, request);
+}
+
+// [FUNC_READSECTORS fad count] goes through the workers like a file
+static void QueueSectorRequest(server_t *server, const link_msg_t *msg)
+{
+    prep_request_t *request;
+
+    if (msg->len < 9)
+    {
+        printf("Bad sector request\n");
+        return;
+    }
+    request = malloc(sizeof(prep_request_t));
+    if (request == NULL)
+    {
+        printf("Memory allocation error\n");
+        PushRequest(server, &missing_request);
+        return;
+    }
+
+    request->quit = 0;
+    request->requested = trace_enabled() ? trace_now() : 0;
+    request->arrived = metrics_now();
+    request->sectors = 1;
+    request->reload = 0;
+    request->fills = 0;
+    request->missing = 0;
+    request->fad = ((unsigned int)msg->data[1] << 24) | ((unsigned int)msg->data[2] << 16) |
+                   ((unsigned int)msg->data[3] << 8) | msg->data[4];
+    request->count = ((unsigned int)msg->data[5] << 24) | ((unsigned int)msg->data[6] << 16) |
+                     ((unsigned int)msg->data[7] << 8) | msg->data[8];
+    // the name is only for messages and the trace
+    snprintf(request->path, PATH_BUF_SIZE, "fad %u+%u", request->fad, request->count);
+    request->name = request->path;
+
+    PushRequest(server, request);
+}
+
+// [FUNC_RELOAD staging size flags], the client polling for watch mode changes
+static void QueueReloadRequest(server_t *server, const link_msg_t *msg)
+{
+    prep_request_t *request;
+
+    if (msg->len < 10)
+    {
+        printf("Bad reload request\n");
+        return;
+    }
+    request = malloc(sizeof(prep_request_t));
+    if (request == NULL)
+    {
+        printf("Memory allocation error\n");
+        PushRequest(server, &missing_request);
+        return;
+    }
+
+    request->quit = 0;
+    request->requested = trace_enabled() ? trace_now() : 0;
+    request->arrived = metrics_now();
+    request->sectors = 0;
+    request->reload = 1;
+    request->fills = 0;
+    request->missing = 0;
+    request->staging = ((unsigned int)msg->data[1] << 24) | ((unsigned int)msg->data[2] << 16) |
+                       ((unsigned int)msg->data[3] << 8) | msg->data[4];
+    request->staging_size = ((unsigned int)msg->data[5] << 24) |
+                            ((unsigned int)msg->data[6] << 16) |
+                            ((unsigned int)msg->data[7] << 8) | msg->data[8];
+    request->reload_flags = msg->data[9];
+    snprintf(request->path, PATH_BUF_SIZE, "reload");
+    request->name = request->path;
+
+    PushRequest(server, request);
+}
+
+// throws away the rest of a response that won't be sent
+static void DrainResponse(prep_worker_t *worker)
+{
+    prep_chunk_t   *chunk;
+    int             type;
+
+    do
+    {
+        chunk = spsc_pop_wait(&worker->chunks);
+        type = chunk->type;
+        FreeRequest(chunk->request);
+        FreeChunkData(chunk);
+        free(chunk);
+    } while (type == CHUNK_HEADER || type == CHUNK_DATA || type == CHUNK_FILL);
+}
+
+static void QueueControl(server_t *server, const unsigned char *data, unsigned int len)
+{
+    while (!link_queue_copy(server->link, CHAN_CONTROL, data, len))
+    {
+        // the control queue only backs up if the link is dead
+        if (link_send_next(server->link) < 0)
+        {
+            return;
+        }
+    }
+}
+
+static void QueueUploadHeader(server_t *server, unsigned int size)
+{
+    unsigned char header[9];
+
+    header[0] = FUNC_UPLOAD;
+    header[1] = 0; /* address, the client already knows it */
+    header[2] = 0;
+    header[3] = 0;
+    header[4] = 0;
+    header[5] = (unsigned char)(size >> 24);
+    header[6] = (unsigned char)(size >> 16);
+    header[7] = (unsigned char)(size >> 8);
+    header[8] = (unsigned char)size;
+    QueueControl(server, header, sizeof(header));
+}
+
+static void QueueFill(server_t *server, unsigned int offset, unsigned int size, unsigned char value)
+{
+    unsigned char msg[10];
+
+    msg[0] = FUNC_FILL;
+    msg[1] = (unsigned char)(offset >> 24);
+    msg[2] = (unsigned char)(offset >> 16);
+    msg[3] = (unsigned char)(offset >> 8);
+    msg[4] = (unsigned char)offset;
+    msg[5] = (unsigned char)(size >> 24);
+    msg[6] = (unsigned char)(size >> 16);
+    msg[7] = (unsigned char)(size >> 8);
+    msg[8] = (unsigned char)size;
+    msg[9] = value;
+    QueueControl(server, msg, sizeof(msg));
+}
+
+static void TraceStart(server_t *server, const prep_chunk_t *chunk)
+{
+    trace_entry_t *trace = &server->xfer.trace;
+
+    snprintf(trace->name, sizeof(trace->name), "%s", chunk->request->name);
+    trace->size = chunk->type == CHUNK_HEADER ? chunk->size : 0;
+    trace->requested = chunk->request->requested;
+    trace->read_start = chunk->stamp;
+    trace->read_end = TRACE_NEVER;
+    trace->send_start = trace_now();
+    trace->send_end = TRACE_NEVER;
+    trace->acked = TRACE_NEVER;
+}
+
+// records how the current request went and lets go of it
+static void FinishRequest(server_t *server, int result)
+{
+    xfer_t *xfer = &server->xfer;
+
+    if (trace_enabled() && xfer->request != NULL)
+    {
+        xfer->trace.result = result;
+        trace_write(&xfer->trace);
+    }
+    FreeRequest(xfer->request);
+    xfer->request = NULL;
+}
+
+// moves staged chunks of the current response onto the link as it drains
+static void ServeRequests(server_t *server)
+{
+    xfer_t         *xfer = &server->xfer;
+    prep_chunk_t   *chunk;
+    unsigned char   msg[2];
+    unsigned int    len;
+
+    if (xfer->state == XFER_IDLE)
+    {
+        if (server->requests_served == server->requests_queued)
+        {
+            return;
+        }
+
+        xfer->worker = &server->workers[server->requests_served % server->num_workers];
+        chunk = spsc_pop(&xfer->worker->chunks);
+        if (chunk == NULL)
+        {
+            return;
+        }
+
+        server->requests_served++;
+        xfer->request = chunk->request;
+        if (trace_enabled())
+        {
+            TraceStart(server, chunk);
+        }
+        if (chunk->type == CHUNK_ERROR)
+        {
+            // the client polls for reloads, usually there's nothing new
+            if (!xfer->request->reload)
+            {
+                printf("Error uploading file\n");
+                metrics_count(METRICS_FAILURES);
+            }
+            QueueUploadHeader(server, DEVCART_NO_FILE);
+            xfer->trace.read_end = chunk->stamp;
+            FinishRequest(server, TRACE_MISSING);
+        }
+        else
+        {
+            xfer->before = metrics_now();
+            QueueUploadHeader(server, chunk->size);
+            xfer->state = XFER_DATA;
+            xfer->size = chunk->size;
+            xfer->queued = 0;
+            xfer->filled = 0;
+            xfer->fill = NULL;
+            xfer->failed = 0;
+        }
+        free(chunk);
+    }
+
+    // keep a chunk's worth of room in the bulk queue
+    while (xfer->state == XFER_DATA &&
+           link_queued(server->link, CHAN_BULK) + PREP_CHUNK_SIZE / FRAME_MAX_PAYLOAD <
+           LINK_TX_FRAMES)
+    {
+        // fills go on the control channel, so they have to wait for the
+        // data before them to be sent
+        if (xfer->fill != NULL)
+        {
+            if (link_queued(server->link, CHAN_BULK) > 0)
+            {
+                break;
+            }
+            QueueFill(server, xfer->queued, xfer->fill->size, xfer->fill->value);
+            xfer->queued += xfer->fill->size;
+            xfer->filled += xfer->fill->size;
+            free(xfer->fill);
+            xfer->fill = NULL;
+        }
+
+        chunk = spsc_pop(&xfer->worker->chunks);
+        if (chunk == NULL)
+        {
+            break;
+        }
+
+        if (chunk->type == CHUNK_DATA)
+        {
+            if (chunk->buffer != NULL)
+            {
+                link_queue_slots(server->link, CHAN_BULK, chunk->buffer->data, chunk->size,
+                                 chunk->buffer, RecycleBuffer);
+            }
+            else
+            {
+                link_queue_split(server->link, CHAN_BULK, chunk->data, chunk->size, chunk->data);
+            }
+            xfer->queued += chunk->size;
+        }
+        else if (chunk->type == CHUNK_FILL)
+        {
+            xfer->fill = chunk;
+            continue;
+        }
+        else if (chunk->type == CHUNK_END)
+        {
+            xfer->checksum = chunk->checksum;
+            xfer->trace.read_end = chunk->stamp;
+            xfer->state = XFER_END;
+        }
+        else
+        {
+            // the header already went out, so pad the transfer and send a
+            // bad checksum to make the client reject it
+            xfer->checksum = chunk->checksum;
+            xfer->trace.read_end = chunk->stamp;
+            xfer->failed = 1;
+            xfer->state = XFER_PAD;
+        }
+        free(chunk);
+    }
+
+    while (xfer->state == XFER_PAD && link_queued(server->link, CHAN_BULK) < LINK_TX_FRAMES)
+    {
+        len = xfer->size - xfer->queued;
+        if (len == 0)
+        {
+            xfer->checksum = ~crc_finalize(xfer->checksum);
+            xfer->state = XFER_END;
+            break;
+        }
+        if (len > FRAME_MAX_PAYLOAD)
+        {
+            len = FRAME_MAX_PAYLOAD;
+        }
+        link_queue(server->link, CHAN_BULK, zero_buf, len, NULL);
+        xfer->checksum = crc_update(xfer->checksum, zero_buf, len);
+        xfer->queued += len;
+    }
+
+    if (xfer->state == XFER_END && link_queued(server->link, CHAN_BULK) == 0)
+    {
+        msg[0] = FUNC_CHECKSUM;
+        msg[1] = xfer->checksum;
+        QueueControl(server, msg, sizeof(msg));
+        xfer->state = XFER_ACK;
+        xfer->acking = metrics_now();
+        if (trace_enabled())
+        {
+            xfer->trace.send_end = trace_now();
+        }
+    }
+}
+
+// gives up on a client that never acknowledged the last upload
+static void CheckAckTimeout(server_t *server)
+{
+    xfer_t *xfer = &server->xfer;
+
+    if (xfer->state != XFER_ACK)
+    {
+        return;
+    }
+
+    if (metrics_now() - xfer->acking > ACK_TIMEOUT_US * 1000ll)
+    {
+        printf("No answer from the client, resynchronising\n");
+        link_resync(server->link);
+    }
+}
+
+// a resync throws away everything in flight on both ends
+static void AbortTransfers(server_t *server)
+{
+    xfer_t *xfer = &server->xfer;
+
+    printf("Lost sync with the client, resynchronising%s\n",
+           xfer->state != XFER_IDLE ? " (upload aborted)" : "");
+    if (xfer->state == XFER_DATA)
+    {
+        DrainResponse(xfer->worker);
+    }
+    if (xfer->state != XFER_IDLE)
+    {
+        FinishRequest(server, TRACE_ABORTED);
+    }
+    free(xfer->fill);
+    xfer->fill = NULL;
+    xfer->state = XFER_IDLE;
+
+    while (server->requests_served != server->requests_queued)
+    {
+        DrainResponse(&server->workers[server->requests_served % server->num_workers]);
+        server->requests_served++;
+    }
+}
+
+static void PrintLinkStats(server_t *server)
+{
+    link_stats_t stats;
+
+    link_get_stats(server->link, &stats);
+    if (stats.resyncs || stats.peer_resyncs || stats.skipped_bytes)
+    {
+        printf("Link: %u resyncs (%u by the client, %u requests sent), %u bad headers, "
+               "%u sequence gaps, %u bytes skipped\n",
+               stats.resyncs + stats.peer_resyncs, stats.peer_resyncs, stats.resync_sends,
+               stats.bad_headers, stats.sequence_gaps, stats.skipped_bytes);
+    }
+}
+
+static void UploadDone(server_t *server, int result)
+{
+    xfer_t             *xfer = &server->xfer;
+    signed long long    timedelta;
+    int                 reload;
+
+    if (xfer->state != XFER_ACK)
+    {
+        printf("Unexpected upload result\n");
+        return;
+    }
+
+    xfer->state = XFER_IDLE;
+    if (trace_enabled())
+    {
+        xfer->trace.acked = trace_now();
+    }
+    metrics_phase(METRICS_ACK_WAIT, xfer->acking);
+    if (result != 0 || xfer->failed)
+    {
+        printf("Error uploading file\n");
+        metrics_count(METRICS_FAILURES);
+        FinishRequest(server, TRACE_FAILED);
+        return;
+    }
+    metrics_phase(METRICS_REQUEST, xfer->request->arrived);
+    reload = xfer->request->reload;
+    FinishRequest(server, TRACE_OK);
+    if (reload)
+    {
+        reload_done();
+    }
+
+    timedelta = (metrics_now() - xfer->before) / 1000;
+    printf("Transfer time %f\n", timedelta/1000000.0f);
+    printf("Transfer speed %f K/s\n", (xfer->size/1024.0f)/(timedelta/1000000.0f));
+    if (xfer->filled > 0)
+    {
+        printf("%u of %u bytes sent as fills\n", xfer->filled, xfer->size);
+        server->fill_total += xfer->filled;
+    }
+}
+
+// copies a lowercased, NUL-terminated string out of a control message
+static void GetString(const link_msg_t *msg, char *dest, unsigned int size)
+{
+    unsigned int ii;
+
+    for (ii = 0; ii + 1 < msg->len && ii < size - 1 && msg->data[ii + 1] != '\0'; ii++)
+    {
+        dest[ii] = tolower(msg->data[ii + 1]);
+    }
+    dest[ii] = '\0';
+}
+
+// the flags byte after a request's string, 0 if there isn't one
+static int GetFlags(const link_msg_t *msg)
+{
+    unsigned int ii;
+
+    for (ii = 1; ii < msg->len && msg->data[ii] != '\0'; ii++);
+    return ii + 1 < msg->len ? msg->data[ii + 1] : 0;
+}
+
+static void HandleMessage(server_t *server, const link_msg_t *msg)
+{
+    // sent before a resync, the client has already given up on it
+    if (msg->len == 0 || msg->epoch != server->link_epoch_seen)
+    {
+        return;
+    }
+
+    switch (msg->data[0])
+    {
+    case FUNC_DOWNLOAD:
+        GetString(msg, server->filename_buf, FILENAME_MAX);
+        QueueRequest(server, GetFlags(msg));
+        break;
+
+    case FUNC_READSECTORS:
+        QueueSectorRequest(server, msg);
+        break;
+
+    case FUNC_RELOAD:
+        QueueReloadRequest(server, msg);
+        break;
+
+    case FUNC_CHGDIR:
+        GetString(msg, server->subdir_buf, SUBDIR_BUF_SIZE);
+        printf("Changing directory to %s\n", server->subdir_buf);
+        // ".." means go back to the root directory, so remove the subdir
+        if (strcmp(server->subdir_buf, "..") == 0)
+        {
+            server->subdir_buf[0] = '\0';
+        }
+        break;
+
+    case FUNC_ACK:
+        UploadDone(server, msg->len > 1 ? msg->data[1] : 1);
+        break;
+
+    case FUNC_QUIT:
+        server->quit = 1;
+        break;
+
+    default:
+        printf("Unknown command %d\n", msg->data[0]);
+        break;
+    }
+}
+
+static void FreeServer(server_t *server)
+{
+    cdimage_close(server->image);
+    free(server);
+}
 
 //main server loop
-void server_run(char *directory)
+void server_run(devcart_t *pCart, char *directory, char *image_file, int prep_workers)
 {
-    int status = 0;
-    int state = FUNC_NULL;
-    int cmd_cursor;
-    int filename_cursor;
-    int subdir_cursor;
-    unsigned char curr_char;
+    server_t   *server;
+    link_msg_t *msg;
+    int         status, spins = 0;
+    long long   start;
 
+    server = calloc(1, sizeof(server_t));
+    if (server == NULL)
+    {
+        printf("Couldn't start server\n");
+        return;
+    }
+    server->cart = pCart;
+    server->directory = directory;
+    if (image_file != NULL && (server->image = cdimage_open(image_file)) == NULL)
+    {
+        printf("Couldn't start server\n");
+        FreeServer(server);
+        return;
+    }
+    server->console = console_open(devcart_get_id(pCart));
+    if (server->console == NULL)
+    {
+        printf("Couldn't start server\n");
+        FreeServer(server);
+        return;
+    }
+    if (!StartWorkers(server, prep_workers < 1 ? 1 : prep_workers))
+    {
+        printf("Couldn't start server\n");
+        console_close(server->console);
+        FreeServer(server);
+        return;
+    }
+    server->link = link_start(pCart, server->console);
+    if (server->link == NULL)
+    {
+        printf("Couldn't start server\n");
+        StopWorkers(server);
+        console_close(server->console);
+        FreeServer(server);
+        return;
+    }
     printf("Started server in %s\n", directory);
+    snprintf(server->cache_dir, sizeof(server->cache_dir), "%s/%s", directory,
+             CONVERT_CACHE_DIR);
 
-    while (status >= 0)
+    server->link_epoch_seen = link_epoch(server->link);
+    for (;;)
     {
-        status = ftdi_read_data(&device, cmd_buf, CMD_BUF_SIZE);
+        if (stop_requested)
+        {
+            break;
+        }
+        if (link_epoch(server->link) != server->link_epoch_seen)
+        {
+            server->link_epoch_seen = link_epoch(server->link);
+            AbortTransfers(server);
+        }
+
+        // control messages are handled at every frame boundary
+        while ((msg = link_receive(server->link)) != NULL)
+        {
+            start = metrics_now();
+            HandleMessage(server, msg);
+            timeline_span("control message", "server", start);
+            free(msg);
+        }
+
+        reload_check();
+        metrics_check();
+        ServeRequests(server);
+        CheckAckTimeout(server);
+        status = link_send_next(server->link);
         if (status < 0)
         {
-            printf("Read error: %s\n", ftdi_get_error_string(&device));
+            break;
         }
-        else if (status > 0)
+        else if (status == 0)
         {
-            cmd_cursor = 0;
-            while (cmd_cursor < status)
+            if (server->quit || !link_alive(server->link))
             {
-            start_switch:
-                switch (state)
-                {
-                case FUNC_NULL:
-                    state = (int)cmd_buf[cmd_cursor++];
-                    filename_cursor = 0; //reset all variables for other states
-                    subdir_cursor = 0;
-                    goto start_switch;
-                    break;
-
-                case FUNC_DOWNLOAD: ;
-                    while (cmd_cursor < status)
-                    {
-                        curr_char = cmd_buf[cmd_cursor++];
-                        filename_buf[filename_cursor++] = tolower(curr_char);
-                        if (curr_char == '\0')
-                        {
-                            strcpy(path_buf, directory);
-                            if (subdir_buf[0] != '\0')
-                            {
-                                snprintf(path_buf, PATH_BUF_SIZE, "%s/%s", path_buf, subdir_buf);
-                            }
-                            snprintf(path_buf, PATH_BUF_SIZE, "%s/%s", path_buf, filename_buf);
-                            printf("Requested to upload %s\n", path_buf);
-                            if (!devcart_upload(path_buf, 0))
-                            {
-                                printf("Error uploading file\n");
-                            }
-                            state = FUNC_NULL;
-                            break;
-                        }
-                    }
-                    break;
-
-                case FUNC_PRINT:
-                    while (cmd_cursor < status)
-                    {
-                        curr_char = cmd_buf[cmd_cursor++];
-                        if (curr_char == '\0')
-                        {
-                            state = FUNC_NULL;
-                            goto start_switch;
-                            break;
-                        }
-                        putchar(curr_char);
-                    }
-                    break;
-
-                case FUNC_QUIT:
-                    return;
-
-                case FUNC_CHGDIR:
-                    while (cmd_cursor < status)
-                    {
-                        curr_char = cmd_buf[cmd_cursor++];
-                        subdir_buf[subdir_cursor++] = tolower(curr_char);
-                        if (curr_char == '\0')
-                        {
-                            printf("Changing directory to %s\n", subdir_buf);
-                            // ".." means go back to the root directory, so remove the subdir
-                            if (strcmp(subdir_buf, "..") == 0)
-                            {
-                                subdir_buf[0] = '\0';
-                            }
-                            state = FUNC_NULL;
-                            break;
-                        }
-                    }
-                    break;
-                }
+                break;
             }
+            queue_backoff(&spins);
         }
+        else
+        {
+            spins = 0;
+        }
+    }
+
+    PrintLinkStats(server);
+    link_stop(server->link);
+    if (server->fill_total > 0)
+    {
+        printf("Fills saved sending %llu bytes\n", server->fill_total);
+    }
+    // drain whatever the workers still had staged
+    if (server->xfer.state == XFER_DATA)
+    {
+        DrainResponse(server->xfer.worker);
     }
+    if (server->xfer.state != XFER_IDLE)
+    {
+        FinishRequest(server, TRACE_ABORTED);
+    }
+    free(server->xfer.fill);
+    while (server->requests_served != server->requests_queued)
+    {
+        DrainResponse(&server->workers[server->requests_served % server->num_workers]);
+        server->requests_served++;
+    }
+    StopWorkers(server);
+    console_close(server->console);
+    FreeServer(server);
+}
+
+void server_stop(void)
+{
+    stop_requested = 1;
 }
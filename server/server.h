@@ -1,6 +1,14 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-void server_run(char *directory);
+#include "devcart.h"
+
+#define SERVER_DEFAULT_WORKERS (2)
+
+//image_file is a CD image to answer sector reads from, or NULL. Several
+//carts can be served at once, each from a thread calling server_run
+void server_run(devcart_t *pCart, char *directory, char *image_file, int prep_workers);
+//makes every server_run return at its next pass, safe from a signal handler
+void server_stop(void);
 
 #endif // SERVER_H
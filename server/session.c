@@ -0,0 +1,406 @@
+/*
+    session.c: USB session capture and replay
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+#include "metrics.h"
+#include "session.h"
+
+/* File format, gzip compressed, values big endian:
+   "SATUSB\0\0", version (4 bytes), wall clock time the capture started in
+   microseconds (8 bytes), then one record per read or write: direction (1
+   byte), microseconds since the previous record and length as varints,
+   then the data */
+#define SESSION_MAGIC "SATUSB\0\0"
+#define SESSION_VERSION (1)
+#define SESSION_HEADER_SIZE (20)
+// how long a read waits before returning 0, like a USB read timing out
+#define READ_WAIT_US (10000ll)
+// how long the host can go without writing before reads go anyway
+#define STALL_US (200000ll)
+
+typedef struct
+{
+    long long       time;       // microseconds since the start
+    unsigned long long gate;    // bytes written before it
+    unsigned int    len;
+    unsigned char  *data;
+} session_read_t;
+
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t session_written = PTHREAD_COND_INITIALIZER;
+
+// capture
+static gzFile capture = NULL;
+static long long last_record;
+
+// replay
+static int replaying = 0;
+static int replay_realtime;
+static session_read_t *reads = NULL;
+static unsigned int read_count, next_read, read_offset;
+static unsigned char *recorded = NULL;     // everything written, in order
+static unsigned long long recorded_size, recorded_capacity;
+static unsigned long long written;
+static unsigned long long first_mismatch;
+static int mismatched;
+static unsigned int stalls;
+static long long replay_start, last_write;
+static long long session_length;
+
+static void PutVarint(unsigned char **pp, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        *(*pp)++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *(*pp)++ = (unsigned char)value;
+}
+
+static int GetVarint(gzFile file, unsigned long long *pValue)
+{
+    int c, shift = 0;
+
+    *pValue = 0;
+    do
+    {
+        c = gzgetc(file);
+        if (c < 0 || shift > 63)
+        {
+            return 0;
+        }
+        *pValue |= (unsigned long long)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 1;
+}
+
+int session_capture_open(const char *pFilename)
+{
+    unsigned char   header[SESSION_HEADER_SIZE];
+    unsigned long long start;
+    struct timeval  now;
+    int             ii;
+
+    // level 1 keeps up with the cart's full speed
+    capture = gzopen(pFilename, "wb1");
+    if (capture == NULL)
+    {
+        printf("Error creating session file '%s'\n", pFilename);
+        return 0;
+    }
+
+    gettimeofday(&now, NULL);
+    start = now.tv_sec * 1000000ull + now.tv_usec;
+    memcpy(header, SESSION_MAGIC, 8);
+    for (ii = 0; ii < 4; ii++)
+    {
+        header[8 + ii] = (unsigned char)(SESSION_VERSION >> (24 - ii * 8));
+    }
+    for (ii = 0; ii < 8; ii++)
+    {
+        header[12 + ii] = (unsigned char)(start >> (56 - ii * 8));
+    }
+    gzwrite(capture, header, sizeof(header));
+    last_record = metrics_now() / 1000;
+    return 1;
+}
+
+void session_log(int direction, const unsigned char *pData, int len)
+{
+    unsigned char   prefix[21], *p = prefix;
+    long long       now;
+
+    if (capture == NULL || len <= 0)
+    {
+        return;
+    }
+
+    // reads and writes come from different threads
+    pthread_mutex_lock(&session_lock);
+    if (capture == NULL)
+    {
+        pthread_mutex_unlock(&session_lock);
+        return;
+    }
+    now = metrics_now() / 1000;
+    *p++ = (unsigned char)direction;
+    PutVarint(&p, now - last_record);
+    PutVarint(&p, len);
+    gzwrite(capture, prefix, p - prefix);
+    gzwrite(capture, pData, len);
+    last_record = now;
+    pthread_mutex_unlock(&session_lock);
+}
+
+static void FreeReplay(void)
+{
+    unsigned int ii;
+
+    for (ii = 0; ii < read_count; ii++)
+    {
+        free(reads[ii].data);
+    }
+    free(reads);
+    free(recorded);
+    reads = NULL;
+    recorded = NULL;
+    read_count = 0;
+}
+
+int session_replay_open(const char *pFilename, int realtime)
+{
+    unsigned char       header[SESSION_HEADER_SIZE];
+    unsigned long long  delta, len;
+    unsigned int        capacity = 0;
+    session_read_t     *grown;
+    unsigned char      *data;
+    gzFile              file;
+    int                 direction, ok = 1;
+    long long           time = 0;
+
+    file = gzopen(pFilename, "rb");
+    if (file == NULL)
+    {
+        printf("Can't open the session file '%s'\n", pFilename);
+        return 0;
+    }
+    if (gzread(file, header, sizeof(header)) != sizeof(header) ||
+        memcmp(header, SESSION_MAGIC, 8) != 0)
+    {
+        printf("'%s' isn't a captured session\n", pFilename);
+        gzclose(file);
+        return 0;
+    }
+
+    // the whole session is loaded up front so replay never waits on disk
+    recorded_size = 0;
+    recorded_capacity = 0;
+    read_count = 0;
+    while (ok && (direction = gzgetc(file)) >= 0)
+    {
+        ok = (direction == SESSION_READ || direction == SESSION_WRITE) &&
+             GetVarint(file, &delta) && GetVarint(file, &len) && len > 0 && len < 0x80000000u;
+        data = ok ? malloc(len) : NULL;
+        ok = data != NULL && gzread(file, data, len) == (int)len;
+        if (!ok)
+        {
+            free(data);
+            break;
+        }
+        time += delta;
+
+        if (direction == SESSION_WRITE)
+        {
+            if (recorded_size + len > recorded_capacity)
+            {
+                unsigned char *all;
+
+                recorded_capacity = (recorded_size + len) * 2;
+                all = realloc(recorded, recorded_capacity);
+                ok = all != NULL;
+                recorded = ok ? all : recorded;
+            }
+            if (ok)
+            {
+                memcpy(&recorded[recorded_size], data, len);
+                recorded_size += len;
+            }
+            free(data);
+            continue;
+        }
+
+        if (read_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024;
+            grown = realloc(reads, capacity * sizeof(session_read_t));
+            if (grown == NULL)
+            {
+                free(data);
+                ok = 0;
+                break;
+            }
+            reads = grown;
+        }
+        reads[read_count].time = time;
+        reads[read_count].gate = recorded_size;
+        reads[read_count].len = len;
+        reads[read_count].data = data;
+        read_count++;
+    }
+    gzclose(file);
+
+    if (!ok)
+    {
+        printf("The session file '%s' is damaged\n", pFilename);
+        FreeReplay();
+        return 0;
+    }
+
+    replay_realtime = realtime;
+    next_read = 0;
+    read_offset = 0;
+    written = 0;
+    mismatched = 0;
+    stalls = 0;
+    session_length = time;
+    replay_start = last_write = metrics_now() / 1000;
+    replaying = 1;
+    printf("Replaying %u reads and %llu bytes written over %.3f seconds%s\n", read_count,
+           recorded_size, time / 1000000.0, realtime ? "" : ", as fast as possible");
+    return 1;
+}
+
+int session_replaying(void)
+{
+    return replaying;
+}
+
+int session_read(unsigned char *pBuffer, int size)
+{
+    session_read_t     *current;
+    struct timespec     until;
+    long long           now, wait;
+    int                 len;
+
+    pthread_mutex_lock(&session_lock);
+    now = metrics_now() / 1000;
+    if (next_read == read_count)
+    {
+        // let the host finish answering before the device goes away
+        if (written < recorded_size && now - last_write < STALL_US)
+        {
+            pthread_mutex_unlock(&session_lock);
+            usleep(READ_WAIT_US);
+            return 0;
+        }
+        pthread_mutex_unlock(&session_lock);
+        return -1;
+    }
+
+    current = &reads[next_read];
+    if (written < current->gate && now - last_write < STALL_US)
+    {
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += READ_WAIT_US * 1000;
+        until.tv_sec += until.tv_nsec / 1000000000;
+        until.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&session_written, &session_lock, &until);
+        pthread_mutex_unlock(&session_lock);
+        return 0;
+    }
+    if (written < current->gate && read_offset == 0)
+    {
+        stalls++;
+    }
+
+    wait = replay_realtime ? replay_start + current->time - now : 0;
+    if (wait > 0)
+    {
+        pthread_mutex_unlock(&session_lock);
+        usleep(wait < READ_WAIT_US ? wait : READ_WAIT_US);
+        return 0;
+    }
+
+    // handed out in the pieces they were read in
+    len = current->len - read_offset < (unsigned int)size ? current->len - read_offset : size;
+    memcpy(pBuffer, &current->data[read_offset], len);
+    read_offset += len;
+    if (read_offset == current->len)
+    {
+        next_read++;
+        read_offset = 0;
+    }
+    pthread_mutex_unlock(&session_lock);
+    return len;
+}
+
+int session_write(const unsigned char *pData, int len)
+{
+    unsigned long long ii;
+
+    pthread_mutex_lock(&session_lock);
+    for (ii = 0; !mismatched && ii < (unsigned long long)len; ii++)
+    {
+        if (written + ii >= recorded_size || pData[ii] != recorded[written + ii])
+        {
+            mismatched = 1;
+            first_mismatch = written + ii;
+        }
+    }
+    written += len;
+    last_write = metrics_now() / 1000;
+    pthread_cond_broadcast(&session_written);
+    pthread_mutex_unlock(&session_lock);
+    return len;
+}
+
+void session_close(void)
+{
+    long long elapsed;
+
+    pthread_mutex_lock(&session_lock);
+    if (capture != NULL)
+    {
+        gzclose(capture);
+        capture = NULL;
+    }
+    if (replaying)
+    {
+        elapsed = metrics_now() / 1000 - replay_start;
+        printf("Replay took %.3f seconds (%.3f recorded), %u of %u reads\n",
+               elapsed / 1000000.0, session_length / 1000000.0, next_read, read_count);
+        if (mismatched)
+        {
+            printf("Writes differ from the recording from byte %llu, %llu written, "
+                   "%llu recorded\n", first_mismatch, written, recorded_size);
+        }
+        else if (written != recorded_size)
+        {
+            printf("Wrote %llu of %llu recorded bytes\n", written, recorded_size);
+        }
+        else
+        {
+            printf("Writes match the recording\n");
+        }
+        if (stalls > 0)
+        {
+            printf("%u reads went early because the host stopped writing\n", stalls);
+        }
+        replaying = 0;
+        FreeReplay();
+    }
+    pthread_mutex_unlock(&session_lock);
+}
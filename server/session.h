@@ -0,0 +1,37 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+/* USB session capture (-a) and replay (-n). Capture logs every read and
+   write on the device with a timestamp. Replay stands in for the device:
+   reads return what the client sent, in the same pieces, and writes are
+   checked against what was sent then. That runs the file server, or any
+   other command, offline on identical traffic to reproduce a problem or
+   compare two versions.
+
+   A read is only handed out once the host has written as much as it had
+   when the read happened, so the server sees requests in the same order
+   relative to its answers. If the host being replayed writes less and
+   stalls, the read goes anyway. At recorded speed reads also wait for
+   their time, with -f they go as soon as they can. */
+
+enum
+{
+    SESSION_READ = 0,
+    SESSION_WRITE
+};
+
+int session_capture_open(const char *pFilename);
+//realtime waits for each read's recorded time
+int session_replay_open(const char *pFilename, int realtime);
+//prints a summary of a replay
+void session_close(void);
+int session_replaying(void);
+
+//capture, len bytes that went in direction
+void session_log(int direction, const unsigned char *pData, int len);
+//replay, in place of ftdi_read_data and ftdi_write_data. reads return 0
+//while waiting and -1 at the end of the session
+int session_read(unsigned char *pBuffer, int size);
+int session_write(const unsigned char *pData, int len);
+
+#endif // SESSION_H
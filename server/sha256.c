@@ -0,0 +1,176 @@
+/*
+    sha256.c: SHA-256 (FIPS 180-4)
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+
+#include "sha256.h"
+
+static const uint32_t k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void Transform(sha256_t *ctx, const unsigned char *block)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h, t1, t2;
+    int ii;
+
+    for (ii = 0; ii < 16; ii++)
+    {
+        w[ii] = ((uint32_t)block[ii * 4] << 24) | ((uint32_t)block[ii * 4 + 1] << 16) |
+                ((uint32_t)block[ii * 4 + 2] << 8) | block[ii * 4 + 3];
+    }
+    for (; ii < 64; ii++)
+    {
+        w[ii] = (ROR(w[ii - 2], 17) ^ ROR(w[ii - 2], 19) ^ (w[ii - 2] >> 10)) + w[ii - 7] +
+                (ROR(w[ii - 15], 7) ^ ROR(w[ii - 15], 18) ^ (w[ii - 15] >> 3)) + w[ii - 16];
+    }
+
+    a = ctx->state[0];
+    b = ctx->state[1];
+    c = ctx->state[2];
+    d = ctx->state[3];
+    e = ctx->state[4];
+    f = ctx->state[5];
+    g = ctx->state[6];
+    h = ctx->state[7];
+
+    for (ii = 0; ii < 64; ii++)
+    {
+        t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + k[ii] + w[ii];
+        t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+void sha256_init(sha256_t *ctx)
+{
+    ctx->state[0] = 0x6a09e667;
+    ctx->state[1] = 0xbb67ae85;
+    ctx->state[2] = 0x3c6ef372;
+    ctx->state[3] = 0xa54ff53a;
+    ctx->state[4] = 0x510e527f;
+    ctx->state[5] = 0x9b05688c;
+    ctx->state[6] = 0x1f83d9ab;
+    ctx->state[7] = 0x5be0cd19;
+    ctx->length = 0;
+    ctx->buf_len = 0;
+}
+
+void sha256_update(sha256_t *ctx, const unsigned char *data, size_t len)
+{
+    size_t count;
+
+    ctx->length += len;
+    if (ctx->buf_len > 0)
+    {
+        count = 64 - ctx->buf_len < len ? 64 - ctx->buf_len : len;
+        memcpy(&ctx->buf[ctx->buf_len], data, count);
+        ctx->buf_len += count;
+        data += count;
+        len -= count;
+        if (ctx->buf_len < 64)
+        {
+            return;
+        }
+        Transform(ctx, ctx->buf);
+        ctx->buf_len = 0;
+    }
+
+    while (len >= 64)
+    {
+        Transform(ctx, data);
+        data += 64;
+        len -= 64;
+    }
+
+    memcpy(ctx->buf, data, len);
+    ctx->buf_len = len;
+}
+
+void sha256_final(sha256_t *ctx, unsigned char *digest)
+{
+    uint64_t bits = ctx->length * 8;
+    int ii;
+
+    ctx->buf[ctx->buf_len++] = 0x80;
+    if (ctx->buf_len > 56)
+    {
+        memset(&ctx->buf[ctx->buf_len], 0, 64 - ctx->buf_len);
+        Transform(ctx, ctx->buf);
+        ctx->buf_len = 0;
+    }
+    memset(&ctx->buf[ctx->buf_len], 0, 56 - ctx->buf_len);
+    for (ii = 0; ii < 8; ii++)
+    {
+        ctx->buf[56 + ii] = (unsigned char)(bits >> (56 - ii * 8));
+    }
+    Transform(ctx, ctx->buf);
+
+    for (ii = 0; ii < 8; ii++)
+    {
+        digest[ii * 4] = (unsigned char)(ctx->state[ii] >> 24);
+        digest[ii * 4 + 1] = (unsigned char)(ctx->state[ii] >> 16);
+        digest[ii * 4 + 2] = (unsigned char)(ctx->state[ii] >> 8);
+        digest[ii * 4 + 3] = (unsigned char)ctx->state[ii];
+    }
+}
+
+void sha256(const unsigned char *data, size_t len, unsigned char *digest)
+{
+    sha256_t ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+}
@@ -0,0 +1,23 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_SIZE (32)
+
+typedef struct
+{
+    uint32_t        state[8];
+    uint64_t        length;
+    unsigned char   buf[64];
+    unsigned int    buf_len;
+} sha256_t;
+
+void sha256_init(sha256_t *ctx);
+void sha256_update(sha256_t *ctx, const unsigned char *data, size_t len);
+void sha256_final(sha256_t *ctx, unsigned char *digest);
+//one-shot version
+void sha256(const unsigned char *data, size_t len, unsigned char *digest);
+
+#endif // SHA256_H
@@ -0,0 +1,385 @@
+/*
+    shmring.c: shared memory upload ring
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "devcart.h"
+#include "metrics.h"
+#include "queue.h"
+#include "shmring.h"
+
+#define SHMRING_NAME_SIZE (256)
+// there's nothing to block on across processes, so waits on the other side
+// sleep up to this long, short next to an upload over USB
+#define SHMRING_MAX_SLEEP_US (2000)
+
+static volatile sig_atomic_t stop_requested = 0;
+
+struct shmring
+{
+    shmring_header_t   *header;
+    unsigned char      *data;
+    unsigned int        data_size;  // our own copy, the header's is writable by anyone
+    size_t              map_size;
+    char                name[SHMRING_NAME_SIZE];
+    int                 created;
+};
+
+static void SetName(shmring_t *pRing, const char *pName)
+{
+    snprintf(pRing->name, sizeof(pRing->name), "%s%s", pName[0] == '/' ? "" : "/", pName);
+}
+
+static int Map(shmring_t *pRing, const int Fd, const size_t Size)
+{
+    void *map = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        printf("Can't map %s: %s\n", pRing->name, strerror(errno));
+        return 0;
+    }
+    pRing->header = map;
+    pRing->map_size = Size;
+    return 1;
+}
+
+// a ring left behind by a satbug that's gone can be taken over
+static int Abandoned(const char *pName)
+{
+    shmring_header_t   *header;
+    int                 fd, abandoned = 1;
+
+    fd = shm_open(pName, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return errno == ENOENT;
+    }
+    header = mmap(NULL, sizeof(shmring_header_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (header != MAP_FAILED)
+    {
+        if (header->magic == SHMRING_MAGIC && kill((pid_t)header->owner, 0) == 0)
+        {
+            printf("%s is already served by process %u\n", pName, header->owner);
+            abandoned = 0;
+        }
+        munmap(header, sizeof(shmring_header_t));
+    }
+    close(fd);
+    return abandoned;
+}
+
+shmring_t *shmring_create(const char *pName, const unsigned int Size)
+{
+    shmring_t      *ring = calloc(1, sizeof(shmring_t));
+    size_t          page = sysconf(_SC_PAGESIZE);
+    unsigned int    data_offset;
+    int             fd;
+
+    if (ring == NULL)
+    {
+        printf("Memory allocation error\n");
+        return NULL;
+    }
+    SetName(ring, pName);
+    data_offset = (sizeof(shmring_header_t) + page - 1) & ~(page - 1);
+
+    fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST && Abandoned(ring->name))
+    {
+        shm_unlink(ring->name);
+        fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd < 0)
+    {
+        if (errno != EEXIST)
+        {
+            printf("Can't create %s: %s\n", ring->name, strerror(errno));
+        }
+        free(ring);
+        return NULL;
+    }
+    ring->created = 1;
+
+    if (ftruncate(fd, (off_t)data_offset + Size) < 0)
+    {
+        printf("Can't size %s: %s\n", ring->name, strerror(errno));
+        close(fd);
+        shmring_close(ring);
+        return NULL;
+    }
+    if (!Map(ring, fd, (size_t)data_offset + Size))
+    {
+        close(fd);
+        shmring_close(ring);
+        return NULL;
+    }
+    close(fd);
+
+    // a new object reads as zeros, so everything else starts out right
+    ring->header->data_size = Size;
+    ring->data_size = Size;
+    ring->header->data_offset = data_offset;
+    ring->header->owner = (unsigned int)getpid();
+    ring->data = (unsigned char *)ring->header + data_offset;
+    __atomic_store_n(&ring->header->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+    return ring;
+}
+
+shmring_t *shmring_attach(const char *pName)
+{
+    shmring_t      *ring = calloc(1, sizeof(shmring_t));
+    struct stat     st;
+    int             fd;
+
+    if (ring == NULL)
+    {
+        printf("Memory allocation error\n");
+        return NULL;
+    }
+    SetName(ring, pName);
+
+    fd = shm_open(ring->name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        printf("Can't open %s: %s\n", ring->name, strerror(errno));
+        free(ring);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shmring_header_t) ||
+        !Map(ring, fd, st.st_size))
+    {
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+    close(fd);
+
+    if (__atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC ||
+        (size_t)ring->header->data_offset + ring->header->data_size > ring->map_size)
+    {
+        printf("%s isn't a satbug upload ring\n", ring->name);
+        shmring_close(ring);
+        return NULL;
+    }
+    ring->data = (unsigned char *)ring->header + ring->header->data_offset;
+    ring->data_size = ring->header->data_size;
+
+    return ring;
+}
+
+void shmring_close(shmring_t *pRing)
+{
+    if (pRing == NULL)
+    {
+        return;
+    }
+    if (pRing->header != NULL)
+    {
+        munmap(pRing->header, pRing->map_size);
+    }
+    if (pRing->created)
+    {
+        shm_unlink(pRing->name);
+    }
+    free(pRing);
+}
+
+static void Lock(shmring_header_t *pHeader)
+{
+    int spins = 0;
+
+    while (__atomic_exchange_n(&pHeader->lock, 1, __ATOMIC_ACQUIRE))
+    {
+        queue_backoff(&spins);
+    }
+}
+
+static void Unlock(shmring_header_t *pHeader)
+{
+    __atomic_store_n(&pHeader->lock, 0, __ATOMIC_RELEASE);
+}
+
+unsigned char *shmring_reserve(shmring_t *pRing, const unsigned int Size,
+                               unsigned int *pTicket)
+{
+    shmring_header_t   *header = pRing->header;
+    shmring_desc_t     *slot;
+    unsigned long long  start, released;
+    unsigned int        head, tail;
+    int                 spins = 0;
+
+    if (Size > pRing->data_size)
+    {
+        printf("%u bytes won't fit in %s\n", Size, pRing->name);
+        return NULL;
+    }
+
+    for (;;)
+    {
+        Lock(header);
+        head = header->head;
+        tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+        released = __atomic_load_n(&header->released, __ATOMIC_ACQUIRE);
+
+        // data never wraps, a reservation that would goes to the start
+        start = header->reserved;
+        if (start % pRing->data_size + Size > pRing->data_size)
+        {
+            start += pRing->data_size - start % pRing->data_size;
+        }
+
+        if (head - tail < SHMRING_SLOTS && start + Size - released <= pRing->data_size)
+        {
+            slot = &header->slots[head % SHMRING_SLOTS];
+            slot->offset = start;
+            slot->length = Size;
+            slot->ticket = head;
+            __atomic_store_n(&slot->state, SHMRING_WRITING, __ATOMIC_RELEASE);
+            header->reserved = start + Size;
+            __atomic_store_n(&header->head, head + 1, __ATOMIC_RELEASE);
+            Unlock(header);
+
+            *pTicket = head;
+            return &pRing->data[start % pRing->data_size];
+        }
+        Unlock(header);
+        queue_backoff_max(&spins, SHMRING_MAX_SLEEP_US);
+    }
+}
+
+void shmring_post(shmring_t *pRing, const unsigned int Ticket,
+                  const unsigned int Address, const unsigned int Flags)
+{
+    shmring_desc_t *slot = &pRing->header->slots[Ticket % SHMRING_SLOTS];
+
+    slot->address = Address;
+    slot->flags = Flags;
+    __atomic_store_n(&slot->state, SHMRING_READY, __ATOMIC_RELEASE);
+}
+
+int shmring_wait(shmring_t *pRing, const unsigned int Ticket)
+{
+    shmring_desc_t *slot = &pRing->header->slots[Ticket % SHMRING_SLOTS];
+    unsigned int    state;
+    int             spins = 0;
+
+    while ((int)(__atomic_load_n(&pRing->header->tail, __ATOMIC_ACQUIRE) - Ticket) <= 0)
+    {
+        queue_backoff_max(&spins, SHMRING_MAX_SLEEP_US);
+    }
+
+    state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+    // the slot's ticket changes before its state when it's reused
+    if (__atomic_load_n(&slot->ticket, __ATOMIC_ACQUIRE) != Ticket)
+    {
+        return -1;
+    }
+    return state == SHMRING_DONE;
+}
+
+void shmring_serve(shmring_t *pRing, devcart_t *pCart)
+{
+    shmring_header_t   *header = pRing->header;
+    shmring_desc_t     *slot, desc;
+    unsigned char      *data;
+    unsigned int        tail = header->tail;
+    unsigned long long  reserved, released;
+    int                 spins = 0, ok, valid;
+    long long           before, timedelta;
+
+    printf("Waiting for uploads on %s (%u MB)\n", pRing->name, pRing->data_size >> 20);
+    while (!stop_requested)
+    {
+        slot = &header->slots[tail % SHMRING_SLOTS];
+        if (__atomic_load_n(&header->head, __ATOMIC_ACQUIRE) == tail ||
+            __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SHMRING_READY)
+        {
+            queue_backoff_max(&spins, SHMRING_MAX_SLEEP_US);
+            continue;
+        }
+        spins = 0;
+
+        // producers can write the slot at any time, so work from a copy
+        // and check it lies in what's been handed out, inside the data area
+        desc = *slot;
+        reserved = __atomic_load_n(&header->reserved, __ATOMIC_ACQUIRE);
+        released = header->released;
+        if (desc.offset < released || desc.offset > reserved ||
+            desc.length > reserved - desc.offset ||
+            desc.offset % pRing->data_size + desc.length > pRing->data_size)
+        {
+            printf("Bad upload descriptor %u: %u bytes at offset %llu\n",
+                   tail, desc.length, desc.offset);
+            valid = ok = 0;
+        }
+        else
+        {
+            valid = 1;
+            // the producer's pages go to USB as they are
+            data = &pRing->data[desc.offset % pRing->data_size];
+            before = metrics_now();
+            if (desc.flags & SHMRING_EXECUTE)
+            {
+                metrics_begin(METRICS_EXECUTE);
+                ok = metrics_end(devcart_execute_image(pCart, data, desc.length, desc.address));
+            }
+            else
+            {
+                metrics_begin(METRICS_UPLOAD);
+                ok = metrics_end(devcart_upload_image(pCart, data, desc.length, desc.address));
+            }
+            timedelta = (metrics_now() - before) / 1000;
+            printf("%s %u bytes to 0x%08x: %s, %f K/s\n",
+                   desc.flags & SHMRING_EXECUTE ? "Executed" : "Uploaded",
+                   desc.length, desc.address, ok ? "ok" : "failed",
+                   (desc.length/1024.0f)/(timedelta/1000000.0f));
+        }
+
+        __atomic_store_n(&slot->state, ok ? SHMRING_DONE : SHMRING_FAILED, __ATOMIC_RELEASE);
+        // a bad descriptor's space is freed by the next good one
+        if (valid)
+        {
+            __atomic_store_n(&header->released, desc.offset + desc.length, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&header->tail, ++tail, __ATOMIC_RELEASE);
+    }
+}
+
+void shmring_stop(void)
+{
+    stop_requested = 1;
+}
@@ -0,0 +1,89 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include "devcart.h"
+
+/* Uploads handed to a running satbug (-y) through POSIX shared memory,
+   so a local program can send what it's just built without writing it to
+   disk for satbug to read back. satbug creates the object: a header, a
+   ring of descriptors and a data area. A producer reserves space, writes
+   its data there and posts the descriptor with the address and flags, and
+   satbug uploads straight from those pages, in posting order.
+
+   Any number of producers can share a ring, they take turns through a
+   spinlock in the header. A producer that dies between reserve and post
+   stalls the ring, since satbug won't skip a descriptor it hasn't got. */
+
+#define SHMRING_MAGIC (0x53425352)  // "SBSR"
+#define SHMRING_SLOTS (64)
+#define SHMRING_DEFAULT_SIZE (64*1024*1024)
+
+// descriptor flags
+#define SHMRING_EXECUTE (1 << 0)    // run it once it's uploaded, like -x
+
+// descriptor states
+enum
+{
+    SHMRING_FREE = 0,
+    SHMRING_WRITING,    // reserved, the producer is filling it in
+    SHMRING_READY,      // posted
+    SHMRING_DONE,
+    SHMRING_FAILED
+};
+
+typedef struct
+{
+    unsigned long long  offset;     // in the data area, counting up forever
+    unsigned int        length;
+    unsigned int        address;
+    unsigned int        flags;
+    unsigned int        state;
+    unsigned int        ticket;     // which post this slot holds
+    unsigned int        pad;
+} shmring_desc_t;
+
+typedef struct
+{
+    unsigned int        magic;
+    unsigned int        data_size;
+    unsigned int        data_offset;    // from the start of the mapping
+    unsigned int        owner;          // satbug's pid
+    // producer side, under lock
+    unsigned int        lock;
+    unsigned int        head;           // tickets handed out
+    unsigned long long  reserved;       // data handed out
+    unsigned char       pad0[64];
+    // satbug's side
+    unsigned int        tail;           // descriptors finished
+    unsigned int        pad1;
+    unsigned long long  released;       // data finished with
+    unsigned char       pad2[64];
+    shmring_desc_t      slots[SHMRING_SLOTS];
+} shmring_header_t;
+
+typedef struct shmring shmring_t;
+
+//satbug's end. The name is a shm_open name, the leading / is optional
+shmring_t *shmring_create(const char *pName, const unsigned int Size);
+//uploads everything posted until shmring_stop is called
+void shmring_serve(shmring_t *pRing, devcart_t *pCart);
+//makes shmring_serve return once the upload in progress is done, safe from
+//a signal handler
+void shmring_stop(void);
+//unmaps it, and removes the object if this process created it
+void shmring_close(shmring_t *pRing);
+
+//a producer's end
+shmring_t *shmring_attach(const char *pName);
+//waits for space and returns where to write Size bytes, NULL if they'll
+//never fit. pTicket identifies the reservation
+unsigned char *shmring_reserve(shmring_t *pRing, const unsigned int Size,
+                               unsigned int *pTicket);
+//hands the data over, it mustn't be touched afterwards
+void shmring_post(shmring_t *pRing, const unsigned int Ticket,
+                  const unsigned int Address, const unsigned int Flags);
+//waits for a post to be uploaded, returns 1 if it was, 0 if it failed and
+//-1 if it finished so long ago its slot has been reused
+int shmring_wait(shmring_t *pRing, const unsigned int Ticket);
+
+#endif // SHMRING_H
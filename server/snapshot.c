@@ -0,0 +1,499 @@
+/*
+    snapshot.c: memory snapshot & restore
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+#include "crc.h"
+#include "crcpar.h"
+#include "devcart.h"
+#include "snapshot.h"
+#include "store.h"
+
+/* File format, all values big endian:
+   "SATSNAP" + NUL, version, region count,
+   then for each region: address, size, compressed size, zlib data */
+#define SNAPSHOT_MAGIC "SATSNAP"
+#define SNAPSHOT_VERSION (1)
+#define SNAPSHOT_MAX_REGIONS (16)
+
+// differences closer together than this are restored as one upload
+#define RESTORE_BLOCK_SIZE (64)
+#define RESTORE_MERGE_GAP (1024)
+
+const snapshot_region_t snapshot_regions[] =
+{
+    {"Work RAM L", 0x00200000, 0x100000},
+    {"Work RAM H", 0x06000000, 0x100000},
+    {"Sound RAM",  0x25A00000, 0x80000},
+    {"VDP1 VRAM",  0x25C00000, 0x80000},
+    {"VDP2 VRAM",  0x25E00000, 0x80000},
+    {"VDP2 CRAM",  0x25F00000, 0x1000},
+};
+const int snapshot_num_regions = sizeof(snapshot_regions) / sizeof(snapshot_regions[0]);
+
+// one region's data, compressed or decompressed on its own thread
+typedef struct
+{
+    unsigned int    address;
+    unsigned int    size;
+    unsigned char  *raw;
+    unsigned char  *packed;
+    unsigned long   packed_size;
+    int             ok;
+    int             started;
+    pthread_t       thread;
+} snapshot_job_t;
+
+static void PutDword(unsigned char *p, unsigned int value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static unsigned int GetDword(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+           ((unsigned int)p[2] << 8) | p[3];
+}
+
+static void *CompressJob(void *arg)
+{
+    snapshot_job_t *job = arg;
+    uLongf          size = compressBound(job->size);
+
+    job->packed = malloc(size);
+    job->ok = job->packed != NULL &&
+              compress2(job->packed, &size, job->raw, job->size, Z_DEFAULT_COMPRESSION) == Z_OK;
+    job->packed_size = size;
+    return NULL;
+}
+
+static void *DecompressJob(void *arg)
+{
+    snapshot_job_t *job = arg;
+    uLongf          size = job->size;
+
+    job->raw = malloc(job->size);
+    job->ok = job->raw != NULL &&
+              uncompress(job->raw, &size, job->packed, job->packed_size) == Z_OK &&
+              size == job->size;
+    return NULL;
+}
+
+static void FreeJobs(snapshot_job_t *jobs, int count)
+{
+    int ii;
+
+    for (ii = 0; ii < count; ii++)
+    {
+        if (jobs[ii].started)
+        {
+            pthread_join(jobs[ii].thread, NULL);
+        }
+        free(jobs[ii].raw);
+        free(jobs[ii].packed);
+    }
+}
+
+// downloads every region with all the commands sent up front
+static int DownloadRegions(devcart_t *pCart, unsigned char **buffers, void *(*done)(void *),
+                           snapshot_job_t *jobs)
+{
+    int ii;
+
+    for (ii = 0; ii < snapshot_num_regions; ii++)
+    {
+        if (!devcart_download_request(pCart, snapshot_regions[ii].address, snapshot_regions[ii].size))
+        {
+            return 0;
+        }
+    }
+
+    for (ii = 0; ii < snapshot_num_regions; ii++)
+    {
+        if (!devcart_download_receive(pCart, buffers[ii], snapshot_regions[ii].size))
+        {
+            printf("Error reading %s\n", snapshot_regions[ii].name);
+            return 0;
+        }
+
+        // compress this region while the next one is coming in
+        if (done != NULL && !pthread_create(&jobs[ii].thread, NULL, done, &jobs[ii]))
+        {
+            jobs[ii].started = 1;
+        }
+        else if (done != NULL)
+        {
+            done(&jobs[ii]);
+        }
+    }
+
+    return 1;
+}
+
+static double Elapsed(const struct timeval *before)
+{
+    struct timeval after;
+
+    gettimeofday(&after, NULL);
+    return (after.tv_sec - before->tv_sec) + (after.tv_usec - before->tv_usec) / 1000000.0;
+}
+
+// hands the downloaded regions to the dedup store instead of a file
+static int SaveToStore(const char *pStore, const char *pName, snapshot_job_t *jobs)
+{
+    store_region_t  regions[SNAPSHOT_MAX_REGIONS];
+    int             ii;
+
+    for (ii = 0; ii < snapshot_num_regions; ii++)
+    {
+        regions[ii].address = jobs[ii].address;
+        regions[ii].size = jobs[ii].size;
+        regions[ii].data = jobs[ii].raw;
+    }
+
+    return store_put(pStore, pName, regions, snapshot_num_regions);
+}
+
+int snapshot_save(devcart_t *pCart, const char *pFilename, const char *pStore)
+{
+    snapshot_job_t  jobs[SNAPSHOT_MAX_REGIONS];
+    unsigned char  *buffers[SNAPSHOT_MAX_REGIONS];
+    unsigned char   header[16];
+    unsigned long   total = 0, packed = 0;
+    FILE           *File;
+    int             ii, ok = 1;
+    struct timeval  before;
+
+    gettimeofday(&before, NULL);
+    memset(jobs, 0, sizeof(jobs));
+    for (ii = 0; ii < snapshot_num_regions; ii++)
+    {
+        jobs[ii].address = snapshot_regions[ii].address;
+        jobs[ii].size = snapshot_regions[ii].size;
+        jobs[ii].raw = malloc(jobs[ii].size);
+        buffers[ii] = jobs[ii].raw;
+        if (jobs[ii].raw == NULL)
+        {
+            printf("Memory allocation error\n");
+            FreeJobs(jobs, snapshot_num_regions);
+            return 0;
+        }
+    }
+
+    if (!DownloadRegions(pCart, buffers, pStore ? NULL : CompressJob, jobs))
+    {
+        FreeJobs(jobs, snapshot_num_regions);
+        return 0;
+    }
+
+    if (pStore != NULL)
+    {
+        ok = SaveToStore(pStore, pFilename, jobs);
+        if (ok)
+        {
+            printf("Saved in %f seconds\n", Elapsed(&before));
+        }
+        FreeJobs(jobs, snapshot_num_regions);
+        return ok;
+    }
+
+    File = fopen(pFilename, "wb");
+    if (File == NULL)
+    {
+        printf("Error creating output file\n");
+        FreeJobs(jobs, snapshot_num_regions);
+        return 0;
+    }
+
+    memcpy(header, SNAPSHOT_MAGIC, 8);
+    PutDword(&header[8], SNAPSHOT_VERSION);
+    PutDword(&header[12], snapshot_num_regions);
+    fwrite(header, 1, 16, File);
+
+    for (ii = 0; ii < snapshot_num_regions && ok; ii++)
+    {
+        if (jobs[ii].started)
+        {
+            pthread_join(jobs[ii].thread, NULL);
+            jobs[ii].started = 0;
+        }
+        if (!jobs[ii].ok)
+        {
+            printf("Error compressing %s\n", snapshot_regions[ii].name);
+            ok = 0;
+            break;
+        }
+
+        PutDword(&header[0], jobs[ii].address);
+        PutDword(&header[4], jobs[ii].size);
+        PutDword(&header[8], jobs[ii].packed_size);
+        ok = fwrite(header, 1, 12, File) == 12 &&
+             fwrite(jobs[ii].packed, 1, jobs[ii].packed_size, File) == jobs[ii].packed_size;
+        total += jobs[ii].size;
+        packed += jobs[ii].packed_size;
+    }
+
+    if (fclose(File) != 0 || !ok)
+    {
+        printf("Error writing snapshot\n");
+        ok = 0;
+    }
+    else
+    {
+        printf("Saved %lu bytes (%lu compressed) in %f seconds\n",
+               total, packed, Elapsed(&before));
+    }
+
+    FreeJobs(jobs, snapshot_num_regions);
+    return ok;
+}
+
+static int ReadSnapshot(const char *pFilename, snapshot_job_t *jobs, int *count)
+{
+    unsigned char   header[16];
+    FILE           *File;
+    int             ii;
+
+    File = fopen(pFilename, "rb");
+    if (File == NULL)
+    {
+        printf("Can't open the file '%s'\n", pFilename);
+        return 0;
+    }
+
+    if (fread(header, 1, 16, File) != 16 || memcmp(header, SNAPSHOT_MAGIC, 8) ||
+        GetDword(&header[8]) != SNAPSHOT_VERSION || GetDword(&header[12]) > SNAPSHOT_MAX_REGIONS)
+    {
+        printf("'%s' isn't a snapshot\n", pFilename);
+        fclose(File);
+        return 0;
+    }
+
+    *count = GetDword(&header[12]);
+    for (ii = 0; ii < *count; ii++)
+    {
+        if (fread(header, 1, 12, File) != 12)
+        {
+            break;
+        }
+        jobs[ii].address = GetDword(&header[0]);
+        jobs[ii].size = GetDword(&header[4]);
+        jobs[ii].packed_size = GetDword(&header[8]);
+        jobs[ii].packed = malloc(jobs[ii].packed_size);
+        if (jobs[ii].packed == NULL ||
+            fread(jobs[ii].packed, 1, jobs[ii].packed_size, File) != jobs[ii].packed_size)
+        {
+            break;
+        }
+
+        if (!pthread_create(&jobs[ii].thread, NULL, DecompressJob, &jobs[ii]))
+        {
+            jobs[ii].started = 1;
+        }
+        else
+        {
+            DecompressJob(&jobs[ii]);
+        }
+    }
+    fclose(File);
+
+    if (ii != *count)
+    {
+        printf("Snapshot '%s' is truncated\n", pFilename);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int ReadStore(const char *pStore, const char *pName, snapshot_job_t *jobs, int *count)
+{
+    store_region_t *regions;
+    int             ii;
+
+    if (!store_get(pStore, pName, &regions, count))
+    {
+        return 0;
+    }
+
+    // the jobs take over the region buffers
+    for (ii = 0; ii < *count; ii++)
+    {
+        jobs[ii].address = regions[ii].address;
+        jobs[ii].size = regions[ii].size;
+        jobs[ii].raw = regions[ii].data;
+        jobs[ii].ok = 1;
+    }
+    free(regions);
+
+    return 1;
+}
+
+// finds the snapshot region matching one of ours
+static snapshot_job_t *FindJob(snapshot_job_t *jobs, int count, const snapshot_region_t *region)
+{
+    int ii;
+
+    for (ii = 0; ii < count; ii++)
+    {
+        if (jobs[ii].address == region->address && jobs[ii].size == region->size)
+        {
+            return &jobs[ii];
+        }
+    }
+
+    return NULL;
+}
+
+int snapshot_restore(devcart_t *pCart, const char *pFilename, const char *pStore)
+{
+    snapshot_job_t      jobs[SNAPSHOT_MAX_REGIONS];
+    snapshot_job_t     *job;
+    unsigned char      *live[SNAPSHOT_MAX_REGIONS];
+    unsigned int        offset, start, end, pending = 0;
+    unsigned long       restored = 0, total = 0;
+    int                 count = 0, ii, ok = 1;
+    struct timeval      before;
+
+    gettimeofday(&before, NULL);
+    memset(jobs, 0, sizeof(jobs));
+    memset(live, 0, sizeof(live));
+
+    // decompression runs while the live memory is read back
+    if (pStore != NULL ? !ReadStore(pStore, pFilename, jobs, &count)
+                       : !ReadSnapshot(pFilename, jobs, &count))
+    {
+        FreeJobs(jobs, SNAPSHOT_MAX_REGIONS);
+        return 0;
+    }
+
+    for (ii = 0; ii < snapshot_num_regions; ii++)
+    {
+        live[ii] = malloc(snapshot_regions[ii].size);
+        if (live[ii] == NULL)
+        {
+            printf("Memory allocation error\n");
+            ok = 0;
+            goto RestoreError;
+        }
+    }
+
+    if (!DownloadRegions(pCart, live, NULL, NULL))
+    {
+        ok = 0;
+        goto RestoreError;
+    }
+
+    for (ii = 0; ii < count; ii++)
+    {
+        if (jobs[ii].started)
+        {
+            pthread_join(jobs[ii].thread, NULL);
+            jobs[ii].started = 0;
+        }
+        if (!jobs[ii].ok)
+        {
+            printf("Snapshot '%s' is corrupt\n", pFilename);
+            ok = 0;
+            goto RestoreError;
+        }
+    }
+
+    // send every differing range back to back, then collect the results
+    for (ii = 0; ii < snapshot_num_regions && ok; ii++)
+    {
+        job = FindJob(jobs, count, &snapshot_regions[ii]);
+        if (job == NULL)
+        {
+            printf("Snapshot has no %s, skipping it\n", snapshot_regions[ii].name);
+            continue;
+        }
+
+        total += job->size;
+        offset = 0;
+        while (offset < job->size && ok)
+        {
+            while (offset < job->size &&
+                   !memcmp(&job->raw[offset], &live[ii][offset], RESTORE_BLOCK_SIZE))
+            {
+                offset += RESTORE_BLOCK_SIZE;
+            }
+            if (offset >= job->size)
+            {
+                break;
+            }
+
+            start = end = offset;
+            while (offset < job->size && offset - end < RESTORE_MERGE_GAP)
+            {
+                if (memcmp(&job->raw[offset], &live[ii][offset], RESTORE_BLOCK_SIZE))
+                {
+                    end = offset + RESTORE_BLOCK_SIZE;
+                }
+                offset += RESTORE_BLOCK_SIZE;
+            }
+
+            ok = devcart_upload_begin(pCart, job->address + start, end - start) &&
+                 devcart_upload_data(pCart, &job->raw[start], end - start) &&
+                 devcart_upload_checksum(pCart, crc_finalize(crc_parallel(crc_init(), &job->raw[start], end - start)));
+            restored += end - start;
+            pending++;
+            offset = end;
+        }
+    }
+
+    for (; pending > 0; pending--)
+    {
+        if (!devcart_upload_result(pCart))
+        {
+            printf("Error restoring memory\n");
+            ok = 0;
+        }
+    }
+
+    if (ok)
+    {
+        printf("Restored %lu of %lu bytes in %f seconds\n",
+               restored, total, Elapsed(&before));
+    }
+
+RestoreError:
+    for (ii = 0; ii < snapshot_num_regions; ii++)
+    {
+        free(live[ii]);
+    }
+    FreeJobs(jobs, SNAPSHOT_MAX_REGIONS);
+    return ok;
+}
@@ -0,0 +1,25 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "devcart.h"
+
+/* Saves all of the Saturn's writable memory to a file and puts it back.
+   Regions are downloaded in one pipelined session and compressed on the
+   host in parallel. Restoring only uploads the parts that differ from
+   what's currently in memory. */
+
+typedef struct
+{
+    const char     *name;
+    unsigned int    address;
+    unsigned int    size;
+} snapshot_region_t;
+
+extern const snapshot_region_t snapshot_regions[];
+extern const int snapshot_num_regions;
+
+//with a store directory, pFilename is the snapshot's name in the store
+int snapshot_save(devcart_t *pCart, const char *pFilename, const char *pStore);
+int snapshot_restore(devcart_t *pCart, const char *pFilename, const char *pStore);
+
+#endif // SNAPSHOT_H
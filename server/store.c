@@ -0,0 +1,777 @@
+/*
+    store.c: deduplicating memory dump store
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <zlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "sha256.h"
+#include "store.h"
+
+/* Manifest format, all values big endian:
+   "SATSTOR" + NUL, version, region count,
+   then for each region: address, size, chunk count,
+   then for each chunk: length, SHA-256 of the data */
+#define STORE_MAGIC "SATSTOR"
+#define STORE_VERSION (1)
+#define STORE_MAX_REGIONS (16)
+#define STORE_PATH_SIZE (1024)
+
+// chunk boundaries come from a gear hash over the data, so an edit only
+// changes the chunks around it instead of shifting every chunk after it
+#define CHUNK_MIN_SIZE (2*1024)
+#define CHUNK_MAX_SIZE (64*1024)
+#define CHUNK_MASK ((((uint64_t)1 << 13) - 1) << 51) /* ~8K average */
+
+typedef struct
+{
+    unsigned int    offset;
+    unsigned int    len;
+    unsigned char   hash[SHA256_SIZE];
+} store_chunk_t;
+
+typedef struct
+{
+    unsigned int    address;
+    unsigned int    size;
+    unsigned int    num_chunks;
+    store_chunk_t  *chunks;
+} store_manifest_region_t;
+
+typedef struct
+{
+    int                         count;
+    store_manifest_region_t     regions[STORE_MAX_REGIONS];
+} store_manifest_t;
+
+// per region work for store_put
+typedef struct
+{
+    const char             *store;
+    const store_region_t   *region;
+    store_manifest_region_t manifest;
+    unsigned int            new_chunks;
+    unsigned long           new_bytes;
+    int                     ok;
+    int                     started;
+    pthread_t               thread;
+} store_job_t;
+
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+static void InitGear(void)
+{
+    uint64_t seed = 0x53617475726e21ull, z;
+    int ii;
+
+    // splitmix64, any fixed random table works
+    for (ii = 0; ii < 256; ii++)
+    {
+        z = (seed += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        gear[ii] = z ^ (z >> 31);
+    }
+}
+
+static unsigned int NextChunk(const unsigned char *data, unsigned int len)
+{
+    uint64_t        hash = 0;
+    unsigned int    ii, end;
+
+    if (len <= CHUNK_MIN_SIZE)
+    {
+        return len;
+    }
+
+    end = len < CHUNK_MAX_SIZE ? len : CHUNK_MAX_SIZE;
+    for (ii = CHUNK_MIN_SIZE; ii < end; ii++)
+    {
+        hash = (hash << 1) + gear[data[ii]];
+        if (!(hash & CHUNK_MASK))
+        {
+            return ii + 1;
+        }
+    }
+
+    return end;
+}
+
+static void PutDword(unsigned char *p, unsigned int value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static unsigned int GetDword(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+           ((unsigned int)p[2] << 8) | p[3];
+}
+
+static void ObjectPath(char *path, const char *store, const unsigned char *hash)
+{
+    int len, ii;
+
+    len = snprintf(path, STORE_PATH_SIZE, "%s/objects/%02x/", store, hash[0]);
+    for (ii = 1; ii < SHA256_SIZE && len < STORE_PATH_SIZE - 2; ii++)
+    {
+        len += sprintf(&path[len], "%02x", hash[ii]);
+    }
+}
+
+static int MakeDir(const char *path)
+{
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+static int MakeStoreDirs(const char *store)
+{
+    char path[STORE_PATH_SIZE];
+    int ii, ok;
+
+    snprintf(path, sizeof(path), "%s/objects", store);
+    ok = MakeDir(store) && MakeDir(path);
+    snprintf(path, sizeof(path), "%s/snapshots", store);
+    ok = ok && MakeDir(path);
+    for (ii = 0; ii < 256 && ok; ii++)
+    {
+        snprintf(path, sizeof(path), "%s/objects/%02x", store, ii);
+        ok = MakeDir(path);
+    }
+
+    return ok;
+}
+
+// writes a chunk unless the store already has it
+static int PutObject(store_job_t *job, const unsigned char *data, store_chunk_t *chunk)
+{
+    char            path[STORE_PATH_SIZE], temp[STORE_PATH_SIZE + 32];
+    struct stat     info;
+    unsigned char  *packed;
+    uLongf          size = compressBound(chunk->len);
+    FILE           *File;
+    int             ok;
+
+    ObjectPath(path, job->store, chunk->hash);
+    if (stat(path, &info) == 0)
+    {
+        return 1;
+    }
+
+    packed = malloc(size);
+    if (packed == NULL || compress2(packed, &size, data, chunk->len, Z_BEST_SPEED) != Z_OK)
+    {
+        free(packed);
+        return 0;
+    }
+
+    // write to a temporary name so a concurrent put of the same chunk or a
+    // crash never leaves a partial object behind
+    snprintf(temp, sizeof(temp), "%s.%d.%p", path, (int)getpid(), (void *)job);
+    File = fopen(temp, "wb");
+    ok = File != NULL && fwrite(packed, 1, size, File) == size;
+    if (File != NULL && fclose(File) != 0)
+    {
+        ok = 0;
+    }
+    ok = ok && rename(temp, path) == 0;
+    if (!ok)
+    {
+        unlink(temp);
+    }
+    else
+    {
+        job->new_chunks++;
+        job->new_bytes += size;
+    }
+
+    free(packed);
+    return ok;
+}
+
+static int GetObject(const char *store, const store_chunk_t *chunk, unsigned char *dest)
+{
+    char            path[STORE_PATH_SIZE];
+    unsigned char   hash[SHA256_SIZE];
+    unsigned char  *packed;
+    uLongf          size = chunk->len;
+    long            packed_size;
+    FILE           *File;
+    int             ok;
+
+    ObjectPath(path, store, chunk->hash);
+    File = fopen(path, "rb");
+    if (File == NULL)
+    {
+        printf("Store is missing chunk %s\n", path);
+        return 0;
+    }
+
+    fseek(File, 0, SEEK_END);
+    packed_size = ftell(File);
+    fseek(File, 0, SEEK_SET);
+    packed = malloc(packed_size > 0 ? packed_size : 1);
+    ok = packed != NULL && fread(packed, 1, packed_size, File) == (size_t)packed_size &&
+         uncompress(dest, &size, packed, packed_size) == Z_OK && size == chunk->len;
+    fclose(File);
+    free(packed);
+
+    if (ok)
+    {
+        sha256(dest, chunk->len, hash);
+        ok = !memcmp(hash, chunk->hash, SHA256_SIZE);
+    }
+    if (!ok)
+    {
+        printf("Store chunk %s is corrupt\n", path);
+    }
+
+    return ok;
+}
+
+static void *PutRegion(void *arg)
+{
+    store_job_t            *job = arg;
+    const store_region_t   *region = job->region;
+    store_chunk_t          *chunk;
+    unsigned int            offset = 0, max_chunks;
+
+    max_chunks = region->size / CHUNK_MIN_SIZE + 1;
+    job->manifest.address = region->address;
+    job->manifest.size = region->size;
+    job->manifest.num_chunks = 0;
+    job->manifest.chunks = malloc(max_chunks * sizeof(store_chunk_t));
+    job->ok = job->manifest.chunks != NULL;
+
+    while (job->ok && offset < region->size)
+    {
+        chunk = &job->manifest.chunks[job->manifest.num_chunks++];
+        chunk->offset = offset;
+        chunk->len = NextChunk(&region->data[offset], region->size - offset);
+        sha256(&region->data[offset], chunk->len, chunk->hash);
+        job->ok = PutObject(job, &region->data[offset], chunk);
+        offset += chunk->len;
+    }
+
+    return NULL;
+}
+
+static int WriteManifest(const char *store, const char *name, store_job_t *jobs, int count)
+{
+    char            path[STORE_PATH_SIZE], temp[STORE_PATH_SIZE + 16];
+    unsigned char   header[16];
+    store_chunk_t  *chunk;
+    FILE           *File;
+    unsigned int    ii;
+    int             jj, ok;
+
+    snprintf(path, sizeof(path), "%s/snapshots/%s", store, name);
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    File = fopen(temp, "wb");
+    if (File == NULL)
+    {
+        printf("Error creating '%s'\n", path);
+        return 0;
+    }
+
+    memcpy(header, STORE_MAGIC, 8);
+    PutDword(&header[8], STORE_VERSION);
+    PutDword(&header[12], count);
+    ok = fwrite(header, 1, 16, File) == 16;
+    for (jj = 0; jj < count && ok; jj++)
+    {
+        PutDword(&header[0], jobs[jj].manifest.address);
+        PutDword(&header[4], jobs[jj].manifest.size);
+        PutDword(&header[8], jobs[jj].manifest.num_chunks);
+        ok = fwrite(header, 1, 12, File) == 12;
+        for (ii = 0; ii < jobs[jj].manifest.num_chunks && ok; ii++)
+        {
+            chunk = &jobs[jj].manifest.chunks[ii];
+            PutDword(header, chunk->len);
+            ok = fwrite(header, 1, 4, File) == 4 &&
+                 fwrite(chunk->hash, 1, SHA256_SIZE, File) == SHA256_SIZE;
+        }
+    }
+
+    if (fclose(File) != 0)
+    {
+        ok = 0;
+    }
+    ok = ok && rename(temp, path) == 0;
+    if (!ok)
+    {
+        printf("Error writing '%s'\n", path);
+        unlink(temp);
+    }
+
+    return ok;
+}
+
+int store_put(const char *pStore, const char *pName, const store_region_t *pRegions, int count)
+{
+    store_job_t     jobs[STORE_MAX_REGIONS];
+    unsigned int    chunks = 0, new_chunks = 0;
+    unsigned long   total = 0, new_bytes = 0;
+    int             ii, ok = 1;
+
+    if (count > STORE_MAX_REGIONS)
+    {
+        printf("Too many regions to store\n");
+        return 0;
+    }
+    if (!MakeStoreDirs(pStore))
+    {
+        printf("Can't create store '%s'\n", pStore);
+        return 0;
+    }
+
+    pthread_once(&gear_once, InitGear);
+    memset(jobs, 0, sizeof(jobs));
+    for (ii = 0; ii < count; ii++)
+    {
+        jobs[ii].store = pStore;
+        jobs[ii].region = &pRegions[ii];
+        if (!pthread_create(&jobs[ii].thread, NULL, PutRegion, &jobs[ii]))
+        {
+            jobs[ii].started = 1;
+        }
+        else
+        {
+            PutRegion(&jobs[ii]);
+        }
+    }
+
+    for (ii = 0; ii < count; ii++)
+    {
+        if (jobs[ii].started)
+        {
+            pthread_join(jobs[ii].thread, NULL);
+        }
+        ok = ok && jobs[ii].ok;
+        chunks += jobs[ii].manifest.num_chunks;
+        new_chunks += jobs[ii].new_chunks;
+        new_bytes += jobs[ii].new_bytes;
+        total += pRegions[ii].size;
+    }
+
+    if (!ok)
+    {
+        printf("Error writing to store '%s'\n", pStore);
+    }
+    else if ((ok = WriteManifest(pStore, pName, jobs, count)))
+    {
+        printf("Stored %s: %lu bytes in %u chunks, %u new (%lu bytes on disk)\n",
+               pName, total, chunks, new_chunks, new_bytes);
+    }
+
+    for (ii = 0; ii < count; ii++)
+    {
+        free(jobs[ii].manifest.chunks);
+    }
+    return ok;
+}
+
+static void FreeManifest(store_manifest_t *manifest)
+{
+    int ii;
+
+    for (ii = 0; ii < manifest->count; ii++)
+    {
+        free(manifest->regions[ii].chunks);
+    }
+    manifest->count = 0;
+}
+
+static int ReadManifest(const char *store, const char *name, store_manifest_t *manifest)
+{
+    char                        path[STORE_PATH_SIZE];
+    unsigned char               header[16];
+    store_manifest_region_t    *region;
+    unsigned int                ii, jj, offset;
+    FILE                       *File;
+    int                         ok;
+
+    memset(manifest, 0, sizeof(*manifest));
+    snprintf(path, sizeof(path), "%s/snapshots/%s", store, name);
+    File = fopen(path, "rb");
+    if (File == NULL)
+    {
+        printf("No snapshot '%s' in store '%s'\n", name, store);
+        return 0;
+    }
+
+    ok = fread(header, 1, 16, File) == 16 && !memcmp(header, STORE_MAGIC, 8) &&
+         GetDword(&header[8]) == STORE_VERSION && GetDword(&header[12]) <= STORE_MAX_REGIONS;
+    if (ok)
+    {
+        manifest->count = GetDword(&header[12]);
+    }
+
+    for (ii = 0; ok && ii < (unsigned int)manifest->count; ii++)
+    {
+        region = &manifest->regions[ii];
+        ok = fread(header, 1, 12, File) == 12;
+        if (!ok)
+        {
+            break;
+        }
+        region->address = GetDword(&header[0]);
+        region->size = GetDword(&header[4]);
+        region->num_chunks = GetDword(&header[8]);
+        region->chunks = calloc(region->num_chunks ? region->num_chunks : 1, sizeof(store_chunk_t));
+        ok = region->chunks != NULL;
+
+        offset = 0;
+        for (jj = 0; ok && jj < region->num_chunks; jj++)
+        {
+            ok = fread(header, 1, 4, File) == 4 &&
+                 fread(region->chunks[jj].hash, 1, SHA256_SIZE, File) == SHA256_SIZE;
+            region->chunks[jj].offset = offset;
+            region->chunks[jj].len = GetDword(header);
+            offset += region->chunks[jj].len;
+        }
+        ok = ok && offset == region->size;
+    }
+    fclose(File);
+
+    if (!ok)
+    {
+        printf("Snapshot '%s' in store '%s' is corrupt\n", name, store);
+        FreeManifest(manifest);
+    }
+
+    return ok;
+}
+
+int store_get(const char *pStore, const char *pName, store_region_t **ppRegions, int *pCount)
+{
+    store_manifest_t    manifest;
+    store_region_t     *regions;
+    unsigned int        jj;
+    int                 ii, ok = 1;
+
+    if (!ReadManifest(pStore, pName, &manifest))
+    {
+        return 0;
+    }
+
+    regions = calloc(manifest.count ? manifest.count : 1, sizeof(store_region_t));
+    ok = regions != NULL;
+    for (ii = 0; ok && ii < manifest.count; ii++)
+    {
+        regions[ii].address = manifest.regions[ii].address;
+        regions[ii].size = manifest.regions[ii].size;
+        regions[ii].data = malloc(regions[ii].size ? regions[ii].size : 1);
+        ok = regions[ii].data != NULL;
+        for (jj = 0; ok && jj < manifest.regions[ii].num_chunks; jj++)
+        {
+            ok = GetObject(pStore, &manifest.regions[ii].chunks[jj],
+                           &regions[ii].data[manifest.regions[ii].chunks[jj].offset]);
+        }
+    }
+
+    if (!ok)
+    {
+        store_free(regions, manifest.count);
+        FreeManifest(&manifest);
+        return 0;
+    }
+
+    *ppRegions = regions;
+    *pCount = manifest.count;
+    FreeManifest(&manifest);
+    return 1;
+}
+
+void store_free(store_region_t *pRegions, int count)
+{
+    int ii;
+
+    if (pRegions == NULL)
+    {
+        return;
+    }
+    for (ii = 0; ii < count; ii++)
+    {
+        free(pRegions[ii].data);
+    }
+    free(pRegions);
+}
+
+// length of the run of equal (or differing) bytes starting at a and b
+static unsigned int RunLength(const unsigned char *a, const unsigned char *b,
+                              unsigned int len, int equal)
+{
+    unsigned int pos = 0;
+
+#ifdef __SSE2__
+    while (pos + 16 <= len)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&a[pos]),
+                                                    _mm_loadu_si128((const __m128i *)&b[pos])));
+        if (!equal)
+        {
+            mask = ~mask & 0xffff;
+        }
+        if (mask != 0xffff)
+        {
+            return pos + __builtin_ctz(~mask);
+        }
+        pos += 16;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint64_t mask;
+
+    while (pos + 16 <= len)
+    {
+        // narrowing the compare leaves 4 bits per byte in a 64 bit mask
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(
+                   vceqq_u8(vld1q_u8(&a[pos]), vld1q_u8(&b[pos]))), 4)), 0);
+        if (equal)
+        {
+            mask = ~mask;
+        }
+        if (mask != 0)
+        {
+            return pos + __builtin_ctzll(mask) / 4;
+        }
+        pos += 16;
+    }
+#else
+    uint64_t wa, wb, diff;
+
+    while (pos + 8 <= len)
+    {
+        memcpy(&wa, &a[pos], 8);
+        memcpy(&wb, &b[pos], 8);
+        diff = wa ^ wb;
+        // a differing run ends at the first word with a zero byte in diff
+        if (equal ? diff != 0 :
+            ((diff - 0x0101010101010101ull) & ~diff & 0x8080808080808080ull) != 0)
+        {
+            break;
+        }
+        pos += 8;
+    }
+#endif
+
+    while (pos < len && (a[pos] == b[pos]) == equal)
+    {
+        pos++;
+    }
+    return pos;
+}
+
+// prints differing ranges in one span that wasn't proven equal by hashes
+static void CompareSpan(const unsigned char *a, const unsigned char *b, unsigned int len,
+                        unsigned int address, unsigned int *ranges, unsigned long *bytes)
+{
+    unsigned int pos = 0, run;
+
+    while (pos < len)
+    {
+        pos += RunLength(&a[pos], &b[pos], len - pos, 1);
+        if (pos >= len)
+        {
+            break;
+        }
+        run = RunLength(&a[pos], &b[pos], len - pos, 0);
+        printf("  0x%08x-0x%08x (%u bytes)\n", address + pos, address + pos + run - 1, run);
+        (*ranges)++;
+        *bytes += run;
+        pos += run;
+    }
+}
+
+static int DiffRegion(const char *store, store_manifest_region_t *ra, store_manifest_region_t *rb,
+                      unsigned int *ranges, unsigned long *bytes)
+{
+    unsigned char  *a, *b;
+    unsigned char  *same_a, *same_b;
+    unsigned int    ia = 0, ib = 0, ii, start;
+    int             ok = 1;
+
+    a = malloc(ra->size ? ra->size : 1);
+    b = malloc(ra->size ? ra->size : 1);
+    same_a = calloc(ra->num_chunks + 1, 1);
+    same_b = calloc(rb->num_chunks + 1, 1);
+    if (a == NULL || b == NULL || same_a == NULL || same_b == NULL)
+    {
+        printf("Memory allocation error\n");
+        ok = 0;
+        goto DiffError;
+    }
+
+    // chunks with the same position and hash in both are known equal
+    while (ia < ra->num_chunks && ib < rb->num_chunks)
+    {
+        store_chunk_t *ca = &ra->chunks[ia], *cb = &rb->chunks[ib];
+        if (ca->offset == cb->offset && ca->len == cb->len &&
+            !memcmp(ca->hash, cb->hash, SHA256_SIZE))
+        {
+            same_a[ia++] = 1;
+            same_b[ib++] = 1;
+        }
+        else if (ca->offset + ca->len <= cb->offset + cb->len)
+        {
+            ia++;
+        }
+        else
+        {
+            ib++;
+        }
+    }
+
+    // only the rest has to be read and compared
+    for (ii = 0; ok && ii < ra->num_chunks; ii++)
+    {
+        if (!same_a[ii])
+        {
+            ok = GetObject(store, &ra->chunks[ii], &a[ra->chunks[ii].offset]);
+        }
+    }
+    for (ii = 0; ok && ii < rb->num_chunks; ii++)
+    {
+        if (!same_b[ii])
+        {
+            ok = GetObject(store, &rb->chunks[ii], &b[rb->chunks[ii].offset]);
+        }
+    }
+
+    // the unmatched chunks cover the same byte ranges in both dumps
+    for (ii = 0; ok && ii < ra->num_chunks; ii++)
+    {
+        if (same_a[ii])
+        {
+            continue;
+        }
+        start = ii;
+        while (ii + 1 < ra->num_chunks && !same_a[ii + 1])
+        {
+            ii++;
+        }
+        CompareSpan(&a[ra->chunks[start].offset], &b[ra->chunks[start].offset],
+                    ra->chunks[ii].offset + ra->chunks[ii].len - ra->chunks[start].offset,
+                    ra->address + ra->chunks[start].offset, ranges, bytes);
+    }
+
+DiffError:
+    free(a);
+    free(b);
+    free(same_a);
+    free(same_b);
+    return ok;
+}
+
+int store_diff(const char *pStore, const char *pNameA, const char *pNameB)
+{
+    store_manifest_t    ma, mb;
+    unsigned int        ranges = 0;
+    unsigned long       bytes = 0;
+    struct timeval      before, after;
+    int                 ii, jj, ok = 1;
+
+    gettimeofday(&before, NULL);
+    if (!ReadManifest(pStore, pNameA, &ma))
+    {
+        return 0;
+    }
+    if (!ReadManifest(pStore, pNameB, &mb))
+    {
+        FreeManifest(&ma);
+        return 0;
+    }
+
+    for (ii = 0; ok && ii < ma.count; ii++)
+    {
+        for (jj = 0; jj < mb.count; jj++)
+        {
+            if (mb.regions[jj].address == ma.regions[ii].address)
+            {
+                break;
+            }
+        }
+
+        if (jj == mb.count || mb.regions[jj].size != ma.regions[ii].size)
+        {
+            printf("  0x%08x-0x%08x (%u bytes, only in %s)\n", ma.regions[ii].address,
+                   ma.regions[ii].address + ma.regions[ii].size - 1, ma.regions[ii].size, pNameA);
+            ranges++;
+            bytes += ma.regions[ii].size;
+            continue;
+        }
+
+        ok = DiffRegion(pStore, &ma.regions[ii], &mb.regions[jj], &ranges, &bytes);
+    }
+
+    for (jj = 0; ok && jj < mb.count; jj++)
+    {
+        for (ii = 0; ii < ma.count; ii++)
+        {
+            if (ma.regions[ii].address == mb.regions[jj].address &&
+                ma.regions[ii].size == mb.regions[jj].size)
+            {
+                break;
+            }
+        }
+
+        if (ii == ma.count)
+        {
+            printf("  0x%08x-0x%08x (%u bytes, only in %s)\n", mb.regions[jj].address,
+                   mb.regions[jj].address + mb.regions[jj].size - 1, mb.regions[jj].size, pNameB);
+            ranges++;
+            bytes += mb.regions[jj].size;
+        }
+    }
+
+    gettimeofday(&after, NULL);
+    if (ok)
+    {
+        printf("%u changed ranges, %lu bytes, in %.3f ms\n", ranges, bytes,
+               (after.tv_sec - before.tv_sec) * 1000.0 + (after.tv_usec - before.tv_usec) / 1000.0);
+    }
+
+    FreeManifest(&ma);
+    FreeManifest(&mb);
+    return ok;
+}
@@ -0,0 +1,24 @@
+#ifndef STORE_H
+#define STORE_H
+
+/* Content-addressed memory dump store. Dumps are split into content-defined
+   chunks, each chunk is stored once under its SHA-256 in
+   <store>/objects/, and a dump is just a list of chunk hashes in
+   <store>/snapshots/<name>. Identical chunks are shared between dumps, so
+   disk use grows with what actually changed. */
+
+typedef struct
+{
+    unsigned int    address;
+    unsigned int    size;
+    unsigned char  *data;
+} store_region_t;
+
+int store_put(const char *pStore, const char *pName, const store_region_t *pRegions, int count);
+//allocates the regions and their data, free them with store_free
+int store_get(const char *pStore, const char *pName, store_region_t **ppRegions, int *pCount);
+void store_free(store_region_t *pRegions, int count);
+//prints the address ranges that differ between two stored dumps
+int store_diff(const char *pStore, const char *pNameA, const char *pNameB);
+
+#endif // STORE_H
@@ -0,0 +1,117 @@
+/*
+    stripbench.c: status byte stripping microbenchmark
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Times libftdi's way of removing the modem status bytes (a memmove per
+   packet inside its read buffer, then a copy out to the caller) against
+   usbread_strip compacting in place. Build with "make bench". */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "usbread.h"
+
+#define TRANSFER_SIZE (64*1024)
+#define ITERATIONS (20000)
+
+static unsigned char raw[TRANSFER_SIZE];
+static unsigned char work[TRANSFER_SIZE];
+static unsigned char out[TRANSFER_SIZE];
+
+static double Now(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
+// what ftdi_read_data does with a completed transfer
+static unsigned int LibftdiStrip(unsigned char *dst, unsigned char *buf,
+                                 unsigned int size, unsigned int packet)
+{
+    unsigned int chunks = size / packet, payload = packet - 2, ii;
+
+    for (ii = 1; ii < chunks; ii++)
+    {
+        memmove(&buf[2 + payload * ii], &buf[2 + packet * ii], payload);
+    }
+    memcpy(dst, &buf[2], chunks * payload);
+    return chunks * payload;
+}
+
+static void Run(unsigned int packet)
+{
+    unsigned int    ii, len = 0, check = 0;
+    double          start, ftdi_time, raw_time;
+    double          mbytes = (double)TRANSFER_SIZE * ITERATIONS / (1024 * 1024);
+
+    start = Now();
+    for (ii = 0; ii < ITERATIONS; ii++)
+    {
+        memcpy(work, raw, TRANSFER_SIZE); // libusb fills the buffer every time
+        len = LibftdiStrip(out, work, TRANSFER_SIZE, packet);
+        check += out[ii % len];
+    }
+    ftdi_time = Now() - start;
+
+    start = Now();
+    for (ii = 0; ii < ITERATIONS; ii++)
+    {
+        memcpy(work, raw, TRANSFER_SIZE);
+        len = usbread_strip(work, work, TRANSFER_SIZE, packet);
+        check += work[ii % len];
+    }
+    raw_time = Now() - start;
+
+    LibftdiStrip(out, memcpy(work, raw, TRANSFER_SIZE), TRANSFER_SIZE, packet);
+    usbread_strip(raw, raw, TRANSFER_SIZE, packet);
+    printf("%3u byte packets: libftdi %8.1f MB/s, usbread %8.1f MB/s (%s, %u)\n",
+           packet, mbytes / ftdi_time, mbytes / raw_time,
+           memcmp(out, raw, len) ? "MISMATCH" : "match", check & 0xff);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int ii;
+
+    srand(1);
+    for (ii = 0; ii < TRANSFER_SIZE; ii++)
+    {
+        raw[ii] = (unsigned char)rand();
+    }
+    Run(64);
+
+    for (ii = 0; ii < TRANSFER_SIZE; ii++)
+    {
+        raw[ii] = (unsigned char)rand();
+    }
+    Run(512);
+
+    return 0;
+}
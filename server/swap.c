@@ -0,0 +1,261 @@
+/*
+    swap.c: byte swapping for uploads
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWAP_X86
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SWAP_NEON
+#endif
+
+#include "swap.h"
+
+#define VECTOR_SIZE (16)
+// the shuffle masks cover lcm(record, 16) bytes
+#define MAX_MASKS (SWAP_MAX_RECORD)
+
+typedef struct
+{
+    unsigned int    period;
+    unsigned int    count;
+    unsigned char   masks[MAX_MASKS][VECTOR_SIZE];
+} swap_masks_t;
+
+int swap_parse(const char *pSpec, swap_layout_t *pLayout)
+{
+    const char     *p = pSpec;
+    char           *end;
+    unsigned long   count, size, stride;
+    unsigned int    pos = 0, ii, jj;
+
+    memset(pLayout, 0, sizeof(swap_layout_t));
+    for (;;)
+    {
+        count = 1;
+        size = strtoul(p, &end, 10);
+        if (end != p && (*end == 'x' || *end == 'X'))
+        {
+            count = size;
+            p = end + 1;
+            size = strtoul(p, &end, 10);
+        }
+        if (end == p || (size != 1 && size != 2 && size != 4) || count == 0 ||
+            count > SWAP_MAX_RECORD || pos + count * size > SWAP_MAX_RECORD)
+        {
+            printf("Bad swap layout '%s'\n", pSpec);
+            return 0;
+        }
+
+        for (ii = 0; ii < count; ii++)
+        {
+            for (jj = 0; jj < size; jj++)
+            {
+                pLayout->perm[pos + jj] = (unsigned char)(pos + size - 1 - jj);
+            }
+            pos += size;
+        }
+
+        p = end;
+        if (*p != ',')
+        {
+            break;
+        }
+        p++;
+    }
+
+    pLayout->fields_end = pos;
+    pLayout->record = pos;
+    if (*p == '/')
+    {
+        stride = strtoul(p + 1, &end, 10);
+        if (end == p + 1 || stride < pos || stride > SWAP_MAX_RECORD)
+        {
+            printf("Bad swap layout '%s'\n", pSpec);
+            return 0;
+        }
+        for (ii = pos; ii < stride; ii++)
+        {
+            pLayout->perm[ii] = (unsigned char)ii;
+        }
+        pLayout->record = stride;
+        p = end;
+    }
+    if (*p != '\0')
+    {
+        printf("Bad swap layout '%s'\n", pSpec);
+        return 0;
+    }
+
+    return 1;
+}
+
+// builds a pshufb/tbl mask per 16 bytes of the repeating pattern. fails
+// if a field would need bytes from the next vector
+static int BuildMasks(const swap_layout_t *pLayout, swap_masks_t *pMasks)
+{
+    unsigned int a = pLayout->record, b = VECTOR_SIZE, t;
+    unsigned int ii, pos, src;
+
+    while (b != 0)
+    {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    pMasks->period = pLayout->record / a * VECTOR_SIZE;
+    pMasks->count = pMasks->period / VECTOR_SIZE;
+    if (pMasks->count > MAX_MASKS)
+    {
+        return 0;
+    }
+
+    for (ii = 0; ii < pMasks->period; ii++)
+    {
+        pos = ii % pLayout->record;
+        src = ii - pos + pLayout->perm[pos];
+        if (src / VECTOR_SIZE != ii / VECTOR_SIZE)
+        {
+            return 0;
+        }
+        pMasks->masks[ii / VECTOR_SIZE][ii % VECTOR_SIZE] = (unsigned char)(src % VECTOR_SIZE);
+    }
+
+    return 1;
+}
+
+static void SwapRecordsScalar(const swap_layout_t *pLayout, unsigned char *pData, size_t records)
+{
+    unsigned char   temp[SWAP_MAX_RECORD];
+    unsigned int    ii;
+
+    while (records-- > 0)
+    {
+        memcpy(temp, pData, pLayout->fields_end);
+        for (ii = 0; ii < pLayout->fields_end; ii++)
+        {
+            pData[ii] = temp[pLayout->perm[ii]];
+        }
+        pData += pLayout->record;
+    }
+}
+
+#ifdef SWAP_X86
+__attribute__((target("ssse3")))
+static size_t SwapSSSE3(const swap_masks_t *pMasks, unsigned char *pData, size_t size)
+{
+    __m128i         block;
+    size_t          done = 0;
+    unsigned int    ii;
+
+    for (; done + pMasks->period <= size; done += pMasks->period)
+    {
+        for (ii = 0; ii < pMasks->count; ii++)
+        {
+            block = _mm_loadu_si128((const __m128i *)&pData[done + ii * VECTOR_SIZE]);
+            block = _mm_shuffle_epi8(block, _mm_loadu_si128((const __m128i *)pMasks->masks[ii]));
+            _mm_storeu_si128((__m128i *)&pData[done + ii * VECTOR_SIZE], block);
+        }
+    }
+
+    return done;
+}
+#elif defined(SWAP_NEON)
+static size_t SwapNEON(const swap_masks_t *pMasks, unsigned char *pData, size_t size)
+{
+    uint8x16_t      block;
+    size_t          done = 0;
+    unsigned int    ii;
+
+    for (; done + pMasks->period <= size; done += pMasks->period)
+    {
+        for (ii = 0; ii < pMasks->count; ii++)
+        {
+            block = vld1q_u8(&pData[done + ii * VECTOR_SIZE]);
+            block = vqtbl1q_u8(block, vld1q_u8(pMasks->masks[ii]));
+            vst1q_u8(&pData[done + ii * VECTOR_SIZE], block);
+        }
+    }
+
+    return done;
+}
+#endif
+
+static size_t SwapVector(const swap_masks_t *pMasks, unsigned char *pData, size_t size)
+{
+#ifdef SWAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        return SwapSSSE3(pMasks, pData, size);
+    }
+#elif defined(SWAP_NEON)
+    return SwapNEON(pMasks, pData, size);
+#endif
+    return 0;
+}
+
+void swap_buffer(const swap_layout_t *pLayout, unsigned char *pData, size_t size)
+{
+    swap_masks_t    masks;
+    size_t          done = 0, left;
+    unsigned char   temp[SWAP_MAX_RECORD];
+    unsigned int    ii, jj, last;
+
+    if (pLayout->record == 0)
+    {
+        return;
+    }
+
+    if (BuildMasks(pLayout, &masks))
+    {
+        done = SwapVector(&masks, pData, size);
+    }
+    SwapRecordsScalar(pLayout, &pData[done], (size - done) / pLayout->record);
+    done += (size - done) / pLayout->record * pLayout->record;
+
+    // fields that fit in what's left of a partial record. perm of a
+    // field's first byte is its last byte
+    left = size - done;
+    memcpy(temp, &pData[done], left);
+    for (ii = 0; ii < pLayout->fields_end; ii = last + 1)
+    {
+        last = pLayout->perm[ii];
+        if (last >= left)
+        {
+            break;
+        }
+        for (jj = ii; jj <= last; jj++)
+        {
+            pData[done + jj] = temp[pLayout->perm[jj]];
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include <stddef.h>
+
+/* Byte swapping for uploads of little endian data to the big endian SH-2.
+   A layout is the list of field sizes in one record, which repeats through
+   the data, so structures that mix word sizes can be swapped too:
+
+       2                 every 16 bit word
+       4                 every 32 bit word
+       4,2,2,4x1         a 32 bit, two 16 bit and four 8 bit fields
+       4,4/16            two 32 bit words swapped, 8 bytes left alone, per
+                         16 byte record
+
+   Fields are 1, 2 or 4 bytes, "<n>x<size>" repeats one. When no field
+   crosses a 16 byte boundary of the repeating pattern the swap is one
+   vector shuffle per 16 bytes. */
+
+#define SWAP_MAX_RECORD (256)
+
+typedef struct
+{
+    unsigned int    record;                 // 0 when not swapping
+    unsigned char   perm[SWAP_MAX_RECORD];  // where each byte of a record comes from
+    unsigned int    fields_end;             // bytes past this are left alone
+} swap_layout_t;
+
+//returns 0 if the layout isn't valid
+int swap_parse(const char *pSpec, swap_layout_t *pLayout);
+//swaps data in place. a partial record at the end only has the fields that
+//fit swapped
+void swap_buffer(const swap_layout_t *pLayout, unsigned char *pData, size_t size);
+
+#endif // SWAP_H
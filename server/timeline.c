@@ -0,0 +1,198 @@
+/*
+    timeline.c: Chrome trace timeline of the transfer pipeline
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "timeline.h"
+
+/* Events are written as they finish, under a lock so the threads don't
+   interleave and none writes once the file is closed. The file is a JSON
+   array that's closed on exit, the viewers also take it unclosed if satbug
+   dies. */
+
+static FILE *timeline_file = NULL;
+static int timeline_on = 0;
+static pthread_mutex_t timeline_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long timeline_start;
+static int next_tid = 1;
+#define NAME_SIZE (256)
+static unsigned int next_id = 0;
+static __thread int thread_tid = 0;
+
+static int Tid(void)
+{
+    if (thread_tid == 0)
+    {
+        thread_tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    }
+    return thread_tid;
+}
+
+// names can be file names, keep them from breaking the JSON
+static void Escape(char *dest, size_t size, const char *src)
+{
+    size_t len = 0;
+
+    for (; *src != '\0' && len + 3 < size; src++)
+    {
+        if (*src == '"' || *src == '\\')
+        {
+            dest[len++] = '\\';
+        }
+        dest[len++] = (unsigned char)*src < ' ' ? '?' : *src;
+    }
+    dest[len] = '\0';
+}
+
+// microseconds since the timeline started
+static double Stamp(long long time)
+{
+    return (time - timeline_start) / 1000.0;
+}
+
+int timeline_open(const char *pFilename)
+{
+    timeline_file = fopen(pFilename, "w");
+    if (timeline_file == NULL)
+    {
+        printf("Error creating timeline file '%s'\n", pFilename);
+        return 0;
+    }
+
+    timeline_start = metrics_now();
+    fprintf(timeline_file, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"satbug\"}}", (int)getpid());
+    __atomic_store_n(&timeline_on, 1, __ATOMIC_RELEASE);
+    timeline_thread("main");
+    return 1;
+}
+
+void timeline_close(void)
+{
+    pthread_mutex_lock(&timeline_lock);
+    if (timeline_file != NULL)
+    {
+        __atomic_store_n(&timeline_on, 0, __ATOMIC_RELEASE);
+        fprintf(timeline_file, "\n]\n");
+        fclose(timeline_file);
+        timeline_file = NULL;
+    }
+    pthread_mutex_unlock(&timeline_lock);
+}
+
+int timeline_enabled(void)
+{
+    return __atomic_load_n(&timeline_on, __ATOMIC_ACQUIRE);
+}
+
+void timeline_thread(const char *pName)
+{
+    char name[NAME_SIZE];
+
+    if (!__atomic_load_n(&timeline_on, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    Escape(name, sizeof(name), pName);
+    pthread_mutex_lock(&timeline_lock);
+    if (timeline_file != NULL)
+    {
+        fprintf(timeline_file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}", (int)getpid(), Tid(), name);
+    }
+    pthread_mutex_unlock(&timeline_lock);
+}
+
+void timeline_span(const char *pName, const char *pCategory, long long start)
+{
+    char        name[NAME_SIZE];
+    long long   now;
+
+    if (!__atomic_load_n(&timeline_on, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    now = metrics_now();
+    Escape(name, sizeof(name), pName);
+    pthread_mutex_lock(&timeline_lock);
+    if (timeline_file != NULL)
+    {
+        fprintf(timeline_file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                "\"dur\":%.3f,\"pid\":%d,\"tid\":%d}", name, pCategory, Stamp(start),
+                (now - start) / 1000.0, (int)getpid(), Tid());
+    }
+    pthread_mutex_unlock(&timeline_lock);
+}
+
+void timeline_async(const char *pName, const char *pCategory, long long start)
+{
+    char            name[NAME_SIZE];
+    unsigned int    id;
+    long long       now;
+
+    if (!__atomic_load_n(&timeline_on, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    now = metrics_now();
+    Escape(name, sizeof(name), pName);
+    id = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&timeline_lock);
+    if (timeline_file != NULL)
+    {
+        fprintf(timeline_file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"b\",\"id\":%u,"
+                "\"ts\":%.3f,\"pid\":%d,\"tid\":%d}", name, pCategory, id, Stamp(start),
+                (int)getpid(), Tid());
+        fprintf(timeline_file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\",\"id\":%u,"
+                "\"ts\":%.3f,\"pid\":%d,\"tid\":%d}", name, pCategory, id, Stamp(now),
+                (int)getpid(), Tid());
+    }
+    pthread_mutex_unlock(&timeline_lock);
+}
+
+void timeline_instant(const char *pName, const char *pCategory)
+{
+    char name[NAME_SIZE];
+
+    if (!__atomic_load_n(&timeline_on, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    Escape(name, sizeof(name), pName);
+    pthread_mutex_lock(&timeline_lock);
+    if (timeline_file != NULL)
+    {
+        fprintf(timeline_file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+                "\"ts\":%.3f,\"pid\":%d,\"tid\":%d}", name, pCategory, Stamp(metrics_now()),
+                (int)getpid(), Tid());
+    }
+    pthread_mutex_unlock(&timeline_lock);
+}
@@ -0,0 +1,27 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+/* Timeline (-l). Spans of work on every thread are written as Chrome
+   trace JSON, for ui.perfetto.dev or chrome://tracing, to show where the
+   pipeline waits: a USB write waiting on a worker's disk read, an ack
+   stall, the console holding up its thread. Every metrics phase is a
+   span, plus a few stages of the file server of its own.
+
+   Stamps come from metrics_now(). When the timeline is off every call
+   returns after testing one flag. */
+
+int timeline_open(const char *pFilename);
+void timeline_close(void);
+int timeline_enabled(void);
+
+//names the calling thread in the timeline
+void timeline_thread(const char *pName);
+//a span from start (metrics_now()) to now on the calling thread
+void timeline_span(const char *pName, const char *pCategory, long long start);
+//the same, for spans that overlap others on the thread, like pipelined
+//requests. they get a track of their own
+void timeline_async(const char *pName, const char *pCategory, long long start);
+//something that happened at one point, like a resync
+void timeline_instant(const char *pName, const char *pCategory);
+
+#endif // TIMELINE_H
@@ -0,0 +1,198 @@
+/*
+    trace.c: file server request trace
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "trace.h"
+
+/* File format, all values big endian:
+   "SATTRACE", version, wall clock time the trace started (microseconds),
+   then one record per request: name length (2 bytes), name, size, result
+   (1 byte), request time (8 bytes), then the other stages as 4 byte
+   offsets from the request time, 0xffffffff if they never happened */
+#define TRACE_MAGIC "SATTRACE"
+#define TRACE_VERSION (1)
+#define TRACE_STAGES (5)
+#define TRACE_NO_OFFSET (0xffffffff)
+
+static FILE *trace_file = NULL;
+static struct timespec trace_start;
+
+static void PutValue(unsigned char *p, unsigned long long value, int bytes)
+{
+    while (bytes-- > 0)
+    {
+        p[bytes] = (unsigned char)value;
+        value >>= 8;
+    }
+}
+
+static unsigned long long GetValue(const unsigned char *p, int bytes)
+{
+    unsigned long long value = 0;
+
+    while (bytes-- > 0)
+    {
+        value = (value << 8) | *p++;
+    }
+    return value;
+}
+
+int trace_open(const char *pFilename)
+{
+    unsigned char   header[20];
+    struct timeval  now;
+
+    trace_file = fopen(pFilename, "wb");
+    if (trace_file == NULL)
+    {
+        printf("Error creating trace file '%s'\n", pFilename);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+    gettimeofday(&now, NULL);
+    memcpy(header, TRACE_MAGIC, 8);
+    PutValue(&header[8], TRACE_VERSION, 4);
+    PutValue(&header[12], now.tv_sec * 1000000ull + now.tv_usec, 8);
+    fwrite(header, 1, sizeof(header), trace_file);
+    return 1;
+}
+
+void trace_close(void)
+{
+    if (trace_file != NULL)
+    {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+}
+
+int trace_enabled(void)
+{
+    return trace_file != NULL;
+}
+
+long long trace_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - trace_start.tv_sec) * 1000000ll +
+           (now.tv_nsec - trace_start.tv_nsec) / 1000;
+}
+
+void trace_write(const trace_entry_t *pEntry)
+{
+    unsigned char   record[2 + 255 + 4 + 1 + 8 + TRACE_STAGES * 4];
+    long long       stages[TRACE_STAGES];
+    unsigned int    len = strlen(pEntry->name), pos;
+    int             ii;
+
+    if (trace_file == NULL)
+    {
+        return;
+    }
+
+    if (len > 255)
+    {
+        len = 255;
+    }
+    PutValue(record, len, 2);
+    memcpy(&record[2], pEntry->name, len);
+    pos = 2 + len;
+    PutValue(&record[pos], pEntry->size, 4);
+    record[pos + 4] = (unsigned char)pEntry->result;
+    PutValue(&record[pos + 5], pEntry->requested, 8);
+    pos += 13;
+
+    stages[0] = pEntry->read_start;
+    stages[1] = pEntry->read_end;
+    stages[2] = pEntry->send_start;
+    stages[3] = pEntry->send_end;
+    stages[4] = pEntry->acked;
+    for (ii = 0; ii < TRACE_STAGES; ii++, pos += 4)
+    {
+        PutValue(&record[pos], stages[ii] == TRACE_NEVER ? TRACE_NO_OFFSET :
+                               stages[ii] - pEntry->requested, 4);
+    }
+
+    fwrite(record, 1, pos, trace_file);
+}
+
+long long trace_read_header(FILE *pFile)
+{
+    unsigned char header[20];
+
+    if (fread(header, 1, sizeof(header), pFile) != sizeof(header) ||
+        memcmp(header, TRACE_MAGIC, 8) || GetValue(&header[8], 4) != TRACE_VERSION)
+    {
+        return 0;
+    }
+
+    return (long long)GetValue(&header[12], 8);
+}
+
+int trace_read(FILE *pFile, trace_entry_t *pEntry)
+{
+    unsigned char   record[13 + TRACE_STAGES * 4];
+    long long      *stages[TRACE_STAGES];
+    unsigned int    len, offset;
+    int             ii;
+
+    if (fread(record, 1, 2, pFile) != 2)
+    {
+        return 0;
+    }
+    len = GetValue(record, 2);
+    if (len > 255 || fread(pEntry->name, 1, len, pFile) != len ||
+        fread(record, 1, sizeof(record), pFile) != sizeof(record))
+    {
+        return 0;
+    }
+    pEntry->name[len] = '\0';
+
+    pEntry->size = GetValue(record, 4);
+    pEntry->result = record[4];
+    pEntry->requested = GetValue(&record[5], 8);
+
+    stages[0] = &pEntry->read_start;
+    stages[1] = &pEntry->read_end;
+    stages[2] = &pEntry->send_start;
+    stages[3] = &pEntry->send_end;
+    stages[4] = &pEntry->acked;
+    for (ii = 0; ii < TRACE_STAGES; ii++)
+    {
+        offset = GetValue(&record[13 + ii * 4], 4);
+        *stages[ii] = offset == TRACE_NO_OFFSET ? TRACE_NEVER : pEntry->requested + offset;
+    }
+
+    return 1;
+}
@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+
+/* Per-request timing trace for the file server (-t). Every request it
+   handles becomes one record with the times it went through each stage,
+   in microseconds since the trace was opened. satrace turns a trace into
+   a report. */
+
+enum
+{
+    TRACE_OK = 0,
+    TRACE_MISSING,  // couldn't be opened
+    TRACE_FAILED,   // read error or the client rejected the checksum
+    TRACE_ABORTED   // dropped by a resync or shutdown
+};
+
+// stages that never happened are TRACE_NEVER
+#define TRACE_NEVER (-1ll)
+
+typedef struct
+{
+    char            name[256];
+    unsigned int    size;
+    int             result;
+    long long       requested;  // the client's request arrived
+    long long       read_start; // a worker had the file open
+    long long       read_end;   // the worker had read all of it
+    long long       send_start; // the upload header was queued
+    long long       send_end;   // the last data frame went out
+    long long       acked;      // the client's checksum result arrived
+} trace_entry_t;
+
+int trace_open(const char *pFilename);
+void trace_close(void);
+int trace_enabled(void);
+//microseconds since trace_open
+long long trace_now(void);
+void trace_write(const trace_entry_t *pEntry);
+
+//for reading a trace back, returns the wall clock start time in
+//microseconds, or 0 if it isn't a trace
+long long trace_read_header(FILE *pFile);
+//returns 0 at the end of the trace
+int trace_read(FILE *pFile, trace_entry_t *pEntry);
+
+#endif // TRACE_H
@@ -0,0 +1,251 @@
+/*
+    usbread.c: raw libusb bulk reads
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "ftdi.h"
+#include "libusb.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define USBREAD_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "usbread.h"
+
+#define STATUS_SIZE (2)
+
+/* Each kernel moves one packet's payload down over its status bytes. All
+   loads for a block happen before its stores, and the last block is loaded
+   before anything is stored, so copying in place is safe. The last block
+   overlaps the one before it instead of needing a scalar tail. */
+
+static void StripScalar(unsigned char *dst, const unsigned char *src, unsigned int payload)
+{
+    memmove(dst, src + STATUS_SIZE, payload);
+}
+
+#ifdef USBREAD_X86
+__attribute__((target("avx2")))
+static void StripAVX2(unsigned char *dst, const unsigned char *src, unsigned int payload)
+{
+    __m256i         tail, block;
+    unsigned int    ii;
+
+    if (payload < 32)
+    {
+        StripScalar(dst, src, payload);
+        return;
+    }
+
+    src += STATUS_SIZE;
+    tail = _mm256_loadu_si256((const __m256i *)&src[payload - 32]);
+    for (ii = 0; ii + 32 <= payload; ii += 32)
+    {
+        block = _mm256_loadu_si256((const __m256i *)&src[ii]);
+        _mm256_storeu_si256((__m256i *)&dst[ii], block);
+    }
+    _mm256_storeu_si256((__m256i *)&dst[payload - 32], tail);
+}
+
+static void StripSSE2(unsigned char *dst, const unsigned char *src, unsigned int payload)
+{
+    __m128i         tail, block;
+    unsigned int    ii;
+
+    if (payload < 16)
+    {
+        StripScalar(dst, src, payload);
+        return;
+    }
+
+    src += STATUS_SIZE;
+    tail = _mm_loadu_si128((const __m128i *)&src[payload - 16]);
+    for (ii = 0; ii + 16 <= payload; ii += 16)
+    {
+        block = _mm_loadu_si128((const __m128i *)&src[ii]);
+        _mm_storeu_si128((__m128i *)&dst[ii], block);
+    }
+    _mm_storeu_si128((__m128i *)&dst[payload - 16], tail);
+}
+#elif defined(__ARM_NEON)
+static void StripNEON(unsigned char *dst, const unsigned char *src, unsigned int payload)
+{
+    uint8x16_t      tail, block;
+    unsigned int    ii;
+
+    if (payload < 16)
+    {
+        StripScalar(dst, src, payload);
+        return;
+    }
+
+    src += STATUS_SIZE;
+    tail = vld1q_u8(&src[payload - 16]);
+    for (ii = 0; ii + 16 <= payload; ii += 16)
+    {
+        block = vld1q_u8(&src[ii]);
+        vst1q_u8(&dst[ii], block);
+    }
+    vst1q_u8(&dst[payload - 16], tail);
+}
+#endif
+
+static void (*SelectKernel(void))(unsigned char *, const unsigned char *, unsigned int)
+{
+#ifdef USBREAD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return StripAVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return StripSSE2;
+    }
+#elif defined(__ARM_NEON)
+    return StripNEON;
+#endif
+    return StripScalar;
+}
+
+unsigned int usbread_strip(unsigned char *pDst, const unsigned char *pSrc,
+                           unsigned int size, unsigned int packet_size)
+{
+    static void (*strip)(unsigned char *, const unsigned char *, unsigned int) = NULL;
+    unsigned int in = 0, out = 0, len;
+
+    if (strip == NULL)
+    {
+        strip = SelectKernel();
+    }
+
+    // only the last packet of a transfer can be short
+    while (in < size)
+    {
+        len = size - in < packet_size ? size - in : packet_size;
+        if (len > STATUS_SIZE)
+        {
+            strip(&pDst[out], &pSrc[in], len - STATUS_SIZE);
+            out += len - STATUS_SIZE;
+        }
+        in += len;
+    }
+
+    return out;
+}
+
+static int BulkRead(struct ftdi_context *pFtdi, unsigned char *pBuffer, int size)
+{
+    int status, actual = 0;
+
+    status = libusb_bulk_transfer(pFtdi->usb_dev, pFtdi->out_ep, pBuffer, size,
+                                  &actual, pFtdi->usb_read_timeout);
+    // a timeout can still have delivered some packets
+    if (status < 0 && status != LIBUSB_ERROR_TIMEOUT)
+    {
+        pFtdi->error_str = "usb bulk read failed";
+        return status;
+    }
+
+    return actual;
+}
+
+int usbread_data(usbread_t *pRead, struct ftdi_context *pFtdi, unsigned char *pBuffer, int size)
+{
+    unsigned int    packet = pFtdi->max_packet_size ? pFtdi->max_packet_size : 64;
+    int             copied = 0, count, status;
+
+    if (packet > USBREAD_MAX_PACKET)
+    {
+        packet = USBREAD_MAX_PACKET;
+    }
+
+    // anything libftdi already buffered comes first
+    if (pFtdi->readbuffer_remaining > 0)
+    {
+        count = (int)pFtdi->readbuffer_remaining < size ? (int)pFtdi->readbuffer_remaining : size;
+        memcpy(pBuffer, &pFtdi->readbuffer[pFtdi->readbuffer_offset], count);
+        pFtdi->readbuffer_offset += count;
+        pFtdi->readbuffer_remaining -= count;
+        copied += count;
+    }
+
+    if (pRead->residual_len > 0 && copied < size)
+    {
+        count = (int)pRead->residual_len < size - copied ? (int)pRead->residual_len : size - copied;
+        memcpy(&pBuffer[copied], &pRead->residual[pRead->residual_offset], count);
+        pRead->residual_offset += count;
+        pRead->residual_len -= count;
+        copied += count;
+    }
+
+    if (copied == size)
+    {
+        return copied;
+    }
+
+    // whole packets that fit land in the caller's buffer and get
+    // compacted there. Stop at the first short transfer, the FTDI
+    // has nothing more right now
+    while ((unsigned int)(size - copied) >= packet)
+    {
+        count = (size - copied) / packet * packet;
+        status = BulkRead(pFtdi, &pBuffer[copied], count);
+        if (status < 0)
+        {
+            return status;
+        }
+        copied += usbread_strip(&pBuffer[copied], &pBuffer[copied], status, packet);
+        if (status < count)
+        {
+            return copied;
+        }
+    }
+
+    // the rest is smaller than a packet, so read one into the side buffer
+    if (copied == 0)
+    {
+        status = BulkRead(pFtdi, pRead->residual, packet);
+        if (status < 0)
+        {
+            return status;
+        }
+        pRead->residual_len = usbread_strip(pRead->residual, pRead->residual, status, packet);
+        pRead->residual_offset = 0;
+
+        count = (int)pRead->residual_len < size ? (int)pRead->residual_len : size;
+        memcpy(pBuffer, pRead->residual, count);
+        pRead->residual_offset = count;
+        pRead->residual_len -= count;
+        copied = count;
+    }
+
+    return copied;
+}
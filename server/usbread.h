@@ -0,0 +1,30 @@
+#ifndef USBREAD_H
+#define USBREAD_H
+
+/* Alternative to ftdi_read_data. Bulk transfers go straight into the
+   caller's buffer, and the two modem status bytes at the start of every
+   packet are squeezed out in place with a vector copy. This skips libftdi's
+   intermediate read buffer and its per-packet memmoves. */
+
+struct ftdi_context;
+
+// largest FTDI bulk packet (high speed parts)
+#define USBREAD_MAX_PACKET (512)
+
+/* Per device: payload that came in past the end of a caller's buffer, handed
+   out by the next read. A zeroed one is ready to use. */
+typedef struct
+{
+    unsigned char   residual[USBREAD_MAX_PACKET];
+    unsigned int    residual_offset;
+    unsigned int    residual_len;
+} usbread_t;
+
+//same contract as ftdi_read_data: bytes read, 0 on timeout, <0 on error
+int usbread_data(usbread_t *pRead, struct ftdi_context *pFtdi, unsigned char *pBuffer, int size);
+//strips the status bytes from size bytes of raw packets, dst may equal src.
+//returns the payload length
+unsigned int usbread_strip(unsigned char *pDst, const unsigned char *pSrc,
+                           unsigned int size, unsigned int packet_size);
+
+#endif // USBREAD_H
@@ -0,0 +1,621 @@
+/*
+    xfer.c: non-blocking transfers for event loops
+
+    Copyright  2026 satbug contributors
+    All rights reserved.
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+    ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+    LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+    CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+    SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+    INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+    CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+    ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+    POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "crc.h"
+#include "crcpar.h"
+#include "devcart.h"
+#include "elf.h"
+#include "metrics.h"
+#include "xfer.h"
+
+// progress is reported each time this much more has gone over USB
+#define XFER_CHUNK (64*1024)
+
+enum
+{
+    JOB_UPLOAD = 0,
+    JOB_DOWNLOAD,
+    JOB_UPLOAD_IMAGE,   // ELF or swapped, through the blocking calls
+    JOB_EXECUTE
+};
+
+typedef struct xfer_job
+{
+    struct xfer_job    *next;
+    unsigned int        id;
+    int                 kind;
+    unsigned char      *data;   // const for everything but downloads
+    unsigned int        size;
+    unsigned int        address;
+    xfer_callback_t     callback;
+    void               *user;
+} xfer_job_t;
+
+typedef struct xfer_event
+{
+    struct xfer_event  *next;
+    xfer_job_t         *job;
+    int                 status;
+    unsigned int        done;
+} xfer_event_t;
+
+typedef struct
+{
+    xfer_job_t *head;
+    xfer_job_t *tail;
+} job_list_t;
+
+struct xfer_queue
+{
+    devcart_t          *cart;
+    pthread_t           send_thread;
+    pthread_t           receive_thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      work;       // something to send or to receive
+    pthread_cond_t      drained;    // nothing left waiting for an answer
+    job_list_t          pending;    // submitted, not sent yet
+    job_list_t          sent;       // waiting for the cart's answer
+    xfer_event_t       *events;
+    xfer_event_t       *events_tail;
+    int                 stop;
+    int                 fds[2];     // the same eventfd twice on Linux
+    unsigned int        next_id;    // only touched by the caller's thread
+    int                 outstanding;
+};
+
+static void Append(job_list_t *pList, xfer_job_t *pJob)
+{
+    pJob->next = NULL;
+    if (pList->tail != NULL)
+    {
+        pList->tail->next = pJob;
+    }
+    else
+    {
+        pList->head = pJob;
+    }
+    pList->tail = pJob;
+}
+
+static xfer_job_t *Take(job_list_t *pList)
+{
+    xfer_job_t *job = pList->head;
+
+    if (job != NULL)
+    {
+        pList->head = job->next;
+        if (pList->head == NULL)
+        {
+            pList->tail = NULL;
+        }
+    }
+    return job;
+}
+
+static void Signal(xfer_queue_t *pQueue)
+{
+#ifdef __linux__
+    unsigned long long one = 1;
+
+    if (write(pQueue->fds[1], &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        printf("Transfer queue signal error: %s\n", strerror(errno));
+    }
+#else
+    unsigned char one = 1;
+
+    // a full pipe is already readable
+    if (write(pQueue->fds[1], &one, 1) < 0 && errno != EAGAIN)
+    {
+        printf("Transfer queue signal error: %s\n", strerror(errno));
+    }
+#endif
+}
+
+// called from the worker threads, the callbacks run in xfer_dispatch
+static void Post(xfer_queue_t *pQueue, xfer_job_t *pJob, const int Status,
+                 const unsigned int Done)
+{
+    xfer_event_t *event = malloc(sizeof(xfer_event_t));
+
+    if (event == NULL)
+    {
+        if (Status == XFER_PROGRESS)
+        {
+            // progress can be lost, the end of a transfer can't
+            return;
+        }
+        printf("Memory allocation error\n");
+        exit(1);
+    }
+    event->next = NULL;
+    event->job = pJob;
+    event->status = Status;
+    event->done = Done;
+
+    pthread_mutex_lock(&pQueue->lock);
+    if (pQueue->events_tail != NULL)
+    {
+        pQueue->events_tail->next = event;
+    }
+    else
+    {
+        pQueue->events = event;
+    }
+    pQueue->events_tail = event;
+    pthread_mutex_unlock(&pQueue->lock);
+
+    Signal(pQueue);
+}
+
+static int Stopping(xfer_queue_t *pQueue)
+{
+    int stop;
+
+    pthread_mutex_lock(&pQueue->lock);
+    stop = pQueue->stop;
+    pthread_mutex_unlock(&pQueue->lock);
+    return stop;
+}
+
+static int SendUpload(xfer_queue_t *pQueue, xfer_job_t *pJob)
+{
+    crc_t           checksum = crc_init();
+    unsigned int    sent = 0, chunk;
+    long long       start = metrics_now();
+
+    checksum = crc_parallel(checksum, pJob->data, pJob->size);
+    checksum = crc_finalize(checksum);
+    metrics_phase(METRICS_CRC, start);
+
+    if (!devcart_upload_begin(pQueue->cart, pJob->address, pJob->size))
+    {
+        return 0;
+    }
+    while (sent < pJob->size)
+    {
+        chunk = pJob->size - sent < XFER_CHUNK ? pJob->size - sent : XFER_CHUNK;
+        if (!devcart_upload_data(pQueue->cart, &pJob->data[sent], chunk))
+        {
+            return 0;
+        }
+        sent += chunk;
+        Post(pQueue, pJob, XFER_PROGRESS, sent);
+    }
+    return devcart_upload_checksum(pQueue->cart, checksum);
+}
+
+// runs the transfer through the blocking calls once nothing's in flight
+static int RunBlocking(xfer_queue_t *pQueue, xfer_job_t *pJob)
+{
+    pthread_mutex_lock(&pQueue->lock);
+    while (pQueue->sent.head != NULL && !pQueue->stop)
+    {
+        pthread_cond_wait(&pQueue->drained, &pQueue->lock);
+    }
+    pthread_mutex_unlock(&pQueue->lock);
+
+    if (pJob->kind == JOB_EXECUTE)
+    {
+        return devcart_execute_image(pQueue->cart, pJob->data, pJob->size, pJob->address);
+    }
+    return devcart_upload_image(pQueue->cart, pJob->data, pJob->size, pJob->address);
+}
+
+static void *SendThread(void *pArg)
+{
+    xfer_queue_t   *queue = pArg;
+    xfer_job_t     *job;
+    int             ok;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->pending.head == NULL && !queue->stop)
+        {
+            pthread_cond_wait(&queue->work, &queue->lock);
+        }
+        if (queue->stop)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        job = Take(&queue->pending);
+        pthread_mutex_unlock(&queue->lock);
+
+        if (job->kind == JOB_UPLOAD_IMAGE || job->kind == JOB_EXECUTE)
+        {
+            ok = RunBlocking(queue, job);
+            Post(queue, job, ok ? XFER_DONE : XFER_FAILED, ok ? job->size : 0);
+            continue;
+        }
+
+        if (job->kind == JOB_DOWNLOAD)
+        {
+            ok = devcart_download_request(queue->cart, job->address, job->size);
+        }
+        else
+        {
+            ok = SendUpload(queue, job);
+        }
+
+        if (!ok)
+        {
+            Post(queue, job, XFER_FAILED, 0);
+            continue;
+        }
+        // the answer is the receive thread's to wait for
+        pthread_mutex_lock(&queue->lock);
+        Append(&queue->sent, job);
+        pthread_cond_broadcast(&queue->work);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    return NULL;
+}
+
+// the cart takes a while to answer, so this waits through read timeouts
+static int ReadByte(xfer_queue_t *pQueue, unsigned char *pByte)
+{
+    int status;
+
+    do
+    {
+        status = devcart_read(pQueue->cart, pByte, 1);
+        if (status < 0)
+        {
+            printf("Read data error: %s\n", devcart_get_error(pQueue->cart));
+            return 0;
+        }
+    } while (status == 0 && !Stopping(pQueue));
+
+    return status == 1;
+}
+
+static int ReceiveDownload(xfer_queue_t *pQueue, xfer_job_t *pJob)
+{
+    unsigned int    received = 0, reported = 0;
+    int             status;
+    unsigned char   checksum;
+    crc_t           calcChecksum = crc_init();
+    long long       start = metrics_now();
+
+    while (received < pJob->size)
+    {
+        status = devcart_read(pQueue->cart, &pJob->data[received], pJob->size - received);
+        if (status < 0)
+        {
+            printf("Read data error: %s\n", devcart_get_error(pQueue->cart));
+            return 0;
+        }
+        if (status == 0 && Stopping(pQueue))
+        {
+            return 0;
+        }
+        received += status;
+        if (received - reported >= XFER_CHUNK || received == pJob->size)
+        {
+            Post(pQueue, pJob, XFER_PROGRESS, received);
+            reported = received;
+        }
+    }
+    metrics_phase(METRICS_USB_READ, start);
+    metrics_bytes(pJob->size);
+
+    if (!ReadByte(pQueue, &checksum))
+    {
+        return 0;
+    }
+
+    calcChecksum = crc_parallel(calcChecksum, pJob->data, pJob->size);
+    calcChecksum = crc_finalize(calcChecksum);
+    if (calcChecksum != checksum)
+    {
+        printf("Checksum error (%02x, %02x)\n", calcChecksum, checksum);
+        return 0;
+    }
+    return 1;
+}
+
+static void *ReceiveThread(void *pArg)
+{
+    xfer_queue_t   *queue = pArg;
+    xfer_job_t     *job;
+    unsigned char   result;
+    int             ok;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->sent.head == NULL && !queue->stop)
+        {
+            pthread_cond_wait(&queue->work, &queue->lock);
+        }
+        if (queue->stop)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        // stays on the list while it's read, so a blocking transfer waits
+        job = queue->sent.head;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (job->kind == JOB_DOWNLOAD)
+        {
+            ok = ReceiveDownload(queue, job);
+        }
+        else
+        {
+            ok = ReadByte(queue, &result) && result == 0;
+        }
+
+        pthread_mutex_lock(&queue->lock);
+        Take(&queue->sent);
+        if (queue->sent.head == NULL)
+        {
+            pthread_cond_signal(&queue->drained);
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        Post(queue, job, ok ? XFER_DONE : XFER_FAILED, ok ? job->size : 0);
+    }
+
+    return NULL;
+}
+
+static int OpenSignal(xfer_queue_t *pQueue)
+{
+#ifdef __linux__
+    pQueue->fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pQueue->fds[1] = pQueue->fds[0];
+    return pQueue->fds[0] >= 0;
+#else
+    if (pipe(pQueue->fds) < 0)
+    {
+        return 0;
+    }
+    fcntl(pQueue->fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(pQueue->fds[1], F_SETFL, O_NONBLOCK);
+    fcntl(pQueue->fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pQueue->fds[1], F_SETFD, FD_CLOEXEC);
+    return 1;
+#endif
+}
+
+static void CloseSignal(xfer_queue_t *pQueue)
+{
+    close(pQueue->fds[0]);
+    if (pQueue->fds[1] != pQueue->fds[0])
+    {
+        close(pQueue->fds[1]);
+    }
+}
+
+xfer_queue_t *xfer_open(devcart_t *pCart)
+{
+    xfer_queue_t *queue = calloc(1, sizeof(xfer_queue_t));
+
+    if (queue == NULL)
+    {
+        printf("Memory allocation error\n");
+        return NULL;
+    }
+    queue->cart = pCart;
+    queue->next_id = 1;
+
+    if (!OpenSignal(queue))
+    {
+        printf("Can't create the transfer queue's descriptor: %s\n", strerror(errno));
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->work, NULL);
+    pthread_cond_init(&queue->drained, NULL);
+
+    if (pthread_create(&queue->send_thread, NULL, SendThread, queue) != 0)
+    {
+        printf("Can't start the transfer queue\n");
+        CloseSignal(queue);
+        free(queue);
+        return NULL;
+    }
+    if (pthread_create(&queue->receive_thread, NULL, ReceiveThread, queue) != 0)
+    {
+        printf("Can't start the transfer queue\n");
+        pthread_mutex_lock(&queue->lock);
+        queue->stop = 1;
+        pthread_cond_broadcast(&queue->work);
+        pthread_mutex_unlock(&queue->lock);
+        pthread_join(queue->send_thread, NULL);
+        CloseSignal(queue);
+        free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+static void FreeJobs(xfer_job_t *pJob)
+{
+    xfer_job_t *next;
+
+    for (; pJob != NULL; pJob = next)
+    {
+        next = pJob->next;
+        free(pJob);
+    }
+}
+
+void xfer_close(xfer_queue_t *pQueue)
+{
+    xfer_event_t   *event, *next;
+
+    if (pQueue == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pQueue->lock);
+    pQueue->stop = 1;
+    pthread_cond_broadcast(&pQueue->work);
+    pthread_cond_broadcast(&pQueue->drained);
+    pthread_mutex_unlock(&pQueue->lock);
+    pthread_join(pQueue->send_thread, NULL);
+    pthread_join(pQueue->receive_thread, NULL);
+
+    // finished jobs are only referenced by their last event
+    for (event = pQueue->events; event != NULL; event = next)
+    {
+        next = event->next;
+        if (event->status != XFER_PROGRESS)
+        {
+            free(event->job);
+        }
+        free(event);
+    }
+    FreeJobs(pQueue->pending.head);
+    FreeJobs(pQueue->sent.head);
+
+    pthread_mutex_destroy(&pQueue->lock);
+    pthread_cond_destroy(&pQueue->work);
+    pthread_cond_destroy(&pQueue->drained);
+    CloseSignal(pQueue);
+    free(pQueue);
+}
+
+int xfer_fd(xfer_queue_t *pQueue)
+{
+    return pQueue->fds[0];
+}
+
+static unsigned int Submit(xfer_queue_t *pQueue, const int Kind, unsigned char *pData,
+                           const unsigned int Size, const unsigned int Address,
+                           xfer_callback_t Callback, void *pUser)
+{
+    xfer_job_t *job = malloc(sizeof(xfer_job_t));
+
+    if (job == NULL)
+    {
+        printf("Memory allocation error\n");
+        return 0;
+    }
+    job->id = pQueue->next_id++;
+    if (pQueue->next_id == 0)
+    {
+        pQueue->next_id = 1;
+    }
+    job->kind = Kind;
+    job->data = pData;
+    job->size = Size;
+    job->address = Address;
+    job->callback = Callback;
+    job->user = pUser;
+    pQueue->outstanding++;
+
+    pthread_mutex_lock(&pQueue->lock);
+    Append(&pQueue->pending, job);
+    pthread_cond_broadcast(&pQueue->work);
+    pthread_mutex_unlock(&pQueue->lock);
+
+    return job->id;
+}
+
+unsigned int xfer_upload(xfer_queue_t *pQueue, const unsigned char *pData,
+                         const unsigned int Size, const unsigned int Address,
+                         xfer_callback_t Callback, void *pUser)
+{
+    int kind = JOB_UPLOAD;
+
+    // these need the caller's data reworked or split, which the blocking
+    // calls already do
+    if (elf_is_elf(pData, Size) || devcart_swapping(pQueue->cart))
+    {
+        kind = JOB_UPLOAD_IMAGE;
+    }
+    return Submit(pQueue, kind, (unsigned char *)pData, Size, Address, Callback, pUser);
+}
+
+unsigned int xfer_download(xfer_queue_t *pQueue, unsigned char *pBuffer,
+                           const unsigned int Address, const unsigned int Size,
+                           xfer_callback_t Callback, void *pUser)
+{
+    return Submit(pQueue, JOB_DOWNLOAD, pBuffer, Size, Address, Callback, pUser);
+}
+
+unsigned int xfer_execute(xfer_queue_t *pQueue, const unsigned char *pData,
+                          const unsigned int Size, const unsigned int Address,
+                          xfer_callback_t Callback, void *pUser)
+{
+    return Submit(pQueue, JOB_EXECUTE, (unsigned char *)pData, Size, Address, Callback, pUser);
+}
+
+int xfer_dispatch(xfer_queue_t *pQueue)
+{
+    unsigned char   drain[64];
+    xfer_event_t   *event, *next;
+
+    // the descriptor only says there's something, the list says what
+    while (read(pQueue->fds[0], drain, sizeof(drain)) > 0)
+    {
+    }
+
+    pthread_mutex_lock(&pQueue->lock);
+    event = pQueue->events;
+    pQueue->events = NULL;
+    pQueue->events_tail = NULL;
+    pthread_mutex_unlock(&pQueue->lock);
+
+    for (; event != NULL; event = next)
+    {
+        next = event->next;
+        if (event->job->callback != NULL)
+        {
+            event->job->callback(event->job->id, event->status, event->done,
+                                 event->job->size, event->job->user);
+        }
+        if (event->status != XFER_PROGRESS)
+        {
+            free(event->job);
+            pQueue->outstanding--;
+        }
+        free(event);
+    }
+
+    return pQueue->outstanding;
+}
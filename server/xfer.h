@@ -0,0 +1,58 @@
+#ifndef XFER_H
+#define XFER_H
+
+#include "devcart.h"
+
+/* Non-blocking uploads, downloads and executes for programs built around
+   an event loop. A transfer is submitted and returns straight away, two
+   threads per queue do the USB work, and completion and progress are
+   signalled on a file descriptor the caller adds to its poll/epoll set.
+   When it's readable, xfer_dispatch runs the callbacks on the caller's
+   thread.
+
+   Plain uploads and downloads are pipelined: one thread sends commands
+   and data while the other reads the answers, which the cart gives in
+   command order, so any number can be in flight at once. ELF images,
+   byte swapped uploads and executes wait for the pipe to drain and then
+   go through the blocking calls, so they only report completion.
+
+   Every call on a queue has to come from the same thread. Data and
+   buffers handed to a transfer must stay valid until its callback has
+   reported XFER_DONE or XFER_FAILED. */
+
+enum
+{
+    XFER_PROGRESS = 0,  // done bytes of total have gone over USB
+    XFER_DONE,
+    XFER_FAILED
+};
+
+typedef struct xfer_queue xfer_queue_t;
+
+typedef void (*xfer_callback_t)(unsigned int Id, int Status, unsigned int Done,
+                                unsigned int Total, void *pUser);
+
+//the queue owns the cart's reads and writes until it's closed
+xfer_queue_t *xfer_open(devcart_t *pCart);
+//transfers not finished yet are dropped without their callbacks
+void xfer_close(xfer_queue_t *pQueue);
+//readable when there's something for xfer_dispatch
+int xfer_fd(xfer_queue_t *pQueue);
+
+//these return an id for the callbacks, 0 if it couldn't be queued.
+//Callback may be NULL
+unsigned int xfer_upload(xfer_queue_t *pQueue, const unsigned char *pData,
+                         const unsigned int Size, const unsigned int Address,
+                         xfer_callback_t Callback, void *pUser);
+unsigned int xfer_download(xfer_queue_t *pQueue, unsigned char *pBuffer,
+                           const unsigned int Address, const unsigned int Size,
+                           xfer_callback_t Callback, void *pUser);
+unsigned int xfer_execute(xfer_queue_t *pQueue, const unsigned char *pData,
+                          const unsigned int Size, const unsigned int Address,
+                          xfer_callback_t Callback, void *pUser);
+
+//runs callbacks for whatever has happened, returns the number of transfers
+//still outstanding. Never blocks
+int xfer_dispatch(xfer_queue_t *pQueue);
+
+#endif // XFER_H